@@ -1,11 +1,22 @@
 #version 450 core
 
 layout (location = 0) in vec3 a_Position;
+// Previous position in xy and current position in zw, as fractions of the domain.
+layout (location = 1) in vec4 a_Positions;
 
 uniform mat4 u_ViewProj;
-uniform mat4 u_Transform;
+uniform vec2 u_Scale;
+uniform vec2 u_DomainSize;
+uniform float u_Interpolation;
+uniform vec4 u_LowColor;
+uniform vec4 u_HighColor;
+
+out vec4 v_Color;
 
 void main()
 {
-	gl_Position = u_ViewProj * u_Transform * vec4(a_Position, 1.0);
+	// Coloured by the current height.
+	v_Color = mix(u_LowColor, u_HighColor, a_Positions.w);
+	vec2 offset = mix(a_Positions.xy, a_Positions.zw, u_Interpolation) * u_DomainSize;
+	gl_Position = u_ViewProj * vec4(a_Position.xy * u_Scale + offset, a_Position.z, 1.0);
 }
@@ -0,0 +1,633 @@
+// CPython extension exposing a headless ParticleSystem. Build it with setup.py next
+// to this file.
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "GLCore/Core/Log.h"
+#include "ParticleSystem.h"
+#include "Random.h"
+
+namespace {
+
+	struct SimulationObject
+	{
+		PyObject_HEAD
+		ParticleSystem* System;
+		// Set while step() runs without the GIL, nothing else may touch the system then.
+		bool Stepping;
+		// Views of the system's memory that are still alive. Like a bytearray, the
+		// system refuses to do anything that would move or free that memory until they
+		// are released.
+		Py_ssize_t Exports;
+	};
+
+	// Read-only float32 array in memory owned by a Simulation, which it keeps alive.
+	// Python only ever sees it through a memoryview.
+	struct FieldBufferObject
+	{
+		PyObject_HEAD
+		SimulationObject* Owner;
+		const float* Data;
+		int Dimensions;
+		Py_ssize_t Shape[3];
+		Py_ssize_t Strides[3];
+	};
+
+	PyTypeObject s_SimulationType = { PyVarObject_HEAD_INIT(nullptr, 0) "particlesim.Simulation" };
+	PyTypeObject s_FieldBufferType = { PyVarObject_HEAD_INIT(nullptr, 0) "particlesim.FieldBuffer" };
+
+	char s_Format[] = "f";
+
+	bool CheckIdle(SimulationObject* self)
+	{
+		if (self->Stepping)
+		{
+			PyErr_SetString(PyExc_RuntimeError, "the simulation is stepping on another thread");
+			return false;
+		}
+		return true;
+	}
+
+	// False with a BufferError set while views of the system's memory are alive. Anything
+	// that steps, reloads or rebuilds the system would leave them pointing at memory that
+	// was swapped, reordered or freed.
+	bool CheckUnexported(SimulationObject* self)
+	{
+		if (self->Exports > 0)
+		{
+			PyErr_SetString(PyExc_BufferError, "views of the simulation are still alive, release them first");
+			return false;
+		}
+		return true;
+	}
+
+	// ---- FieldBuffer ----
+
+	void FieldBuffer_Dealloc(FieldBufferObject* self)
+	{
+		Py_XDECREF(self->Owner);
+		Py_TYPE(self)->tp_free((PyObject*)self);
+	}
+
+	int FieldBuffer_GetBuffer(FieldBufferObject* self, Py_buffer* view, int flags)
+	{
+		if (flags & PyBUF_WRITABLE)
+		{
+			PyErr_SetString(PyExc_BufferError, "simulation fields are read-only");
+			view->obj = nullptr;
+			return -1;
+		}
+
+		Py_ssize_t count = 1;
+		for (int i = 0; i < self->Dimensions; ++i)
+			count *= self->Shape[i];
+		view->buf = (void*)self->Data;
+		view->obj = (PyObject*)self;
+		Py_INCREF(self);
+		view->len = count * (Py_ssize_t)sizeof(float);
+		view->readonly = 1;
+		view->itemsize = sizeof(float);
+		view->format = (flags & PyBUF_FORMAT) ? s_Format : nullptr;
+		// Without PyBUF_ND the consumer reads plain bytes, the data is C-contiguous.
+		view->ndim = (flags & PyBUF_ND) ? self->Dimensions : 1;
+		view->shape = (flags & PyBUF_ND) ? self->Shape : nullptr;
+		view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->Strides : nullptr;
+		view->suboffsets = nullptr;
+		view->internal = nullptr;
+		++self->Owner->Exports;
+		return 0;
+	}
+
+	void FieldBuffer_ReleaseBuffer(FieldBufferObject* self, Py_buffer*)
+	{
+		--self->Owner->Exports;
+	}
+
+	PyBufferProcs s_FieldBufferProcs = { (getbufferproc)FieldBuffer_GetBuffer, (releasebufferproc)FieldBuffer_ReleaseBuffer };
+
+	// memoryview of contiguous floats shaped shape[0] x ... x shape[dimensions - 1].
+	PyObject* MakeView(SimulationObject* owner, const float* data, int dimensions, const Py_ssize_t* shape)
+	{
+		FieldBufferObject* buffer = PyObject_New(FieldBufferObject, &s_FieldBufferType);
+		if (!buffer)
+			return nullptr;
+		buffer->Owner = owner;
+		Py_INCREF(owner);
+		buffer->Data = data;
+		buffer->Dimensions = dimensions;
+		Py_ssize_t stride = sizeof(float);
+		for (int i = dimensions - 1; i >= 0; --i)
+		{
+			buffer->Shape[i] = shape[i];
+			buffer->Strides[i] = stride;
+			stride *= shape[i];
+		}
+
+		PyObject* view = PyMemoryView_FromObject((PyObject*)buffer);
+		Py_DECREF(buffer);
+		return view;
+	}
+
+	PyObject* MakeFieldView(SimulationObject* self, const Grid2D<float>& field)
+	{
+		const Py_ssize_t shape[] = { field.GetHeight(), field.GetWidth() };
+		return MakeView(self, field.GetData(), 2, shape);
+	}
+
+	// ---- Simulation ----
+
+	PyObject* Simulation_New(PyTypeObject* type, PyObject*, PyObject*)
+	{
+		SimulationObject* self = (SimulationObject*)type->tp_alloc(type, 0);
+		if (self)
+		{
+			self->System = nullptr;
+			self->Stepping = false;
+			self->Exports = 0;
+		}
+		return (PyObject*)self;
+	}
+
+	void Simulation_Dealloc(SimulationObject* self)
+	{
+		delete self->System;
+		Py_TYPE(self)->tp_free((PyObject*)self);
+	}
+
+	// Builds the system for props, after seeding Random, which is shared by every
+	// system in the process.
+	bool CreateSystem(SimulationObject* self, const ParticleSystemProps& props, uint32_t seed, uint32_t threadCount)
+	{
+		if (!CheckIdle(self) || !CheckUnexported(self))
+			return false;
+		delete self->System;
+		self->System = nullptr;
+		Random::Init(seed);
+		try
+		{
+			self->System = new ParticleSystem(props);
+		}
+		catch (const std::bad_alloc&)
+		{
+			PyErr_NoMemory();
+			return false;
+		}
+		self->System->SetThreadCount(threadCount);
+		return true;
+	}
+
+	int Simulation_Init(SimulationObject* self, PyObject* args, PyObject* kwargs)
+	{
+		static const char* keywords[] = { "width", "height", "cell_size", "particles", "gravity",
+			"vorticity", "buoyancy", "seed", "threads", "particle_capacity", nullptr };
+		ParticleSystemProps props;
+		Py_ssize_t particleCount = (Py_ssize_t)props.ParticleCount;
+		Py_ssize_t particleCapacity = (Py_ssize_t)props.ParticleCapacity;
+		unsigned int seed = 5489, threadCount = 0;
+		if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|iifnfffIIn", (char**)keywords, &props.Width, &props.Height,
+			&props.CellSize, &particleCount, &props.Gravity, &props.VorticityEpsilon, &props.BuoyancyEpsilon,
+			&seed, &threadCount, &particleCapacity))
+			return -1;
+		if (props.Width < 3 || props.Height < 3 || props.CellSize <= 0.0f || particleCount < 0 || particleCapacity < 0)
+		{
+			PyErr_SetString(PyExc_ValueError, "width and height must be at least 3, cell_size positive and particles and particle_capacity not negative");
+			return -1;
+		}
+		props.ParticleCount = (size_t)particleCount;
+		props.ParticleCapacity = (size_t)particleCapacity;
+		return CreateSystem(self, props, seed, threadCount) ? 0 : -1;
+	}
+
+	bool CheckSystem(SimulationObject* self)
+	{
+		if (!self->System)
+		{
+			PyErr_SetString(PyExc_RuntimeError, "Simulation.__init__ was not called");
+			return false;
+		}
+		return CheckIdle(self);
+	}
+
+	PyObject* Simulation_Step(SimulationObject* self, PyObject* args, PyObject* kwargs)
+	{
+		static const char* keywords[] = { "count", "dt", nullptr };
+		int count = 1;
+		float deltaTime = 0.016f;
+		if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|if", (char**)keywords, &count, &deltaTime))
+			return nullptr;
+		if (!CheckSystem(self) || !CheckUnexported(self))
+			return nullptr;
+
+		self->Stepping = true;
+		Py_BEGIN_ALLOW_THREADS
+		for (int i = 0; i < count; ++i)
+			self->System->OnUpdate(deltaTime);
+		Py_END_ALLOW_THREADS
+		self->Stepping = false;
+		Py_RETURN_NONE;
+	}
+
+	PyObject* Simulation_SaveCheckpoint(SimulationObject* self, PyObject* args)
+	{
+		const char* path;
+		if (!PyArg_ParseTuple(args, "s", &path) || !CheckSystem(self))
+			return nullptr;
+		if (!self->System->SaveCheckpoint(path))
+			return PyErr_Format(PyExc_OSError, "could not write checkpoint '%s'", path);
+		Py_RETURN_NONE;
+	}
+
+	PyObject* Simulation_LoadCheckpoint(SimulationObject* self, PyObject* args)
+	{
+		const char* path;
+		if (!PyArg_ParseTuple(args, "s", &path) || !CheckSystem(self) || !CheckUnexported(self))
+			return nullptr;
+		if (!self->System->LoadCheckpoint(path))
+			return PyErr_Format(PyExc_OSError, "could not load checkpoint '%s'", path);
+		Py_RETURN_NONE;
+	}
+
+	// Simulation.from_checkpoint(path, threads=0), with the grid and parameters the
+	// checkpoint was saved with.
+	PyObject* Simulation_FromCheckpoint(PyObject* type, PyObject* args, PyObject* kwargs)
+	{
+		static const char* keywords[] = { "path", "threads", nullptr };
+		const char* path;
+		unsigned int threadCount = 0;
+		if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|I", (char**)keywords, &path, &threadCount))
+			return nullptr;
+
+		ParticleSystemProps props;
+		if (!ParticleSystem::ReadCheckpointProps(path, props))
+			return PyErr_Format(PyExc_OSError, "could not read checkpoint '%s'", path);
+		SimulationObject* self = (SimulationObject*)Simulation_New((PyTypeObject*)type, nullptr, nullptr);
+		if (!self)
+			return nullptr;
+		// The checkpoint carries the seed, LoadCheckpoint restores it.
+		if (!CreateSystem(self, props, Random::GetSeed(), threadCount))
+		{
+			Py_DECREF(self);
+			return nullptr;
+		}
+		if (!self->System->LoadCheckpoint(path))
+		{
+			Py_DECREF(self);
+			return PyErr_Format(PyExc_OSError, "could not load checkpoint '%s'", path);
+		}
+		return (PyObject*)self;
+	}
+
+	const char* const s_EmitterShapeNames[] = { "point", "line", "area" };
+	const char* const s_EmitterTriggerNames[] = { "always", "cloud_water", "vapor" };
+
+	// Index of name in names, or -1 with a ValueError set.
+	int FindName(const char* name, const char* const* names, int count, const char* what)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			if (std::strcmp(name, names[i]) == 0)
+				return i;
+		}
+		PyErr_Format(PyExc_ValueError, "unknown emitter %s '%s'", what, name);
+		return -1;
+	}
+
+	PyObject* Simulation_AddEmitter(SimulationObject* self, PyObject* args, PyObject* kwargs)
+	{
+		static const char* keywords[] = { "shape", "trigger", "start", "end", "threshold", "rate", "lifetime", nullptr };
+		ParticleEmitter emitter;
+		const char* shapeName = s_EmitterShapeNames[(int)emitter.Shape];
+		const char* triggerName = s_EmitterTriggerNames[(int)emitter.Trigger];
+		if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|ss(ff)(ff)fff", (char**)keywords, &shapeName, &triggerName,
+			&emitter.Start.x, &emitter.Start.y, &emitter.End.x, &emitter.End.y,
+			&emitter.Threshold, &emitter.Rate, &emitter.Lifetime))
+			return nullptr;
+		if (!CheckSystem(self))
+			return nullptr;
+		const int shape = FindName(shapeName, s_EmitterShapeNames, 3, "shape");
+		const int trigger = shape < 0 ? -1 : FindName(triggerName, s_EmitterTriggerNames, 3, "trigger");
+		if (trigger < 0)
+			return nullptr;
+		if (emitter.Rate < 0.0f || emitter.Lifetime < 0.0f)
+		{
+			PyErr_SetString(PyExc_ValueError, "rate and lifetime must not be negative");
+			return nullptr;
+		}
+		emitter.Shape = (EmitterShape)shape;
+		emitter.Trigger = (EmitterTrigger)trigger;
+		self->System->emitters.push_back(emitter);
+		Py_RETURN_NONE;
+	}
+
+	PyObject* Simulation_ClearEmitters(SimulationObject* self, PyObject*)
+	{
+		if (!CheckSystem(self))
+			return nullptr;
+		self->System->emitters.clear();
+		Py_RETURN_NONE;
+	}
+
+	PyObject* Simulation_GetTemperature(SimulationObject* self, void*)
+	{
+		return CheckSystem(self) ? MakeFieldView(self, self->System->GetTemperatureField()) : nullptr;
+	}
+
+	PyObject* Simulation_GetVapor(SimulationObject* self, void*)
+	{
+		return CheckSystem(self) ? MakeFieldView(self, self->System->GetVaporField()) : nullptr;
+	}
+
+	PyObject* Simulation_GetCloudWater(SimulationObject* self, void*)
+	{
+		return CheckSystem(self) ? MakeFieldView(self, self->System->GetCloudWaterField()) : nullptr;
+	}
+
+	PyObject* Simulation_GetPressure(SimulationObject* self, void*)
+	{
+		return CheckSystem(self) ? MakeFieldView(self, self->System->GetPressureField()) : nullptr;
+	}
+
+	PyObject* Simulation_GetProjectionPressure(SimulationObject* self, void*)
+	{
+		return CheckSystem(self) ? MakeFieldView(self, self->System->GetProjectionPressureField()) : nullptr;
+	}
+
+	PyObject* Simulation_GetVelocity(SimulationObject* self, void*)
+	{
+		if (!CheckSystem(self))
+			return nullptr;
+		const Grid2D<glm::vec2>& velocity = self->System->GetVelocityField();
+		const Py_ssize_t shape[] = { velocity.GetHeight(), velocity.GetWidth(), 2 };
+		return MakeView(self, &velocity.GetData()->x, 3, shape);
+	}
+
+	PyObject* Simulation_GetParticles(SimulationObject* self, void*)
+	{
+		if (!CheckSystem(self))
+			return nullptr;
+		const ParticleStore& particles = self->System->GetParticles();
+		const auto attributes = particles.GetAttributes();
+		PyObject* dict = PyDict_New();
+		if (!dict)
+			return nullptr;
+		const Py_ssize_t shape[] = { (Py_ssize_t)particles.GetCount() };
+		for (size_t i = 0; i < attributes.size(); ++i)
+		{
+			PyObject* view = MakeView(self, attributes[i]->data(), 1, shape);
+			if (!view || PyDict_SetItemString(dict, ParticleStore::GetAttributeName(i), view) < 0)
+			{
+				Py_XDECREF(view);
+				Py_DECREF(dict);
+				return nullptr;
+			}
+			Py_DECREF(view);
+		}
+		return dict;
+	}
+
+	// The closure of a float parameter's getter and setter says which one it is.
+	enum Parameter
+	{
+		ParameterGravity = 0,
+		ParameterVorticityEpsilon,
+		ParameterBuoyancyEpsilon,
+		ParameterFlipRatio
+	};
+
+	float* GetParameter(ParticleSystem* system, void* closure)
+	{
+		switch ((Parameter)(intptr_t)closure)
+		{
+		case ParameterGravity: return &system->gravity;
+		case ParameterVorticityEpsilon: return &system->vorticityEpsilon;
+		case ParameterBuoyancyEpsilon: return &system->buoyancyEpsilon;
+		case ParameterFlipRatio: return &system->GetParticleTransfer().FlipRatio;
+		}
+		return nullptr;
+	}
+
+	PyObject* Simulation_GetFloat(SimulationObject* self, void* closure)
+	{
+		return CheckSystem(self) ? PyFloat_FromDouble(*GetParameter(self->System, closure)) : nullptr;
+	}
+
+	int Simulation_SetFloat(SimulationObject* self, PyObject* value, void* closure)
+	{
+		if (!value)
+		{
+			PyErr_SetString(PyExc_AttributeError, "simulation parameters cannot be deleted");
+			return -1;
+		}
+		double parsed = PyFloat_AsDouble(value);
+		if (parsed == -1.0 && PyErr_Occurred())
+			return -1;
+		if (!CheckSystem(self))
+			return -1;
+		*GetParameter(self->System, closure) = (float)parsed;
+		return 0;
+	}
+
+	PyObject* Simulation_GetSparse(SimulationObject* self, void*)
+	{
+		return CheckSystem(self) ? PyBool_FromLong(self->System->activeTiles.Enabled) : nullptr;
+	}
+
+	int Simulation_SetSparse(SimulationObject* self, PyObject* value, void*)
+	{
+		if (!value)
+		{
+			PyErr_SetString(PyExc_AttributeError, "simulation parameters cannot be deleted");
+			return -1;
+		}
+		int enabled = PyObject_IsTrue(value);
+		if (enabled < 0 || !CheckSystem(self))
+			return -1;
+		self->System->activeTiles.Enabled = enabled != 0;
+		return 0;
+	}
+
+	PyObject* Simulation_GetSph(SimulationObject* self, void*)
+	{
+		return CheckSystem(self) ? PyBool_FromLong(self->System->sph.Enabled) : nullptr;
+	}
+
+	int Simulation_SetSph(SimulationObject* self, PyObject* value, void*)
+	{
+		if (!value)
+		{
+			PyErr_SetString(PyExc_AttributeError, "simulation parameters cannot be deleted");
+			return -1;
+		}
+		int enabled = PyObject_IsTrue(value);
+		if (enabled < 0 || !CheckSystem(self))
+			return -1;
+		self->System->sph.Enabled = enabled != 0;
+		return 0;
+	}
+
+	const char* const s_TransferModeNames[] = { "passive", "pic", "flip", "apic" };
+
+	PyObject* Simulation_GetTransfer(SimulationObject* self, void*)
+	{
+		return CheckSystem(self) ? PyUnicode_FromString(s_TransferModeNames[(int)self->System->GetParticleTransfer().Mode]) : nullptr;
+	}
+
+	int Simulation_SetTransfer(SimulationObject* self, PyObject* value, void*)
+	{
+		if (!value)
+		{
+			PyErr_SetString(PyExc_AttributeError, "simulation parameters cannot be deleted");
+			return -1;
+		}
+		const char* name = PyUnicode_AsUTF8(value);
+		if (!name || !CheckSystem(self))
+			return -1;
+		for (int mode = 0; mode < 4; ++mode)
+		{
+			if (std::strcmp(name, s_TransferModeNames[mode]) == 0)
+			{
+				self->System->GetParticleTransfer().Mode = (ParticleTransferMode)mode;
+				return 0;
+			}
+		}
+		PyErr_Format(PyExc_ValueError, "unknown transfer mode '%s', expected passive, pic, flip or apic", name);
+		return -1;
+	}
+
+	PyObject* Simulation_GetWidth(SimulationObject* self, void*)
+	{
+		return CheckSystem(self) ? PyLong_FromLong(self->System->GetWidth()) : nullptr;
+	}
+
+	PyObject* Simulation_GetHeight(SimulationObject* self, void*)
+	{
+		return CheckSystem(self) ? PyLong_FromLong(self->System->GetHeight()) : nullptr;
+	}
+
+	PyObject* Simulation_GetCellSize(SimulationObject* self, void*)
+	{
+		return CheckSystem(self) ? PyFloat_FromDouble(self->System->GetCellSize()) : nullptr;
+	}
+
+	PyObject* Simulation_GetStepIndex(SimulationObject* self, void*)
+	{
+		return CheckSystem(self) ? PyLong_FromUnsignedLong(self->System->GetStepIndex()) : nullptr;
+	}
+
+	PyObject* Simulation_GetLiveParticles(SimulationObject* self, void*)
+	{
+		return CheckSystem(self) ? PyLong_FromSize_t(self->System->GetLiveParticleCount()) : nullptr;
+	}
+
+	PyObject* Simulation_GetThreads(SimulationObject* self, void*)
+	{
+		return CheckSystem(self) ? PyLong_FromUnsignedLong(self->System->GetThreadCount()) : nullptr;
+	}
+
+	PyMethodDef s_SimulationMethods[] = {
+		{ "step", (PyCFunction)(void(*)(void))Simulation_Step, METH_VARARGS | METH_KEYWORDS,
+			"step(count=1, dt=0.016)\n\nAdvances the simulation count steps of dt seconds with the GIL released.\n"
+			"Raises BufferError while views of the fields or particles are alive." },
+		{ "save_checkpoint", (PyCFunction)Simulation_SaveCheckpoint, METH_VARARGS,
+			"save_checkpoint(path)\n\nWrites everything needed to carry on the run to path." },
+		{ "load_checkpoint", (PyCFunction)Simulation_LoadCheckpoint, METH_VARARGS,
+			"load_checkpoint(path)\n\nRestores a checkpoint saved with the same grid and no more particles than particle_capacity,\n"
+			"along with the transfer, sph, sorting and sparse settings it was saved with.\n"
+			"Raises BufferError while views of the fields or particles are alive." },
+		{ "from_checkpoint", (PyCFunction)(void(*)(void))Simulation_FromCheckpoint, METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+			"from_checkpoint(path, threads=0)\n\nSimulation resumed from a checkpoint, with the grid, parameters and settings it was saved with." },
+		{ "add_emitter", (PyCFunction)(void(*)(void))Simulation_AddEmitter, METH_VARARGS | METH_KEYWORDS,
+			"add_emitter(shape='area', trigger='cloud_water', start=(0, 0), end=(1, 1), threshold=1e-4, rate=2, lifetime=5)\n\n"
+			"Adds a source of particles. shape is point, line or area, placed by start and end as fractions of the\n"
+			"domain. Every cell under it whose trigger field, cloud_water or vapor, is above threshold spawns rate\n"
+			"particles per second, always spawns regardless. The particles live lifetime seconds, 0 for ever." },
+		{ "clear_emitters", (PyCFunction)Simulation_ClearEmitters, METH_NOARGS, "clear_emitters()\n\nRemoves every emitter." },
+		{ nullptr }
+	};
+
+	PyGetSetDef s_SimulationGetSet[] = {
+		{ "temperature", (getter)Simulation_GetTemperature, nullptr, "Potential temperature in K, height x width.", nullptr },
+		{ "vapor", (getter)Simulation_GetVapor, nullptr, "Water vapor mixing ratio, height x width.", nullptr },
+		{ "cloud_water", (getter)Simulation_GetCloudWater, nullptr, "Cloud water mixing ratio, height x width.", nullptr },
+		{ "pressure", (getter)Simulation_GetPressure, nullptr, "Base pressure in Pa, height x width.", nullptr },
+		{ "projection_pressure", (getter)Simulation_GetProjectionPressure, nullptr, "Pressure of the last projection, height x width.", nullptr },
+		{ "velocity", (getter)Simulation_GetVelocity, nullptr, "Velocity, height x width x 2.", nullptr },
+		{ "particles", (getter)Simulation_GetParticles, nullptr,
+			"Dict of the particle attributes, one array each. Slots of dead particles have a lifetime of -1.\n"
+			"Steps sort the particles by cell and compact the dead slots away every few steps, so particle i\n"
+			"of one step is not particle i of the next.", nullptr },
+		{ "live_particles", (getter)Simulation_GetLiveParticles, nullptr, "Number of particles alive.", nullptr },
+		{ "gravity", (getter)Simulation_GetFloat, (setter)Simulation_SetFloat, nullptr, (void*)ParameterGravity },
+		{ "vorticity_epsilon", (getter)Simulation_GetFloat, (setter)Simulation_SetFloat, nullptr, (void*)ParameterVorticityEpsilon },
+		{ "buoyancy_epsilon", (getter)Simulation_GetFloat, (setter)Simulation_SetFloat, nullptr, (void*)ParameterBuoyancyEpsilon },
+		{ "sparse", (getter)Simulation_GetSparse, (setter)Simulation_SetSparse, "Skip the quiescent tiles of the grid.", nullptr },
+		{ "transfer", (getter)Simulation_GetTransfer, (setter)Simulation_SetTransfer,
+			"How the particles couple to the grid: passive, pic, flip or apic.", nullptr },
+		{ "sph", (getter)Simulation_GetSph, (setter)Simulation_SetSph, "Density, pressure and viscosity between the particles.", nullptr },
+		{ "flip_ratio", (getter)Simulation_GetFloat, (setter)Simulation_SetFloat, "Share of the FLIP update in flip mode.", (void*)ParameterFlipRatio },
+		{ "width", (getter)Simulation_GetWidth, nullptr, nullptr, nullptr },
+		{ "height", (getter)Simulation_GetHeight, nullptr, nullptr, nullptr },
+		{ "cell_size", (getter)Simulation_GetCellSize, nullptr, nullptr, nullptr },
+		{ "step_index", (getter)Simulation_GetStepIndex, nullptr, "Number of steps taken.", nullptr },
+		{ "threads", (getter)Simulation_GetThreads, nullptr, "Threads the solver runs on.", nullptr },
+		{ nullptr }
+	};
+
+	PyModuleDef s_Module = {
+		PyModuleDef_HEAD_INIT, "particlesim",
+		"Headless cloud simulation. The fields and particle attributes are read-only\n"
+		"memoryviews of the simulation's own memory, numpy.asarray wraps them without\n"
+		"copying. A step swaps the double buffered fields and periodically sorts and\n"
+		"compacts the particles into new arrays, so while any view, or any array made\n"
+		"from one, is alive, step(), load_checkpoint() and __init__() raise BufferError.\n"
+		"Release the views, or copy what has to outlive the step, and take new ones after.",
+		-1, nullptr
+	};
+
+}
+
+PyMODINIT_FUNC PyInit_particlesim()
+{
+	if (!GLCore::Log::GetLogger())
+		GLCore::Log::Init();
+
+	s_FieldBufferType.tp_basicsize = sizeof(FieldBufferObject);
+	s_FieldBufferType.tp_flags = Py_TPFLAGS_DEFAULT;
+	s_FieldBufferType.tp_dealloc = (destructor)FieldBuffer_Dealloc;
+	s_FieldBufferType.tp_as_buffer = &s_FieldBufferProcs;
+	s_FieldBufferType.tp_doc = "Memory of a simulation field, exported through the buffer protocol.";
+
+	s_SimulationType.tp_basicsize = sizeof(SimulationObject);
+	s_SimulationType.tp_flags = Py_TPFLAGS_DEFAULT;
+	s_SimulationType.tp_new = Simulation_New;
+	s_SimulationType.tp_init = (initproc)Simulation_Init;
+	s_SimulationType.tp_dealloc = (destructor)Simulation_Dealloc;
+	s_SimulationType.tp_methods = s_SimulationMethods;
+	s_SimulationType.tp_getset = s_SimulationGetSet;
+	s_SimulationType.tp_doc =
+		"Simulation(width=100, height=100, cell_size=0.01, particles=10000, gravity=-0.1,\n"
+		"           vorticity=0.001, buoyancy=0.02, seed=5489, threads=0, particle_capacity=0)\n\n"
+		"A particle system without a window. threads=0 uses every hardware thread. The\n"
+		"emitters can grow the particles up to particle_capacity, or particles if that is\n"
+		"more. The seed is shared by every simulation in the process.";
+
+	if (PyType_Ready(&s_FieldBufferType) < 0 || PyType_Ready(&s_SimulationType) < 0)
+		return nullptr;
+
+	PyObject* module = PyModule_Create(&s_Module);
+	if (!module)
+		return nullptr;
+	Py_INCREF(&s_SimulationType);
+	if (PyModule_AddObject(module, "Simulation", (PyObject*)&s_SimulationType) < 0)
+	{
+		Py_DECREF(&s_SimulationType);
+		Py_DECREF(module);
+		return nullptr;
+	}
+	return module;
+}
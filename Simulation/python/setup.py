@@ -0,0 +1,65 @@
+"""Builds the particlesim extension from the simulation sources.
+
+    python setup.py build_ext --inplace
+
+Only the solver is compiled in, without the window, renderer or OpenGL, so the module
+runs headless anywhere the simulation itself builds.
+"""
+import os
+import sys
+
+from setuptools import Extension, setup
+
+here = os.path.dirname(os.path.abspath(__file__))
+src = os.path.join(here, "..", "src")
+core = os.path.join(here, "..", "..", "OpenGL-Core")
+
+sources = [
+    "ActiveTiles.cpp",
+    "AdvectionKernels.cpp",
+    "BoundaryConditions.cpp",
+    "CellIndex.cpp",
+    "Checkpoint.cpp",
+    "ForceKernels.cpp",
+    "MicrophysicsKernels.cpp",
+    "ParticleEmitter.cpp",
+    "ParticleKernels.cpp",
+    "ParticlePool.cpp",
+    "ParticleSystem.cpp",
+    "ParticleTransfer.cpp",
+    "PressureSolver.cpp",
+    "Profiler.cpp",
+    "Random.cpp",
+    "SphSolver.cpp",
+    "TaskGraph.cpp",
+    "ThreadPool.cpp",
+]
+
+if sys.platform == "win32":
+    # Same instruction set as the Release builds of the app.
+    compile_args = ["/std:c++17", "/O2", "/arch:AVX2", "/EHsc"]
+else:
+    compile_args = ["-std=c++17", "-O2", "-mavx2", "-mfma"]
+
+extension = Extension(
+    "particlesim",
+    sources=[os.path.join(here, "ParticleSimModule.cpp")]
+    + [os.path.join(src, name) for name in sources]
+    + [os.path.join(core, "src", "GLCore", "Core", "Log.cpp")],
+    include_dirs=[
+        src,
+        os.path.join(core, "src"),
+        os.path.join(core, "vendor", "spdlog", "include"),
+        os.path.join(core, "vendor", "glm"),
+        os.path.join(core, "vendor", "Glad", "include"),
+    ],
+    extra_compile_args=compile_args,
+    language="c++",
+)
+
+setup(
+    name="particlesim",
+    version="0.1.0",
+    description="Python bindings for the 2D cloud simulation",
+    ext_modules=[extension],
+)
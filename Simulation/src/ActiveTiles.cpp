@@ -0,0 +1,194 @@
+#include "ActiveTiles.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "MicrophysicsKernels.h"
+
+void ActiveTileMask::Resize(int width, int height)
+{
+	m_Width = width;
+	m_Height = height;
+	m_TilesX = (width + TileSize - 1) / TileSize;
+	m_TilesY = (height + TileSize - 1) / TileSize;
+	m_Flagged.assign((size_t)m_TilesX * m_TilesY, 0);
+	m_Active.assign(m_Flagged.size(), 0);
+	m_Grown.assign(m_Flagged.size(), 0);
+	m_HighestPressure.assign(m_Flagged.size(), 0.0f);
+	m_LowestExner.assign(m_Flagged.size(), 0.0f);
+	// Room for every tile, or every row when the mask is off, so rebuilding the lists
+	// never allocates.
+	m_ActiveTiles.reserve(std::max(m_Flagged.size(), (size_t)height));
+	m_InactiveTiles.reserve(m_Flagged.size());
+	m_Enabled = false;
+	SetRows();
+}
+
+TileRange ActiveTileMask::GetTileRange(int tileX, int tileY) const
+{
+	TileRange range;
+	range.XBegin = tileX * TileSize;
+	range.XEnd = std::min(range.XBegin + TileSize, m_Width);
+	range.YBegin = tileY * TileSize;
+	range.YEnd = std::min(range.YBegin + TileSize, m_Height);
+	return range;
+}
+
+void ActiveTileMask::SetRows()
+{
+	m_ActiveTiles.clear();
+	for (int y = 0; y < m_Height; ++y)
+		m_ActiveTiles.push_back({ 0, m_Width, y, y + 1 });
+	m_InactiveTiles.clear();
+	m_ActiveFraction = 1.0f;
+}
+
+void ActiveTileMask::UpdatePressureBounds(const Grid2D<float>& pressureField, const Grid2D<float>& exnerField)
+{
+	for (int tileY = 0; tileY < m_TilesY; ++tileY)
+	{
+		for (int tileX = 0; tileX < m_TilesX; ++tileX)
+		{
+			const TileRange tile = GetTileRange(tileX, tileY);
+			float highestPressure = 0.0f;
+			float lowestExner = std::numeric_limits<float>::max();
+			for (int y = tile.YBegin; y < tile.YEnd; ++y)
+			{
+				for (int x = tile.XBegin; x < tile.XEnd; ++x)
+				{
+					highestPressure = std::max(highestPressure, pressureField[y][x]);
+					lowestExner = std::min(lowestExner, exnerField[y][x]);
+				}
+			}
+			m_HighestPressure[(size_t)tileY * m_TilesX + tileX] = highestPressure;
+			m_LowestExner[(size_t)tileY * m_TilesX + tileX] = lowestExner;
+		}
+	}
+}
+
+bool ActiveTileMask::IsFlagged(int tileX, int tileY, const Grid2D<glm::vec2>& velocityField, const Grid2D<float>& temperatureField,
+	const Grid2D<float>& vaporField, const Grid2D<float>& cloudWaterField, const ActiveTileSettings& settings) const
+{
+	// Every cell is visited without branching on the thresholds, which lets the row
+	// loops vectorize, and the tile is judged once at the end.
+	const TileRange tile = GetTileRange(tileX, tileY);
+	const int interiorBegin = std::max(tile.XBegin, 1);
+	const int interiorEnd = std::min(tile.XEnd, m_Width - 1);
+	const float halfInvCellSize = 0.5f / velocityField.GetCellSize();
+	float highestSpeedSquared = 0.0f, highestVorticity = 0.0f;
+	float highestCloudWater = 0.0f, highestVapor = 0.0f;
+	float lowestTemperature = std::numeric_limits<float>::max();
+	for (int y = tile.YBegin; y < tile.YEnd; ++y)
+	{
+		const glm::vec2* velocity = velocityField[y];
+		const float* temperature = temperatureField[y];
+		const float* vapor = vaporField[y];
+		const float* cloudWater = cloudWaterField[y];
+		for (int x = tile.XBegin; x < tile.XEnd; ++x)
+		{
+			highestSpeedSquared = std::max(highestSpeedSquared, velocity[x].x * velocity[x].x + velocity[x].y * velocity[x].y);
+			highestCloudWater = std::max(highestCloudWater, cloudWater[x]);
+			highestVapor = std::max(highestVapor, vapor[x]);
+			lowestTemperature = std::min(lowestTemperature, temperature[x]);
+		}
+		// Same central difference ApplyForces uses.
+		if (y == 0 || y == m_Height - 1)
+			continue;
+		const glm::vec2* below = velocityField[y - 1];
+		const glm::vec2* above = velocityField[y + 1];
+		for (int x = interiorBegin; x < interiorEnd; ++x)
+		{
+			const float vorticity = (velocity[x + 1].x - velocity[x - 1].x) * halfInvCellSize - (above[x].y - below[x].y) * halfInvCellSize;
+			highestVorticity = std::max(highestVorticity, std::abs(vorticity));
+		}
+	}
+
+	if (highestCloudWater > settings.CloudWaterThreshold ||
+		highestSpeedSquared > settings.VelocityThreshold * settings.VelocityThreshold ||
+		highestVorticity > settings.VorticityThreshold)
+		return true;
+
+	// Saturation only rises with temperature and falls with pressure, so no cell can be
+	// above the saturation of the tile's lowest temperature at its highest pressure, and
+	// the microphysics leaves a tile below that and without cloud water untouched. The
+	// margin covers the rounding of the fast exponential.
+	const size_t index = (size_t)tileY * m_TilesX + tileX;
+	const float saturation = SaturationMixingRatio(lowestTemperature * m_LowestExner[index], m_HighestPressure[index]);
+	return highestVapor >= 0.999f * saturation;
+}
+
+void ActiveTileMask::Rebuild(const Grid2D<glm::vec2>& velocityField, const Grid2D<float>& temperatureField,
+	const Grid2D<float>& vaporField, const Grid2D<float>& cloudWaterField,
+	const ActiveTileSettings& settings, ThreadPool& pool)
+{
+	if (!settings.Enabled)
+	{
+		if (m_Enabled)
+			SetRows();
+		m_Enabled = false;
+		return;
+	}
+
+	pool.ParallelFor(0, m_TilesY, [&](int tileYBegin, int tileYEnd)
+	{
+		for (int tileY = tileYBegin; tileY < tileYEnd; ++tileY)
+		{
+			for (int tileX = 0; tileX < m_TilesX; ++tileX)
+			{
+				m_Flagged[(size_t)tileY * m_TilesX + tileX] = IsFlagged(tileX, tileY, velocityField,
+					temperatureField, vaporField, cloudWaterField, settings);
+			}
+		}
+	});
+
+	// The lists only change when a tile starts or stops being active, which is rare
+	// from one step to the next.
+	m_Grown.assign(m_Active.size(), 0);
+	Grow(m_Flagged, m_Grown);
+	if (m_Enabled && m_Grown == m_Active)
+		return;
+	m_Active.swap(m_Grown);
+	m_Enabled = true;
+	BuildLists();
+}
+
+void ActiveTileMask::Grow(const std::vector<uint8_t>& source, std::vector<uint8_t>& destination) const
+{
+	for (int tileY = 0; tileY < m_TilesY; ++tileY)
+	{
+		for (int tileX = 0; tileX < m_TilesX; ++tileX)
+		{
+			if (!source[(size_t)tileY * m_TilesX + tileX])
+				continue;
+			for (int y = std::max(tileY - 1, 0); y <= std::min(tileY + 1, m_TilesY - 1); ++y)
+			{
+				for (int x = std::max(tileX - 1, 0); x <= std::min(tileX + 1, m_TilesX - 1); ++x)
+					destination[(size_t)y * m_TilesX + x] = 1;
+			}
+		}
+	}
+}
+
+void ActiveTileMask::BuildLists()
+{
+	m_ActiveTiles.clear();
+	m_InactiveTiles.clear();
+	size_t activeCells = 0;
+	for (int tileY = 0; tileY < m_TilesY; ++tileY)
+	{
+		for (int tileX = 0; tileX < m_TilesX; ++tileX)
+		{
+			const size_t tile = (size_t)tileY * m_TilesX + tileX;
+			const TileRange range = GetTileRange(tileX, tileY);
+			if (m_Active[tile])
+			{
+				m_ActiveTiles.push_back(range);
+				activeCells += (size_t)(range.XEnd - range.XBegin) * (range.YEnd - range.YBegin);
+			}
+			else
+				m_InactiveTiles.push_back(range);
+		}
+	}
+	m_ActiveFraction = m_Width * m_Height > 0 ? (float)activeCells / ((size_t)m_Width * m_Height) : 0.0f;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Grid2D.h"
+#include "ThreadPool.h"
+
+struct ActiveTileSettings
+{
+	// Off runs every kernel over the whole grid.
+	bool Enabled = false;
+	// A tile is active while any of its cells is above one of these, or may hold vapor
+	// above saturation.
+	float VelocityThreshold = 1e-3f;
+	float VorticityThreshold = 1e-2f;
+	float CloudWaterThreshold = 0.0f;
+};
+
+// Half-open block of cells, [XBegin, XEnd) x [YBegin, YEnd).
+struct TileRange
+{
+	int XBegin, XEnd;
+	int YBegin, YEnd;
+};
+
+// Splits the grid into square tiles and tracks which of them are doing anything, so
+// the kernels can skip the quiescent parts of the domain. The active set is grown by
+// one tile in every direction, which covers anything advected in during the step as
+// long as it moves less than a tile per step.
+//
+// While disabled every "tile" is a whole row, so the kernels run exactly as they
+// would over the full grid.
+class ActiveTileMask
+{
+public:
+	static constexpr int TileSize = 16;
+
+	void Resize(int width, int height);
+
+	// Highest pressure and lowest Exner function of every tile, for the saturation test.
+	// Must be called whenever the pressure field changes.
+	void UpdatePressureBounds(const Grid2D<float>& pressureField, const Grid2D<float>& exnerField);
+
+	// Flags the tiles from the current fields. The mask only depends on the fields, not
+	// on earlier masks, so a resumed run picks the same tiles.
+	void Rebuild(const Grid2D<glm::vec2>& velocityField, const Grid2D<float>& temperatureField,
+		const Grid2D<float>& vaporField, const Grid2D<float>& cloudWaterField,
+		const ActiveTileSettings& settings, ThreadPool& pool);
+
+	const std::vector<TileRange>& GetActiveTiles() const { return m_ActiveTiles; }
+	// Tiles the kernels skip, double buffered fields have to be copied over here.
+	const std::vector<TileRange>& GetInactiveTiles() const { return m_InactiveTiles; }
+
+	// False while the tiles are whole rows.
+	bool IsSparse() const { return m_Enabled; }
+	// Fraction of the grid's cells in active tiles.
+	float GetActiveFraction() const { return m_ActiveFraction; }
+private:
+	TileRange GetTileRange(int tileX, int tileY) const;
+	bool IsFlagged(int tileX, int tileY, const Grid2D<glm::vec2>& velocityField, const Grid2D<float>& temperatureField,
+		const Grid2D<float>& vaporField, const Grid2D<float>& cloudWaterField, const ActiveTileSettings& settings) const;
+	void SetRows();
+	// Sets every tile within one tile of a flagged one in destination.
+	void Grow(const std::vector<uint8_t>& source, std::vector<uint8_t>& destination) const;
+	void BuildLists();
+private:
+	int m_Width = 0, m_Height = 0;
+	int m_TilesX = 0, m_TilesY = 0;
+	bool m_Enabled = false;
+	std::vector<uint8_t> m_Flagged, m_Active;
+	// Next active set, swapped with m_Active when it differs so neither is reallocated.
+	std::vector<uint8_t> m_Grown;
+	std::vector<float> m_HighestPressure, m_LowestExner;
+	std::vector<TileRange> m_ActiveTiles, m_InactiveTiles;
+	float m_ActiveFraction = 1.0f;
+};
@@ -0,0 +1,152 @@
+#include "AdvectionKernels.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+	#define ADVECTION_KERNELS_AVX2
+	#include <immintrin.h>
+#endif
+
+namespace {
+
+	// Corner cells and weights of a bilinear sample. Traced positions are already
+	// clamped to the grid, so truncating them is the same as flooring.
+	struct BilinearCell
+	{
+		size_t Index00, Index10, Index01, Index11;
+		float FracX, FracY;
+	};
+
+	inline BilinearCell LocateCell(glm::vec2 position, int width, int height)
+	{
+		const int x0 = (int)position.x;
+		const int y0 = (int)position.y;
+		const int x1 = std::min(x0 + 1, width - 1);
+		const int y1 = std::min(y0 + 1, height - 1);
+
+		BilinearCell cell;
+		cell.Index00 = (size_t)y0 * width + x0;
+		cell.Index10 = (size_t)y0 * width + x1;
+		cell.Index01 = (size_t)y1 * width + x0;
+		cell.Index11 = (size_t)y1 * width + x1;
+		cell.FracX = position.x - (float)x0;
+		cell.FracY = position.y - (float)y0;
+		return cell;
+	}
+
+	template<typename T>
+	inline T Blend(const T* data, const BilinearCell& cell)
+	{
+		T bottom = data[cell.Index00] + (data[cell.Index10] - data[cell.Index00]) * cell.FracX;
+		T top = data[cell.Index01] + (data[cell.Index11] - data[cell.Index01]) * cell.FracX;
+		return bottom + (top - bottom) * cell.FracY;
+	}
+
+	template<typename T>
+	inline void Range(const Grid2D<T>& field, glm::vec2 position, T& low, T& high)
+	{
+		const BilinearCell cell = LocateCell(position, field.GetWidth(), field.GetHeight());
+		const T* data = field.GetData();
+		low = glm::min(glm::min(data[cell.Index00], data[cell.Index10]), glm::min(data[cell.Index01], data[cell.Index11]));
+		high = glm::max(glm::max(data[cell.Index00], data[cell.Index10]), glm::max(data[cell.Index01], data[cell.Index11]));
+	}
+
+	void SampleScalar(const glm::vec2* trace, int begin, int end,
+		const Grid2D<float>* const fields[], float* const out[], int fieldCount)
+	{
+		const int width = fields[0]->GetWidth();
+		const int height = fields[0]->GetHeight();
+		for (int i = begin; i < end; ++i)
+		{
+			const BilinearCell cell = LocateCell(trace[i], width, height);
+			for (int f = 0; f < fieldCount; ++f)
+				out[f][i] = Blend(fields[f]->GetData(), cell);
+		}
+	}
+
+#if defined(ADVECTION_KERNELS_AVX2)
+	int SampleSimd(const glm::vec2* trace, int count,
+		const Grid2D<float>* const fields[], float* const out[], int fieldCount)
+	{
+		const __m256i one = _mm256_set1_epi32(1);
+		const __m256i width = _mm256_set1_epi32(fields[0]->GetWidth());
+		const __m256i lastX = _mm256_set1_epi32(fields[0]->GetWidth() - 1);
+		const __m256i lastY = _mm256_set1_epi32(fields[0]->GetHeight() - 1);
+
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			// Deinterleave eight (x, y) pairs into one register of x and one of y.
+			const float* positions = &trace[i].x;
+			__m256 a = _mm256_loadu_ps(positions), b = _mm256_loadu_ps(positions + 8);
+			__m256 px = _mm256_castpd_ps(_mm256_permute4x64_pd(
+				_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+			__m256 py = _mm256_castpd_ps(_mm256_permute4x64_pd(
+				_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+
+			__m256i x0 = _mm256_cvttps_epi32(px), y0 = _mm256_cvttps_epi32(py);
+			__m256i x1 = _mm256_min_epi32(_mm256_add_epi32(x0, one), lastX);
+			__m256i y1 = _mm256_min_epi32(_mm256_add_epi32(y0, one), lastY);
+			__m256 fracX = _mm256_sub_ps(px, _mm256_cvtepi32_ps(x0));
+			__m256 fracY = _mm256_sub_ps(py, _mm256_cvtepi32_ps(y0));
+			__m256i row0 = _mm256_mullo_epi32(y0, width), row1 = _mm256_mullo_epi32(y1, width);
+			__m256i index00 = _mm256_add_epi32(row0, x0), index10 = _mm256_add_epi32(row0, x1);
+			__m256i index01 = _mm256_add_epi32(row1, x0), index11 = _mm256_add_epi32(row1, x1);
+
+			for (int f = 0; f < fieldCount; ++f)
+			{
+				const float* data = fields[f]->GetData();
+				__m256 v00 = _mm256_i32gather_ps(data, index00, 4), v10 = _mm256_i32gather_ps(data, index10, 4);
+				__m256 v01 = _mm256_i32gather_ps(data, index01, 4), v11 = _mm256_i32gather_ps(data, index11, 4);
+				__m256 bottom = _mm256_add_ps(v00, _mm256_mul_ps(_mm256_sub_ps(v10, v00), fracX));
+				__m256 top = _mm256_add_ps(v01, _mm256_mul_ps(_mm256_sub_ps(v11, v01), fracX));
+				_mm256_storeu_ps(out[f] + i, _mm256_add_ps(bottom, _mm256_mul_ps(_mm256_sub_ps(top, bottom), fracY)));
+			}
+		}
+		return i;
+	}
+#else
+	int SampleSimd(const glm::vec2*, int, const Grid2D<float>* const[], float* const[], int)
+	{
+		return 0;
+	}
+#endif
+
+}
+
+void TraceRow(const Grid2D<glm::vec2>& velocityField, int y, int xBegin, int xEnd, float deltaTime, glm::vec2* trace)
+{
+	const float maxX = (float)(velocityField.GetWidth() - 1);
+	const float maxY = (float)(velocityField.GetHeight() - 1);
+	const float step = deltaTime / velocityField.GetCellSize();
+	const glm::vec2* velocity = velocityField[y];
+	for (int x = xBegin; x < xEnd; ++x)
+	{
+		float tracedX = (float)x - velocity[x].x * step;
+		float tracedY = (float)y - velocity[x].y * step;
+		trace[x].x = std::min(std::max(tracedX, 0.0f), maxX);
+		trace[x].y = std::min(std::max(tracedY, 0.0f), maxY);
+	}
+}
+
+void SampleScalarRow(const glm::vec2* trace, int count,
+	const Grid2D<float>* const fields[], float* const out[], int fieldCount)
+{
+	int i = SampleSimd(trace, count, fields, out, fieldCount);
+	SampleScalar(trace, i, count, fields, out, fieldCount);
+}
+
+glm::vec2 SampleBilinear(const Grid2D<glm::vec2>& field, glm::vec2 position)
+{
+	return Blend(field.GetData(), LocateCell(position, field.GetWidth(), field.GetHeight()));
+}
+
+void SampleRange(const Grid2D<float>& field, glm::vec2 position, float& low, float& high)
+{
+	Range(field, position, low, high);
+}
+
+void SampleRange(const Grid2D<glm::vec2>& field, glm::vec2 position, glm::vec2& low, glm::vec2& high)
+{
+	Range(field, position, low, high);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "Grid2D.h"
+
+enum class AdvectionScheme
+{
+	Bilinear = 0,
+	// Bilinear forward and backward passes combined to cancel most of the smoothing,
+	// clamped to the values around the back-traced point so it cannot overshoot.
+	MacCormack
+};
+
+// Traces cells [xBegin, xEnd) of row y through the velocity field for deltaTime,
+// backwards for a positive step and forwards for a negative one, and writes where
+// cell x lands to trace[x], in cells and clamped to the grid.
+void TraceRow(const Grid2D<glm::vec2>& velocityField, int y, int xBegin, int xEnd, float deltaTime, glm::vec2* trace);
+
+// Bilinearly samples fieldCount scalar fields at count traced positions, writing
+// fields[f] at trace[i] to out[f][i]. Cell indices and weights are worked out once per
+// position and reused for every field. Uses AVX2 gathers when the build enables them
+// and a scalar loop for the remainder, both paths produce identical results.
+void SampleScalarRow(const glm::vec2* trace, int count,
+	const Grid2D<float>* const fields[], float* const out[], int fieldCount);
+
+glm::vec2 SampleBilinear(const Grid2D<glm::vec2>& field, glm::vec2 position);
+
+// Smallest and largest of the four values bilinear sampling blends at position, used
+// to limit the MacCormack correction.
+void SampleRange(const Grid2D<float>& field, glm::vec2 position, float& low, float& high);
+void SampleRange(const Grid2D<glm::vec2>& field, glm::vec2 position, glm::vec2& low, glm::vec2& high);
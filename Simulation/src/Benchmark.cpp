@@ -0,0 +1,85 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+
+using Clock = std::chrono::steady_clock;
+
+// Batches shorter than this are dominated by clock overhead.
+static constexpr double s_MinBatchNs = 100000.0;
+static constexpr int s_MinBatches = 5;
+
+static void PrintRow(const BenchmarkResult& result)
+{
+	std::printf("%-36s %5dx%-5d %8zu %10.3f ns/item %8.2f GB/s %11.3e items/s\n",
+		result.Name.c_str(), result.Width, result.Height, result.Particles,
+		result.NsPerItem(), result.GigabytesPerSecond(), result.ItemsPerSecond());
+	std::fflush(stdout);
+}
+
+bool BenchmarkRunner::IsEnabled(const std::string& name) const
+{
+	return m_Filter.empty() || name.find(m_Filter) != std::string::npos;
+}
+
+void BenchmarkRunner::Run(BenchmarkResult result, const std::function<void()>& call)
+{
+	// One untimed call warms the caches and wakes the worker threads, the second
+	// sizes the batches.
+	call();
+	Clock::time_point start = Clock::now();
+	call();
+	double estimateNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+	const int64_t batchSize = std::max<int64_t>(1, (int64_t)(s_MinBatchNs / std::max(estimateNs, 1.0)));
+
+	std::vector<double> perCallNs;
+	double totalNs = 0.0;
+	while (totalNs < m_MinSeconds * 1e9 || (int)perCallNs.size() < s_MinBatches)
+	{
+		start = Clock::now();
+		for (int64_t i = 0; i < batchSize; ++i)
+			call();
+		double batchNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+		perCallNs.push_back(batchNs / (double)batchSize);
+		totalNs += batchNs;
+	}
+
+	std::sort(perCallNs.begin(), perCallNs.end());
+	result.Calls = (int64_t)perCallNs.size() * batchSize;
+	result.MinNs = perCallNs.front();
+	result.MedianNs = perCallNs[perCallNs.size() / 2];
+	result.MeanNs = totalNs / (double)result.Calls;
+	m_Results.push_back(result);
+
+	PrintRow(result);
+}
+
+void BenchmarkRunner::PrintHeader() const
+{
+	std::printf("%-36s %11s %8s %18s %13s %19s\n", "Case", "Grid", "Parts", "Time", "Bandwidth", "Throughput");
+}
+
+bool BenchmarkRunner::WriteJson(const std::string& path, uint32_t threadCount) const
+{
+	FILE* file = std::fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+
+	std::fprintf(file, "{\n  \"context\": {\n    \"threads\": %u,\n    \"min_time_s\": %g\n  },\n  \"benchmarks\": [\n",
+		threadCount, m_MinSeconds);
+	for (size_t i = 0; i < m_Results.size(); ++i)
+	{
+		const BenchmarkResult& result = m_Results[i];
+		std::fprintf(file,
+			"    {\"name\": \"%s\", \"width\": %d, \"height\": %d, \"particles\": %zu, \"items\": %zu, "
+			"\"calls\": %lld, \"min_ns\": %.1f, \"median_ns\": %.1f, \"mean_ns\": %.1f, "
+			"\"ns_per_item\": %.4f, \"gb_per_s\": %.3f, \"items_per_s\": %.6e}%s\n",
+			result.Name.c_str(), result.Width, result.Height, result.Particles, result.Items,
+			(long long)result.Calls, result.MinNs, result.MedianNs, result.MeanNs,
+			result.NsPerItem(), result.GigabytesPerSecond(), result.ItemsPerSecond(),
+			i + 1 < m_Results.size() ? "," : "");
+	}
+	std::fprintf(file, "  ]\n}\n");
+	std::fclose(file);
+	return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BenchmarkResult
+{
+	std::string Name;
+	int Width = 0, Height = 0;
+	size_t Particles = 0;
+	// Cells or particles one call processes, and the bytes it has to load and store
+	// for each of them.
+	size_t Items = 0;
+	double BytesPerItem = 0.0;
+
+	int64_t Calls = 0;
+	double MinNs = 0.0, MedianNs = 0.0, MeanNs = 0.0;
+
+	double NsPerItem() const { return MedianNs / (double)Items; }
+	double ItemsPerSecond() const { return (double)Items * 1e9 / MedianNs; }
+	double GigabytesPerSecond() const { return (double)Items * BytesPerItem / MedianNs; }
+};
+
+// Minimal timing harness in the spirit of Google Benchmark. Each case is called in
+// batches long enough to time reliably until the minimum time has passed, and the
+// per-call median is reported alongside the minimum and mean.
+class BenchmarkRunner
+{
+public:
+	BenchmarkRunner(double minSeconds, const std::string& filter)
+		: m_MinSeconds(minSeconds), m_Filter(filter)
+	{
+	}
+
+	// Names are matched against the filter as a plain substring.
+	bool IsEnabled(const std::string& name) const;
+
+	// Times call and prints a row for it as soon as it finishes.
+	void Run(BenchmarkResult result, const std::function<void()>& call);
+
+	const std::vector<BenchmarkResult>& GetResults() const { return m_Results; }
+
+	void PrintHeader() const;
+	// Writes the results as JSON, one object per case in run order, so runs from two
+	// builds can be diffed directly.
+	bool WriteJson(const std::string& path, uint32_t threadCount) const;
+private:
+	double m_MinSeconds;
+	std::string m_Filter;
+	std::vector<BenchmarkResult> m_Results;
+};
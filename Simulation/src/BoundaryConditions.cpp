@@ -0,0 +1,87 @@
+#include "BoundaryConditions.h"
+
+namespace {
+
+	// A scalar has no normal component, a free-slip wall is only a zero gradient for it.
+	inline float SlipValue(float inner, int)
+	{
+		return inner;
+	}
+
+	inline glm::vec2 SlipValue(glm::vec2 inner, int normalAxis)
+	{
+		inner[normalAxis] = 0.0f;
+		return inner;
+	}
+
+	// Fills count ghosts of one side, stride apart in the field's storage. inner points
+	// at the neighbour of the first ghost and opposite at the interior cell next to the
+	// opposite side. The type is switched on once per side, so every loop is a plain
+	// copy or fill.
+	template<typename T>
+	void FillSide(T* ghost, const T* inner, const T* opposite, size_t stride, int count,
+		const BoundarySide<T>& side, int normalAxis)
+	{
+		switch (side.Type)
+		{
+		case BoundaryType::Dirichlet:
+		case BoundaryType::Inflow:
+			if (side.Profile)
+			{
+				for (int i = 0; i < count; ++i)
+					ghost[i * stride] = side.Profile[i];
+			}
+			else
+			{
+				for (int i = 0; i < count; ++i)
+					ghost[i * stride] = side.Value;
+			}
+			break;
+		case BoundaryType::NoSlip:
+			for (int i = 0; i < count; ++i)
+				ghost[i * stride] = T();
+			break;
+		case BoundaryType::Neumann:
+		case BoundaryType::Outflow:
+			for (int i = 0; i < count; ++i)
+				ghost[i * stride] = inner[i * stride];
+			break;
+		case BoundaryType::Periodic:
+			for (int i = 0; i < count; ++i)
+				ghost[i * stride] = opposite[i * stride];
+			break;
+		case BoundaryType::FreeSlip:
+			for (int i = 0; i < count; ++i)
+				ghost[i * stride] = SlipValue(inner[i * stride], normalAxis);
+			break;
+		}
+	}
+
+	template<typename T>
+	void Apply(Grid2D<T>& field, const FieldBoundaries<T>& boundaries)
+	{
+		const int width = field.GetWidth();
+		const int height = field.GetHeight();
+		if (width < 3 || height < 3)
+			return;
+
+		T* data = field.GetData();
+		const size_t row = (size_t)width;
+		// Columns walk down the rows, the rows are contiguous.
+		FillSide(data, data + 1, data + width - 2, row, height, boundaries.Left, 0);
+		FillSide(data + width - 1, data + width - 2, data + 1, row, height, boundaries.Right, 0);
+		FillSide(data, data + row, data + (height - 2) * row, 1, width, boundaries.Bottom, 1);
+		FillSide(data + (height - 1) * row, data + (height - 2) * row, data + row, 1, width, boundaries.Top, 1);
+	}
+
+}
+
+void ApplyBoundaries(Grid2D<float>& field, const FieldBoundaries<float>& boundaries)
+{
+	Apply(field, boundaries);
+}
+
+void ApplyBoundaries(Grid2D<glm::vec2>& field, const FieldBoundaries<glm::vec2>& boundaries)
+{
+	Apply(field, boundaries);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "Grid2D.h"
+
+// The outermost ring of cells of every field is its ghost layer: the kernels only
+// compute the interior [1, width - 1) x [1, height - 1) and the ring is filled from
+// the interior by these boundary conditions, so no stencil needs a special case at
+// the edges.
+enum class BoundaryType
+{
+	// Ghosts are set to Value, or to Profile[i] along the side when one is given.
+	Dirichlet = 0,
+	// Ghosts copy their inner neighbour, so nothing flows across the side.
+	Neumann,
+	// Ghosts copy the interior cell next to the opposite side.
+	Periodic,
+	// Wall the flow sticks to, zero velocity. Dirichlet 0 for scalars.
+	NoSlip,
+	// Wall the flow slides along, zero normal velocity and a copied tangential one.
+	// Neumann for scalars.
+	FreeSlip,
+	// Prescribed values coming in, the same as Dirichlet.
+	Inflow,
+	// Lets whatever reaches the side leave, the same as Neumann.
+	Outflow
+};
+
+template<typename T>
+struct BoundarySide
+{
+	BoundaryType Type = BoundaryType::Neumann;
+	T Value = T();
+	// Optional value per cell along the side, left to right or bottom to top. Must stay
+	// valid while the boundaries are applied.
+	const T* Profile = nullptr;
+};
+
+template<typename T>
+struct FieldBoundaries
+{
+	BoundarySide<T> Left, Right, Bottom, Top;
+
+	// Same type on every side.
+	static FieldBoundaries All(BoundaryType type, T value = T())
+	{
+		FieldBoundaries boundaries;
+		boundaries.Left = boundaries.Right = boundaries.Bottom = boundaries.Top = { type, value, nullptr };
+		return boundaries;
+	}
+};
+
+// Fills the ghost ring of a field in one pass, the left and right columns first and
+// then the bottom and top rows, so the rows own the corners.
+void ApplyBoundaries(Grid2D<float>& field, const FieldBoundaries<float>& boundaries);
+void ApplyBoundaries(Grid2D<glm::vec2>& field, const FieldBoundaries<glm::vec2>& boundaries);
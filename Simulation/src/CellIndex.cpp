@@ -0,0 +1,134 @@
+#include "CellIndex.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+	// Cells each band of the prefix sum covers.
+	const int s_ScanBlockCells = 16384;
+	// Cell of the particle pool's free slots, which are left out.
+	const uint32_t s_FreeSlot = UINT32_MAX;
+
+}
+
+void CellIndex::Resize(int width, int height)
+{
+	m_Width = width;
+	m_Height = height;
+	const size_t cellCount = (size_t)width * height;
+	m_CellStart.assign(cellCount + 1, 0);
+	m_CellCounts.reset(new std::atomic<uint32_t>[cellCount]);
+	m_BlockStarts.assign((cellCount + s_ScanBlockCells - 1) / s_ScanBlockCells + 1, 0);
+}
+
+void CellIndex::Reserve(size_t capacity)
+{
+	m_Cells.reserve(capacity);
+	m_Ranks.reserve(capacity);
+	m_CellParticles.reserve(capacity);
+	m_Order.reserve(capacity);
+	m_Scratch.reserve(capacity);
+}
+
+void CellIndex::Bin(const ParticleStore& particles, float invCellSize, ThreadPool& pool)
+{
+	const int count = (int)particles.GetCount();
+	const int cellCount = m_Width * m_Height;
+	const int blockCount = (int)m_BlockStarts.size() - 1;
+	const float maxX = (float)(m_Width - 1), maxY = (float)(m_Height - 1);
+	m_Cells.resize(count);
+	m_Ranks.resize(count);
+
+	pool.ParallelFor(0, cellCount, [&](int begin, int end) {
+		for (int cell = begin; cell < end; ++cell)
+			m_CellCounts[cell].store(0, std::memory_order_relaxed);
+	});
+	// Each particle takes the next slot of its cell. Which particle gets which slot
+	// depends on the scheduling, the stable order is restored below.
+	pool.ParallelFor(0, count, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+		{
+			if (!particles.IsAlive(i))
+			{
+				m_Cells[i] = s_FreeSlot;
+				continue;
+			}
+			float x = std::min(std::max(particles.PositionX[i] * invCellSize, 0.0f), maxX);
+			float y = std::min(std::max(particles.PositionY[i] * invCellSize, 0.0f), maxY);
+			m_Cells[i] = (uint32_t)(int)y * m_Width + (uint32_t)(int)x;
+			m_Ranks[i] = m_CellCounts[m_Cells[i]].fetch_add(1, std::memory_order_relaxed);
+		}
+	});
+
+	// Exclusive prefix sum of the counts: every block sums its cells, the block sums
+	// are scanned on one thread, then every block writes its starts from its offset.
+	pool.ParallelFor(0, blockCount, [&](int begin, int end) {
+		for (int block = begin; block < end; ++block)
+		{
+			const int cellEnd = std::min((block + 1) * s_ScanBlockCells, cellCount);
+			uint32_t sum = 0;
+			for (int cell = block * s_ScanBlockCells; cell < cellEnd; ++cell)
+				sum += m_CellCounts[cell].load(std::memory_order_relaxed);
+			m_BlockStarts[block + 1] = sum;
+		}
+	});
+	for (int block = 1; block <= blockCount; ++block)
+		m_BlockStarts[block] += m_BlockStarts[block - 1];
+	pool.ParallelFor(0, blockCount, [&](int begin, int end) {
+		for (int block = begin; block < end; ++block)
+		{
+			const int cellEnd = std::min((block + 1) * s_ScanBlockCells, cellCount);
+			uint32_t start = m_BlockStarts[block];
+			for (int cell = block * s_ScanBlockCells; cell < cellEnd; ++cell)
+			{
+				m_CellStart[cell] = start;
+				start += m_CellCounts[cell].load(std::memory_order_relaxed);
+			}
+		}
+	});
+	m_CellStart[cellCount] = m_BlockStarts[blockCount];
+	m_CellParticles.resize(m_CellStart[cellCount]);
+
+	pool.ParallelFor(0, count, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+		{
+			if (m_Cells[i] != s_FreeSlot)
+				m_CellParticles[m_CellStart[m_Cells[i]] + m_Ranks[i]] = (uint32_t)i;
+		}
+	});
+	// Put each cell's particles back in index order. Cells hold a handful of them, so
+	// this costs far less than the slots it fixes up.
+	pool.ParallelFor(0, cellCount, [&](int begin, int end) {
+		for (int cell = begin; cell < end; ++cell)
+		{
+			if (m_CellStart[cell + 1] - m_CellStart[cell] > 1)
+				std::sort(m_CellParticles.begin() + m_CellStart[cell], m_CellParticles.begin() + m_CellStart[cell + 1]);
+		}
+	});
+}
+
+void CellIndex::Sort(ParticleStore& particles, float invCellSize, ThreadPool& pool)
+{
+	Bin(particles, invCellSize, pool);
+	const int count = (int)m_CellParticles.size();
+	m_Order.swap(m_CellParticles);
+	for (AlignedVector<float>* attribute : particles.GetAttributes())
+	{
+		// The attribute leaves its storage here for the next one, so whatever the store
+		// reserved survives the swap.
+		m_Scratch.reserve(attribute->capacity());
+		m_Scratch.resize(count);
+		const float* source = attribute->data();
+		float* destination = m_Scratch.data();
+		pool.ParallelFor(0, count, [&](int begin, int end) {
+			for (int i = begin; i < end; ++i)
+				destination[i] = source[m_Order[i]];
+		});
+		attribute->swap(m_Scratch);
+	}
+	// The particles are in cell order now, without the free slots.
+	particles.Resize(count);
+	m_CellParticles.resize(count);
+	std::iota(m_CellParticles.begin(), m_CellParticles.end(), 0u);
+}
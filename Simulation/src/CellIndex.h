@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+
+// Buckets particles by the grid cell they are in. Sort reorders the particle store so
+// the particles of each cell are contiguous and the cells follow the grid's row-major
+// order, which turns the grid gathers of the particle update into a near-sequential
+// walk. Bin only lists the particles cell by cell, for passes that need them grouped
+// every step without paying for the move. The start of every cell's run is kept, for
+// neighbour queries.
+class CellIndex
+{
+public:
+	void Resize(int width, int height);
+	// Makes room to bin and sort capacity particles, so neither allocates as the store
+	// grows up to it.
+	void Reserve(size_t capacity);
+	int GetWidth() const { return m_Width; }
+	int GetHeight() const { return m_Height; }
+
+	// Lists the particles by the cell their position falls in, clamped to the grid,
+	// without moving them. Free slots are left out. Counting, the prefix sum and the scatter all run on the
+	// pool, and the result is stable like Sort's.
+	void Bin(const ParticleStore& particles, float invCellSize, ThreadPool& pool);
+
+	// Counting sort of the particles by the cell their position falls in, clamped to
+	// the grid. The sort is stable, so particles in the same cell keep their order and
+	// the result does not depend on the thread count. Free slots are dropped from the
+	// store.
+	void Sort(ParticleStore& particles, float invCellSize, ThreadPool& pool);
+
+	// GetCellParticles()[GetCellStart(x, y), GetCellEnd(x, y)) were in cell (x, y) when
+	// the particles were last binned or sorted. Right after a sort the list is 0, 1, 2...
+	uint32_t GetCellStart(int x, int y) const { return m_CellStart[(size_t)y * m_Width + x]; }
+	uint32_t GetCellEnd(int x, int y) const { return m_CellStart[(size_t)y * m_Width + x + 1]; }
+	const std::vector<uint32_t>& GetCellParticles() const { return m_CellParticles; }
+
+	// Index each particle had before the last sort, by its index after it.
+	const std::vector<uint32_t>& GetOrder() const { return m_Order; }
+private:
+	int m_Width = 0, m_Height = 0;
+	std::vector<uint32_t> m_CellStart;
+	std::vector<uint32_t> m_Cells;
+	// Particles counted into each cell so far, and the slot each particle took there.
+	std::unique_ptr<std::atomic<uint32_t>[]> m_CellCounts;
+	std::vector<uint32_t> m_Ranks;
+	// Where each block of the prefix sum starts.
+	std::vector<uint32_t> m_BlockStarts;
+	std::vector<uint32_t> m_CellParticles;
+	std::vector<uint32_t> m_Order;
+	// Sorted attributes are gathered here and then swapped into the store, so it is kept
+	// at least as large as the attribute it replaces.
+	AlignedVector<float> m_Scratch;
+};
@@ -0,0 +1,410 @@
+#include "Checkpoint.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#include "GLCore/Core/Log.h"
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <Windows.h>
+	#include <io.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace {
+
+	// Sections are checksummed in blocks of this size, so large sections can be
+	// verified by every thread at once.
+	const uint64_t s_ChecksumBlockSize = 1 << 20;
+
+	const uint64_t s_Prime1 = 11400714785074694791ULL;
+	const uint64_t s_Prime2 = 14029467366897019727ULL;
+	const uint64_t s_Prime3 = 1609587929392839161ULL;
+	const uint64_t s_Prime4 = 9650029242287828579ULL;
+	const uint64_t s_Prime5 = 2870177450012600261ULL;
+
+	inline uint64_t RotateLeft(uint64_t value, int bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	inline uint64_t Read64(const uint8_t* data)
+	{
+		uint64_t value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	inline uint32_t Read32(const uint8_t* data)
+	{
+		uint32_t value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	inline uint64_t Round(uint64_t accumulator, uint64_t input)
+	{
+		accumulator += input * s_Prime2;
+		return RotateLeft(accumulator, 31) * s_Prime1;
+	}
+
+	inline uint64_t Merge(uint64_t hash, uint64_t accumulator)
+	{
+		hash ^= Round(0, accumulator);
+		return hash * s_Prime1 + s_Prime4;
+	}
+
+	// XXH64, fast enough to keep up with memcpy.
+	uint64_t Hash(const void* data, uint64_t size, uint64_t seed)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		const uint8_t* end = bytes + size;
+		uint64_t hash;
+		if (size >= 32)
+		{
+			uint64_t v1 = seed + s_Prime1 + s_Prime2, v2 = seed + s_Prime2, v3 = seed, v4 = seed - s_Prime1;
+			for (; bytes + 32 <= end; bytes += 32)
+			{
+				v1 = Round(v1, Read64(bytes));
+				v2 = Round(v2, Read64(bytes + 8));
+				v3 = Round(v3, Read64(bytes + 16));
+				v4 = Round(v4, Read64(bytes + 24));
+			}
+			hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+			hash = Merge(Merge(Merge(Merge(hash, v1), v2), v3), v4);
+		}
+		else
+			hash = seed + s_Prime5;
+
+		hash += size;
+		for (; bytes + 8 <= end; bytes += 8)
+			hash = RotateLeft(hash ^ Round(0, Read64(bytes)), 27) * s_Prime1 + s_Prime4;
+		if (bytes + 4 <= end)
+		{
+			hash = RotateLeft(hash ^ (Read32(bytes) * s_Prime1), 23) * s_Prime2 + s_Prime3;
+			bytes += 4;
+		}
+		for (; bytes < end; ++bytes)
+			hash = RotateLeft(hash ^ (*bytes * s_Prime5), 11) * s_Prime1;
+
+		hash ^= hash >> 33;
+		hash *= s_Prime2;
+		hash ^= hash >> 29;
+		hash *= s_Prime3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+	int BlockCount(uint64_t size)
+	{
+		return (int)((size + s_ChecksumBlockSize - 1) / s_ChecksumBlockSize);
+	}
+
+	// Hashes every block of a section and then the block hashes.
+	uint64_t BlockChecksum(const uint8_t* data, uint64_t size, ThreadPool& pool)
+	{
+		std::vector<uint64_t> blockHashes(BlockCount(size));
+		pool.ParallelFor(0, (int)blockHashes.size(), [&](int blockBegin, int blockEnd) {
+			for (int block = blockBegin; block < blockEnd; ++block)
+			{
+				const uint64_t offset = block * s_ChecksumBlockSize;
+				blockHashes[block] = Hash(data + offset, std::min(s_ChecksumBlockSize, size - offset), 0);
+			}
+		});
+		return Hash(blockHashes.data(), blockHashes.size() * sizeof(uint64_t), size);
+	}
+
+	// Puts the file's data on the disk, so the rename that publishes it cannot land
+	// before the data does.
+	bool SyncFile(FILE* file)
+	{
+#ifdef _WIN32
+		return _commit(_fileno(file)) == 0;
+#else
+		return fsync(fileno(file)) == 0;
+#endif
+	}
+
+	uint64_t AlignUp(uint64_t value)
+	{
+		return (value + CheckpointAlignment - 1) / CheckpointAlignment * CheckpointAlignment;
+	}
+
+	uint64_t HeaderChecksum(const CheckpointHeader& header, const CheckpointSectionDescriptor* sections)
+	{
+		CheckpointHeader copy = header;
+		copy.HeaderChecksum = 0;
+		return Hash(sections, header.SectionCount * sizeof(CheckpointSectionDescriptor), Hash(&copy, sizeof(copy), 0));
+	}
+
+}
+
+void CheckpointWriter::AddSection(const char* name, CheckpointElement element, const void* data, uint64_t elementCount, uint64_t size)
+{
+	Section section = {};
+	std::strncpy(section.Descriptor.Name, name, sizeof(section.Descriptor.Name) - 1);
+	section.Descriptor.Element = element;
+	section.Descriptor.ElementCount = elementCount;
+	section.Descriptor.Size = size;
+	section.Data = data;
+	m_Sections.push_back(section);
+}
+
+bool CheckpointWriter::Write(const std::string& path, ThreadPool& pool) const
+{
+	CheckpointHeader header = {};
+	std::memcpy(header.Magic, CheckpointMagic, sizeof(header.Magic));
+	header.Version = CheckpointVersion;
+	header.SectionCount = (uint32_t)m_Sections.size();
+
+	std::vector<CheckpointSectionDescriptor> descriptors;
+	uint64_t offset = AlignUp(sizeof(CheckpointHeader) + m_Sections.size() * sizeof(CheckpointSectionDescriptor));
+	for (const Section& section : m_Sections)
+	{
+		CheckpointSectionDescriptor descriptor = section.Descriptor;
+		descriptor.Offset = offset;
+		descriptor.Checksum = BlockChecksum(static_cast<const uint8_t*>(section.Data), descriptor.Size, pool);
+		descriptors.push_back(descriptor);
+		offset = AlignUp(offset + descriptor.Size);
+	}
+	header.FileSize = offset;
+	header.HeaderChecksum = HeaderChecksum(header, descriptors.data());
+
+	const std::string temporaryPath = path + ".tmp";
+	FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+	if (!file)
+	{
+		LOG_ERROR("Could not create checkpoint '{0}'", temporaryPath);
+		return false;
+	}
+
+	static const uint8_t padding[CheckpointAlignment] = {};
+	uint64_t written = 0;
+	bool failed = false;
+	auto write = [&](const void* data, uint64_t size) {
+		if (!failed && std::fwrite(data, 1, (size_t)size, file) != size)
+			failed = true;
+		written += size;
+	};
+	write(&header, sizeof(header));
+	write(descriptors.data(), descriptors.size() * sizeof(CheckpointSectionDescriptor));
+	for (size_t i = 0; i < m_Sections.size(); ++i)
+	{
+		write(padding, descriptors[i].Offset - written);
+		write(m_Sections[i].Data, descriptors[i].Size);
+	}
+	write(padding, header.FileSize - written);
+
+	const bool complete = !failed && std::fflush(file) == 0 && SyncFile(file);
+	const bool closed = std::fclose(file) == 0;
+	if (!complete || !closed)
+	{
+		LOG_ERROR("Could not write checkpoint '{0}'", temporaryPath);
+		std::remove(temporaryPath.c_str());
+		return false;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, path, error);
+	if (error)
+	{
+		LOG_ERROR("Could not replace checkpoint '{0}': {1}", path, error.message());
+		return false;
+	}
+	return true;
+}
+
+CheckpointReader::~CheckpointReader()
+{
+	Close();
+}
+
+bool CheckpointReader::Open(const std::string& path)
+{
+	Close();
+	m_Path = path;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		LOG_ERROR("Could not open checkpoint '{0}'", path);
+		return false;
+	}
+	m_File = file;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		LOG_ERROR("Checkpoint '{0}' is empty", path);
+		Close();
+		return false;
+	}
+	m_Mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_Mapping)
+		m_Data = static_cast<const uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+	m_Size = (uint64_t)size.QuadPart;
+#else
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		LOG_ERROR("Could not open checkpoint '{0}'", path);
+		return false;
+	}
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size == 0)
+	{
+		LOG_ERROR("Checkpoint '{0}' is empty", path);
+		close(file);
+		return false;
+	}
+	void* data = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (data != MAP_FAILED)
+	{
+		m_Data = static_cast<const uint8_t*>(data);
+		// Sections are read by several threads at once, so fetch ahead in bulk.
+		madvise(data, (size_t)status.st_size, MADV_WILLNEED);
+	}
+	m_Size = (uint64_t)status.st_size;
+#endif
+	if (!m_Data)
+	{
+		LOG_ERROR("Could not map checkpoint '{0}'", path);
+		Close();
+		return false;
+	}
+
+	CheckpointHeader header;
+	if (m_Size < sizeof(header))
+	{
+		LOG_ERROR("Checkpoint '{0}' is truncated", path);
+		Close();
+		return false;
+	}
+	std::memcpy(&header, m_Data, sizeof(header));
+	if (std::memcmp(header.Magic, CheckpointMagic, sizeof(header.Magic)) != 0)
+	{
+		LOG_ERROR("'{0}' is not a checkpoint", path);
+		Close();
+		return false;
+	}
+	if (header.Version < CheckpointOldestVersion || header.Version > CheckpointVersion)
+	{
+		LOG_ERROR("Checkpoint '{0}' has version {1}, expected {2} to {3}", path, header.Version, CheckpointOldestVersion, CheckpointVersion);
+		Close();
+		return false;
+	}
+	const uint64_t descriptorBytes = (uint64_t)header.SectionCount * sizeof(CheckpointSectionDescriptor);
+	if (header.FileSize != m_Size || sizeof(header) + descriptorBytes > m_Size)
+	{
+		LOG_ERROR("Checkpoint '{0}' is truncated", path);
+		Close();
+		return false;
+	}
+
+	m_Sections = reinterpret_cast<const CheckpointSectionDescriptor*>(m_Data + sizeof(header));
+	m_SectionCount = header.SectionCount;
+	if (HeaderChecksum(header, m_Sections) != header.HeaderChecksum)
+	{
+		LOG_ERROR("Checkpoint '{0}' has a damaged header", path);
+		Close();
+		return false;
+	}
+	for (uint32_t i = 0; i < m_SectionCount; ++i)
+	{
+		const CheckpointSectionDescriptor& section = m_Sections[i];
+		if (section.Offset % CheckpointAlignment != 0 || section.Offset > m_Size || section.Size > m_Size - section.Offset)
+		{
+			LOG_ERROR("Checkpoint '{0}' has a bad section '{1}'", path, std::string(section.Name, strnlen(section.Name, sizeof(section.Name))));
+			Close();
+			return false;
+		}
+	}
+	return true;
+}
+
+void CheckpointReader::Close()
+{
+#ifdef _WIN32
+	if (m_Data)
+		UnmapViewOfFile(m_Data);
+	if (m_Mapping)
+		CloseHandle(m_Mapping);
+	if (m_File)
+		CloseHandle(m_File);
+	m_Mapping = nullptr;
+	m_File = nullptr;
+#else
+	if (m_Data)
+		munmap(const_cast<uint8_t*>(m_Data), (size_t)m_Size);
+#endif
+	m_Data = nullptr;
+	m_Size = 0;
+	m_Sections = nullptr;
+	m_SectionCount = 0;
+}
+
+const CheckpointSectionDescriptor* CheckpointReader::FindSection(const char* name) const
+{
+	for (uint32_t i = 0; i < m_SectionCount; ++i)
+	{
+		if (std::strncmp(m_Sections[i].Name, name, sizeof(m_Sections[i].Name)) == 0)
+			return &m_Sections[i];
+	}
+	return nullptr;
+}
+
+bool CheckpointReader::VerifySection(const char* name, CheckpointElement element, uint64_t elementCount, uint64_t size, ThreadPool& pool) const
+{
+	const CheckpointSectionDescriptor* section = FindSection(name);
+	if (!section)
+	{
+		LOG_ERROR("Checkpoint '{0}' has no section '{1}'", m_Path, name);
+		return false;
+	}
+	if (section->Element != element || section->ElementCount != elementCount || section->Size != size)
+	{
+		LOG_ERROR("Section '{0}' of checkpoint '{1}' holds {2} elements of type {3}, expected {4} of type {5}",
+			name, m_Path, section->ElementCount, (uint32_t)section->Element, elementCount, (uint32_t)element);
+		return false;
+	}
+
+	if (BlockChecksum(m_Data + section->Offset, size, pool) != section->Checksum)
+	{
+		LOG_ERROR("Section '{0}' of checkpoint '{1}' is damaged", name, m_Path);
+		return false;
+	}
+	return true;
+}
+
+void CheckpointReader::CopySection(const char* name, void* destination, ThreadPool& pool) const
+{
+	const CheckpointSectionDescriptor* section = FindSection(name);
+	const uint8_t* source = m_Data + section->Offset;
+	uint8_t* target = static_cast<uint8_t*>(destination);
+	const uint64_t size = section->Size;
+	pool.ParallelFor(0, BlockCount(size), [&](int blockBegin, int blockEnd) {
+		for (int block = blockBegin; block < blockEnd; ++block)
+		{
+			const uint64_t offset = block * s_ChecksumBlockSize;
+			std::memcpy(target + offset, source + offset, (size_t)std::min(s_ChecksumBlockSize, size - offset));
+		}
+	});
+}
+
+bool CheckpointReader::ReadSection(const char* name, CheckpointElement element, void* destination, uint64_t elementCount, uint64_t size, ThreadPool& pool) const
+{
+	if (!VerifySection(name, element, elementCount, size, pool))
+		return false;
+	CopySection(name, destination, pool);
+	return true;
+}
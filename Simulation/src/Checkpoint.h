@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Versioned binary checkpoint file. Layout:
+//   CheckpointHeader
+//   CheckpointSectionDescriptor * SectionCount
+//   section data, each section starting on a CheckpointAlignment boundary
+// The header checksum covers the header and the descriptors, and every descriptor
+// carries the checksum of its own section, so a truncated or damaged file is caught
+// before any of it is used. All values are little-endian.
+constexpr char CheckpointMagic[8] = { 'P', 'S', 'Y', 'S', 'C', 'K', 'P', 'T' };
+constexpr uint32_t CheckpointVersion = 2;
+// Oldest version the reader still opens. Version 1 has no "settings" section, the
+// rest of its layout is the same.
+constexpr uint32_t CheckpointOldestVersion = 1;
+// Page sized, so sections of a mapped file start on their own page and any SIMD load
+// from them is aligned.
+constexpr uint64_t CheckpointAlignment = 4096;
+
+struct CheckpointHeader
+{
+	char Magic[8];
+	uint32_t Version;
+	uint32_t SectionCount;
+	uint64_t FileSize;
+	// Checksum of the header, with this field zeroed, and the descriptors.
+	uint64_t HeaderChecksum;
+};
+
+enum class CheckpointElement : uint32_t
+{
+	Bytes = 0,
+	Float32,
+	Vec2Float32
+};
+
+struct CheckpointSectionDescriptor
+{
+	char Name[32];
+	CheckpointElement Element;
+	uint32_t Reserved;
+	uint64_t ElementCount;
+	uint64_t Offset;
+	uint64_t Size;
+	uint64_t Checksum;
+};
+
+// Collects sections that point at live data and writes them out in one go. The data
+// must stay unchanged until Write returns.
+class CheckpointWriter
+{
+public:
+	void AddSection(const char* name, CheckpointElement element, const void* data, uint64_t elementCount, uint64_t size);
+
+	// Writes to a temporary file next to path and renames it over path once it is
+	// complete and synced to disk, so a crash while saving leaves the previous
+	// checkpoint intact.
+	bool Write(const std::string& path, ThreadPool& pool) const;
+private:
+	struct Section
+	{
+		CheckpointSectionDescriptor Descriptor;
+		const void* Data;
+	};
+	std::vector<Section> m_Sections;
+};
+
+// Maps a checkpoint file into memory and copies its sections out of the mapping, so
+// loading reads straight from the page cache with no intermediate buffers. Sections
+// are verified in place, so a loader can check all of them before it overwrites any
+// of its own state.
+class CheckpointReader
+{
+public:
+	CheckpointReader() = default;
+	~CheckpointReader();
+
+	CheckpointReader(const CheckpointReader&) = delete;
+	CheckpointReader& operator=(const CheckpointReader&) = delete;
+
+	// Maps the file and validates its header and descriptors. Section checksums are
+	// checked by VerifySection.
+	bool Open(const std::string& path);
+	void Close();
+
+	const CheckpointSectionDescriptor* FindSection(const char* name) const;
+
+	// Checks that a section is present, has exactly this element type, count and size
+	// and matches its checksum, hashed across the pool. Nothing is copied.
+	bool VerifySection(const char* name, CheckpointElement element, uint64_t elementCount, uint64_t size, ThreadPool& pool) const;
+	// Copies a section VerifySection accepted into destination, split across the pool.
+	void CopySection(const char* name, void* destination, ThreadPool& pool) const;
+	// VerifySection, then CopySection.
+	bool ReadSection(const char* name, CheckpointElement element, void* destination, uint64_t elementCount, uint64_t size, ThreadPool& pool) const;
+private:
+	std::string m_Path;
+	const uint8_t* m_Data = nullptr;
+	uint64_t m_Size = 0;
+	const CheckpointSectionDescriptor* m_Sections = nullptr;
+	uint32_t m_SectionCount = 0;
+#ifdef _WIN32
+	void* m_File = nullptr;
+	void* m_Mapping = nullptr;
+#endif
+};
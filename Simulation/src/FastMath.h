@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+#endif
+
+// Approximations of the transcendental functions the solver kernels call per cell.
+// Each vector version performs exactly the same operations as its scalar version, so
+// the two give identical results and kernels can mix them for row remainders.
+namespace FastMath {
+
+	// exp(x) is split into 2^n * exp(f) with |f| <= ln(2)/2, using a two-part ln(2) so
+	// f keeps its precision, and exp(f) is the Cephes expf polynomial. The relative
+	// error is below 2e-7 over the whole float range; x is clamped to [-87.3, 88.3] so
+	// the result never overflows or goes denormal.
+	constexpr float ExpMin = -87.3f;
+	constexpr float ExpMax = 88.3f;
+	constexpr float Log2e = 1.44269504089f;
+	constexpr float Ln2High = 0.693359375f;
+	constexpr float Ln2Low = -2.12194440e-4f;
+	constexpr float ExpP0 = 1.9875691500e-4f;
+	constexpr float ExpP1 = 1.3981999507e-3f;
+	constexpr float ExpP2 = 8.3334519073e-3f;
+	constexpr float ExpP3 = 4.1665795894e-2f;
+	constexpr float ExpP4 = 1.6666665459e-1f;
+	constexpr float ExpP5 = 5.0000001201e-1f;
+
+	inline float Exp(float x)
+	{
+		x = std::min(std::max(x, ExpMin), ExpMax);
+		const float n = std::floor(x * Log2e + 0.5f);
+		const float f = x - n * Ln2High - n * Ln2Low;
+
+		float p = ExpP0 * f + ExpP1;
+		p = p * f + ExpP2;
+		p = p * f + ExpP3;
+		p = p * f + ExpP4;
+		p = p * f + ExpP5;
+		p = p * (f * f) + f + 1.0f;
+
+		const int32_t bits = ((int32_t)n + 127) << 23;
+		float scale;
+		std::memcpy(&scale, &bits, sizeof(scale));
+		return p * scale;
+	}
+
+#if defined(__AVX2__)
+	inline __m256 Exp(__m256 x)
+	{
+		x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(ExpMin)), _mm256_set1_ps(ExpMax));
+		const __m256 n = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(Log2e)), _mm256_set1_ps(0.5f)));
+		const __m256 f = _mm256_sub_ps(_mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(Ln2High))), _mm256_mul_ps(n, _mm256_set1_ps(Ln2Low)));
+
+		__m256 p = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(ExpP0), f), _mm256_set1_ps(ExpP1));
+		p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(ExpP2));
+		p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(ExpP3));
+		p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(ExpP4));
+		p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(ExpP5));
+		p = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p, _mm256_mul_ps(f, f)), f), _mm256_set1_ps(1.0f));
+
+		const __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127)), 23);
+		return _mm256_mul_ps(p, _mm256_castsi256_ps(bits));
+	}
+#endif
+
+}
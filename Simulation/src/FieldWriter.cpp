@@ -0,0 +1,224 @@
+#include "FieldWriter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "GLCore/Core/Log.h"
+
+static const uint32_t s_FrameMagic = 0x454D5246; // "FRME"
+
+FieldWriter::~FieldWriter()
+{
+	Close();
+}
+
+bool FieldWriter::Open(const FieldOutputSettings& settings, int width, int height, float cellSize)
+{
+	Close();
+	m_Settings = settings;
+	m_Settings.Interval = std::max(1, settings.Interval);
+	m_Settings.Decimation = std::max(1, settings.Decimation);
+	m_Settings.QueueDepth = std::max(1, settings.QueueDepth);
+	m_SourceWidth = width;
+	m_SourceHeight = height;
+	m_Width = (width + m_Settings.Decimation - 1) / m_Settings.Decimation;
+	m_Height = (height + m_Settings.Decimation - 1) / m_Settings.Decimation;
+
+	int components = 0;
+	if (m_Settings.Fields & FieldOutputTemperature) components += 1;
+	if (m_Settings.Fields & FieldOutputVapor) components += 1;
+	if (m_Settings.Fields & FieldOutputCloudWater) components += 1;
+	if (m_Settings.Fields & FieldOutputVelocity) components += 2;
+	m_FrameFloats = (size_t)m_Width * m_Height * components;
+
+	m_File = std::fopen(m_Settings.Path.c_str(), "wb");
+	if (!m_File)
+	{
+		LOG_ERROR("Could not create field output '{0}'", m_Settings.Path);
+		return false;
+	}
+
+	FieldFileHeader header = {};
+	std::memcpy(header.Magic, FieldFileMagic, sizeof(header.Magic));
+	header.Version = FieldFileVersion;
+	header.Fields = m_Settings.Fields;
+	header.Width = m_Width;
+	header.Height = m_Height;
+	header.Decimation = m_Settings.Decimation;
+	header.CellSize = cellSize * m_Settings.Decimation;
+	// Flushed straight away, so a file that cannot be written fails here rather than
+	// on the writer thread.
+	if (std::fwrite(&header, sizeof(header), 1, m_File) != 1 || std::fflush(m_File) != 0)
+	{
+		LOG_ERROR("Could not write field output '{0}'", m_Settings.Path);
+		std::fclose(m_File);
+		m_File = nullptr;
+		return false;
+	}
+	m_Offset = sizeof(header);
+
+	// Every buffer is allocated up front, Submit never allocates.
+	m_Frames = std::vector<Frame>(m_Settings.QueueDepth);
+	for (Frame& frame : m_Frames)
+	{
+		frame.Data.resize(m_FrameFloats);
+		m_FreeFrames.push_back(&frame);
+	}
+	m_Stats = FieldOutputStats();
+	m_Stop = false;
+	m_WriteFailed = false;
+	m_Thread = std::thread(&FieldWriter::WriterLoop, this);
+	return true;
+}
+
+bool FieldWriter::Close()
+{
+	if (!m_File)
+		return true;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_FrameQueued.notify_all();
+	m_Thread.join();
+
+	// After a failed write the file ends in a partial frame, so the index would not
+	// land where the trailer says. It is left without one, like a file cut short by a
+	// crash, and the frames before the failure can be re-indexed from their headers.
+	bool written = !m_WriteFailed;
+	if (written)
+	{
+		FieldFileTrailer trailer = {};
+		trailer.IndexOffset = m_Offset;
+		trailer.FrameCount = m_Index.size();
+		std::memcpy(trailer.Magic, FieldFileMagic, sizeof(trailer.Magic));
+		written = std::fwrite(m_Index.data(), sizeof(FieldIndexEntry), m_Index.size(), m_File) == m_Index.size() &&
+			std::fwrite(&trailer, sizeof(trailer), 1, m_File) == 1;
+	}
+	written = std::fclose(m_File) == 0 && written;
+	if (!written)
+		LOG_ERROR("Could not write field output '{0}'", m_Settings.Path);
+
+	m_File = nullptr;
+	m_Index.clear();
+	m_FreeFrames.clear();
+	m_QueuedFrames.clear();
+	m_Frames.clear();
+	return written;
+}
+
+void FieldWriter::CopyField(const float* source, int components, float*& out) const
+{
+	const int decimation = m_Settings.Decimation;
+	for (int y = 0; y < m_SourceHeight; y += decimation)
+	{
+		const float* row = source + (size_t)y * m_SourceWidth * components;
+		if (decimation == 1)
+		{
+			std::memcpy(out, row, (size_t)m_SourceWidth * components * sizeof(float));
+			out += (size_t)m_SourceWidth * components;
+			continue;
+		}
+		for (int x = 0; x < m_SourceWidth; x += decimation)
+		{
+			for (int c = 0; c < components; ++c)
+				*out++ = row[(size_t)x * components + c];
+		}
+	}
+}
+
+void FieldWriter::Submit(uint32_t step, float time, const Grid2D<float>& temperature, const Grid2D<float>& vapor,
+	const Grid2D<float>& cloudWater, const Grid2D<glm::vec2>& velocity)
+{
+	if (!m_File)
+		return;
+
+	Frame* frame = nullptr;
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		++m_Stats.FramesSubmitted;
+		if (m_FreeFrames.empty())
+		{
+			if (m_Settings.DropWhenFull)
+			{
+				++m_Stats.FramesDropped;
+				return;
+			}
+			auto stallStart = std::chrono::steady_clock::now();
+			m_FrameFreed.wait(lock, [this]() { return !m_FreeFrames.empty(); });
+			m_Stats.StallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - stallStart).count();
+		}
+		frame = m_FreeFrames.front();
+		m_FreeFrames.pop_front();
+	}
+
+	float* out = frame->Data.data();
+	if (m_Settings.Fields & FieldOutputTemperature)
+		CopyField(temperature.GetData(), 1, out);
+	if (m_Settings.Fields & FieldOutputVapor)
+		CopyField(vapor.GetData(), 1, out);
+	if (m_Settings.Fields & FieldOutputCloudWater)
+		CopyField(cloudWater.GetData(), 1, out);
+	if (m_Settings.Fields & FieldOutputVelocity)
+		CopyField(&velocity.GetData()->x, 2, out);
+
+	frame->Header.Magic = s_FrameMagic;
+	frame->Header.Step = step;
+	frame->Header.Time = time;
+	frame->Header.Fields = m_Settings.Fields;
+	frame->Header.PayloadSize = m_FrameFloats * sizeof(float);
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_QueuedFrames.push_back(frame);
+		m_Stats.PeakQueueDepth = std::max(m_Stats.PeakQueueDepth, (int)m_QueuedFrames.size());
+	}
+	m_FrameQueued.notify_one();
+}
+
+FieldOutputStats FieldWriter::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Stats;
+}
+
+void FieldWriter::WriterLoop()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	for (;;)
+	{
+		m_FrameQueued.wait(lock, [this]() { return m_Stop || !m_QueuedFrames.empty(); });
+		// Queued frames are still written after Close asks the thread to stop.
+		if (m_QueuedFrames.empty())
+			return;
+
+		Frame* frame = m_QueuedFrames.front();
+		m_QueuedFrames.pop_front();
+		// Nothing more is written after a failure, the frames would not start where the
+		// offsets say.
+		const bool failed = m_WriteFailed;
+		lock.unlock();
+
+		const bool written = !failed && std::fwrite(&frame->Header, sizeof(frame->Header), 1, m_File) == 1 &&
+			std::fwrite(frame->Data.data(), sizeof(float), frame->Data.size(), m_File) == frame->Data.size();
+		// Only frames that made it to the file are indexed.
+		if (written)
+		{
+			m_Index.push_back({ frame->Header.Step, 0, m_Offset });
+			m_Offset += sizeof(frame->Header) + frame->Header.PayloadSize;
+		}
+
+		lock.lock();
+		if (written)
+		{
+			++m_Stats.FramesWritten;
+			m_Stats.BytesWritten += sizeof(frame->Header) + frame->Header.PayloadSize;
+		}
+		else
+			m_WriteFailed = true;
+		m_FreeFrames.push_back(frame);
+		m_FrameFreed.notify_one();
+	}
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Grid2D.h"
+
+// Fields a FieldWriter can store, combined as a bit mask.
+enum FieldOutputFlags : uint32_t
+{
+	FieldOutputTemperature = 1 << 0,
+	FieldOutputVapor = 1 << 1,
+	FieldOutputCloudWater = 1 << 2,
+	FieldOutputVelocity = 1 << 3,
+	FieldOutputAll = FieldOutputTemperature | FieldOutputVapor | FieldOutputCloudWater | FieldOutputVelocity
+};
+
+struct FieldOutputSettings
+{
+	std::string Path;
+	uint32_t Fields = FieldOutputAll;
+	// A frame is captured every Interval steps.
+	int Interval = 10;
+	// Keeps every Decimation-th cell in x and in y.
+	int Decimation = 1;
+	// Number of frame buffers, at most this many frames are waiting to be written.
+	int QueueDepth = 4;
+	// When every buffer is waiting, stall the solver until one is free, or drop the frame.
+	bool DropWhenFull = false;
+};
+
+struct FieldOutputStats
+{
+	uint64_t FramesSubmitted = 0;
+	uint64_t FramesWritten = 0;
+	uint64_t FramesDropped = 0;
+	uint64_t BytesWritten = 0;
+	// Most frames that were waiting at once, and how long the solver waited for a
+	// free buffer in total.
+	int PeakQueueDepth = 0;
+	double StallSeconds = 0.0;
+};
+
+// File layout, all values little-endian:
+//   FieldFileHeader
+//   frames, each a FieldFrameHeader followed by the selected fields in flag order,
+//   float32 per cell and two for velocity, row-major at the decimated resolution
+//   index written on Close: FieldIndexEntry * FrameCount
+//   FieldFileTrailer
+// Frames are only ever appended, so a file cut short by a crash still holds every
+// frame before the cut and can be re-indexed by walking the frame headers.
+constexpr char FieldFileMagic[8] = { 'P', 'S', 'Y', 'S', 'F', 'L', 'D', 'S' };
+constexpr uint32_t FieldFileVersion = 1;
+
+struct FieldFileHeader
+{
+	char Magic[8];
+	uint32_t Version;
+	uint32_t Fields;
+	int32_t Width, Height;
+	int32_t Decimation;
+	float CellSize;
+};
+
+struct FieldFrameHeader
+{
+	uint32_t Magic;
+	uint32_t Step;
+	float Time;
+	uint32_t Fields;
+	uint64_t PayloadSize;
+};
+
+struct FieldIndexEntry
+{
+	uint32_t Step;
+	uint32_t Reserved;
+	uint64_t Offset;
+};
+
+struct FieldFileTrailer
+{
+	uint64_t IndexOffset;
+	uint64_t FrameCount;
+	char Magic[8];
+};
+
+// Streams field snapshots to disk on its own thread. Submit copies the selected fields
+// into one of a fixed pool of buffers and hands it to the writer thread, so the
+// solver only pays for the copy and never waits on the disk unless the queue is full.
+class FieldWriter
+{
+public:
+	FieldWriter() = default;
+	~FieldWriter();
+
+	FieldWriter(const FieldWriter&) = delete;
+	FieldWriter& operator=(const FieldWriter&) = delete;
+
+	// False if the file could not be created or its header written.
+	bool Open(const FieldOutputSettings& settings, int width, int height, float cellSize);
+	// Writes every queued frame and the index, then closes the file. False if any of
+	// it failed to write, the file then ends after the last whole frame it could hold
+	// and has no index.
+	bool Close();
+	bool IsOpen() const { return m_File != nullptr; }
+
+	bool ShouldCapture(uint32_t step) const { return IsOpen() && step % (uint32_t)m_Settings.Interval == 0; }
+	void Submit(uint32_t step, float time, const Grid2D<float>& temperature, const Grid2D<float>& vapor,
+		const Grid2D<float>& cloudWater, const Grid2D<glm::vec2>& velocity);
+
+	FieldOutputStats GetStats() const;
+private:
+	struct Frame
+	{
+		FieldFrameHeader Header;
+		std::vector<float> Data;
+	};
+
+	void WriterLoop();
+	void CopyField(const float* source, int components, float*& out) const;
+private:
+	FieldOutputSettings m_Settings;
+	int m_SourceWidth = 0, m_SourceHeight = 0;
+	int m_Width = 0, m_Height = 0;
+	size_t m_FrameFloats = 0;
+	FILE* m_File = nullptr;
+	uint64_t m_Offset = 0;
+	std::vector<FieldIndexEntry> m_Index;
+
+	std::vector<Frame> m_Frames;
+	std::deque<Frame*> m_FreeFrames;
+	std::deque<Frame*> m_QueuedFrames;
+	mutable std::mutex m_Mutex;
+	std::condition_variable m_FrameFreed;
+	std::condition_variable m_FrameQueued;
+	bool m_Stop = false;
+	bool m_WriteFailed = false;
+	FieldOutputStats m_Stats;
+	std::thread m_Thread;
+};
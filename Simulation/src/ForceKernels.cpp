@@ -0,0 +1,91 @@
+#include "ForceKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+	// Reference virtual potential temperature the buoyancy is measured against, in K.
+	const float s_ReferenceVirtualTemperature = 295.0f;
+
+	// Curl of row y over [xBegin, xEnd), for 0 < y < height - 1. The last column of the
+	// grid copies its inner neighbour.
+	void CurlRow(const Grid2D<glm::vec2>& velocityField, int y, int xBegin, int xEnd, float* curl)
+	{
+		const int width = velocityField.GetWidth();
+		const float twoCellSize = 2.0f * velocityField.GetCellSize();
+		const glm::vec2* below = velocityField[y - 1];
+		const glm::vec2* row = velocityField[y];
+		const glm::vec2* above = velocityField[y + 1];
+		const int interiorEnd = std::min(xEnd, width - 1);
+		for (int x = xBegin; x < interiorEnd; ++x)
+			curl[x] = (row[x + 1].x - row[x - 1].x) / twoCellSize - (above[x].y - below[x].y) / twoCellSize;
+		if (xEnd == width)
+			curl[width - 1] = curl[width - 2];
+	}
+
+}
+
+void ApplyForces(const Grid2D<glm::vec2>& velocityField, const Grid2D<float>& temperatureField,
+	const Grid2D<float>& vaporField, const Grid2D<float>& cloudWaterField,
+	Grid2D<glm::vec2>& newVelocity, const TileRange& range, bool confine, const ForceParams& params)
+{
+	const int width = velocityField.GetWidth();
+	const int height = velocityField.GetHeight();
+	const float cellSize = velocityField.GetCellSize();
+	// The gradient reads the curl one cell right of the range.
+	const int xBegin = std::max(range.XBegin, 1);
+	const int xEnd = std::min(range.XEnd, width - 1);
+	const int curlEnd = std::min(range.XEnd + 1, width);
+
+	// Kept per thread, so a step does not allocate.
+	thread_local std::vector<float> t_CurlRows;
+	t_CurlRows.resize(2 * (size_t)width);
+	float* curl = t_CurlRows.data();
+	float* curlAbove = curl + width;
+	bool haveCurl = false;
+
+	for (int y = range.YBegin; y < range.YEnd; ++y)
+	{
+		const glm::vec2* velocity = velocityField[y];
+		glm::vec2* out = newVelocity[y];
+		std::copy(velocity + range.XBegin, velocity + range.XEnd, out + range.XBegin);
+
+		if (confine && y > 0 && y < height - 1 && xBegin < xEnd)
+		{
+			// The row above becomes this row's curl on the next iteration.
+			if (haveCurl)
+				std::swap(curl, curlAbove);
+			else
+				CurlRow(velocityField, y, xBegin, curlEnd, curl);
+			if (y + 1 < height - 1)
+				CurlRow(velocityField, y + 1, xBegin, curlEnd, curlAbove);
+			else
+				std::copy(curl + xBegin, curl + curlEnd, curlAbove + xBegin);
+			haveCurl = true;
+
+			const float epsilon = params.VorticityEpsilon;
+			for (int x = xBegin; x < xEnd; ++x)
+			{
+				float nx = (std::abs(curl[x + 1]) - std::abs(curl[x])) / cellSize;
+				float ny = (std::abs(curlAbove[x]) - std::abs(curl[x])) / cellSize;
+				glm::vec2 n = { nx, ny };
+				float magnitude = glm::length(n);
+				glm::vec2 gradient = magnitude > 0.000001 ? n / magnitude : glm::vec2(0.0f, 0.0f);
+				glm::vec2 force = { -epsilon * gradient.y * curl[x], epsilon * gradient.x * curl[x] };
+				out[x] += force * params.DeltaTime;
+			}
+		}
+
+		const float* temperature = temperatureField[y];
+		const float* vapor = vaporField[y];
+		const float* cloudWater = cloudWaterField[y];
+		for (int x = range.XBegin; x < range.XEnd; ++x)
+		{
+			float virtualTemperature = temperature[x] * (1.0f + 0.61f * vapor[x]);
+			float buoyancy = params.BuoyancyScale * ((virtualTemperature / s_ReferenceVirtualTemperature) - cloudWater[x]);
+			out[x].y += buoyancy * params.DeltaTime;
+		}
+	}
+}
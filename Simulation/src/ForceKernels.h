@@ -0,0 +1,26 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "ActiveTiles.h"
+#include "Grid2D.h"
+
+struct ForceParams
+{
+	float VorticityEpsilon;
+	// -buoyancyEpsilon * gravity, the buoyancy per unit of relative virtual potential
+	// temperature.
+	float BuoyancyScale;
+	float DeltaTime;
+};
+
+// Adds the vorticity confinement and buoyancy forces to the cells of range, reading
+// velocityField and writing the result to newVelocity, which must not be the same
+// grid. The curl is streamed through two rows of scratch instead of a full grid: each
+// row's curl is worked out once, used for the gradient of that row and the one below
+// it, and dropped. The edges of the curl copy their inner neighbours, and the
+// confinement only reaches the interior of the grid. With confine false only the
+// buoyancy is added, for the tiles the sparse kernels skip.
+void ApplyForces(const Grid2D<glm::vec2>& velocityField, const Grid2D<float>& temperatureField,
+	const Grid2D<float>& vaporField, const Grid2D<float>& cloudWaterField,
+	Grid2D<glm::vec2>& newVelocity, const TileRange& range, bool confine, const ForceParams& params);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+// Row-major 2D field whose resolution and cell size are chosen at runtime.
+// Storage lives on the heap, so large grids no longer risk overflowing the stack.
+// field[y][x] indexing is kept so kernels read the same as the old std::array fields.
+template<typename T>
+class Grid2D
+{
+public:
+	Grid2D() = default;
+	Grid2D(int width, int height, float cellSize, const T& value = T())
+	{
+		Resize(width, height, cellSize, value);
+	}
+
+	void Resize(int width, int height, float cellSize, const T& value = T())
+	{
+		m_Width = width;
+		m_Height = height;
+		m_CellSize = cellSize;
+		m_Data.assign((size_t)width * (size_t)height, value);
+	}
+
+	void Fill(const T& value) { std::fill(m_Data.begin(), m_Data.end(), value); }
+
+	// Exchanges storage with another grid without copying, used to ping-pong
+	// between front and back buffers.
+	void Swap(Grid2D& other)
+	{
+		std::swap(m_Width, other.m_Width);
+		std::swap(m_Height, other.m_Height);
+		std::swap(m_CellSize, other.m_CellSize);
+		m_Data.swap(other.m_Data);
+	}
+
+	T* operator[](int y) { return m_Data.data() + (size_t)y * m_Width; }
+	const T* operator[](int y) const { return m_Data.data() + (size_t)y * m_Width; }
+
+	T& operator()(int x, int y) { return m_Data[(size_t)y * m_Width + x]; }
+	const T& operator()(int x, int y) const { return m_Data[(size_t)y * m_Width + x]; }
+
+	T* GetData() { return m_Data.data(); }
+	const T* GetData() const { return m_Data.data(); }
+	size_t GetSize() const { return m_Data.size(); }
+
+	int GetWidth() const { return m_Width; }
+	int GetHeight() const { return m_Height; }
+	float GetCellSize() const { return m_CellSize; }
+private:
+	int m_Width = 0;
+	int m_Height = 0;
+	float m_CellSize = 0.0f;
+	std::vector<T> m_Data;
+};
@@ -0,0 +1,507 @@
+#include "HeadlessRunner.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+#include "GLCore/Core/Log.h"
+#include "Profiler.h"
+#include "Random.h"
+
+namespace {
+
+	bool ParseInt(const std::string& text, int& value)
+	{
+		char* end = nullptr;
+		long parsed = std::strtol(text.c_str(), &end, 10);
+		if (text.empty() || *end != '\0')
+			return false;
+		value = (int)parsed;
+		return true;
+	}
+
+	bool ParseUnsigned(const std::string& text, uint32_t& value)
+	{
+		char* end = nullptr;
+		unsigned long parsed = std::strtoul(text.c_str(), &end, 10);
+		if (text.empty() || *end != '\0' || text[0] == '-')
+			return false;
+		value = (uint32_t)parsed;
+		return true;
+	}
+
+	bool ParseFloat(const std::string& text, float& value)
+	{
+		char* end = nullptr;
+		float parsed = std::strtof(text.c_str(), &end);
+		if (text.empty() || *end != '\0')
+			return false;
+		value = parsed;
+		return true;
+	}
+
+	// Comma separated list of temperature, vapor, cloud-water and velocity, or all.
+	bool ParseFields(const std::string& text, uint32_t& fields)
+	{
+		fields = 0;
+		size_t begin = 0;
+		while (begin <= text.size())
+		{
+			size_t end = text.find(',', begin);
+			if (end == std::string::npos)
+				end = text.size();
+			std::string name = text.substr(begin, end - begin);
+			if (name == "temperature")
+				fields |= FieldOutputTemperature;
+			else if (name == "vapor")
+				fields |= FieldOutputVapor;
+			else if (name == "cloud-water")
+				fields |= FieldOutputCloudWater;
+			else if (name == "velocity")
+				fields |= FieldOutputVelocity;
+			else if (name == "all")
+				fields |= FieldOutputAll;
+			else
+				return false;
+			begin = end + 1;
+		}
+		return fields != 0;
+	}
+
+	bool ParseBoundaryValue(const std::string& text, float& value)
+	{
+		return ParseFloat(text, value);
+	}
+
+	bool ParseBoundaryValue(const std::string& text, glm::vec2& value)
+	{
+		size_t comma = text.find(',');
+		return comma != std::string::npos &&
+			ParseFloat(text.substr(0, comma), value.x) && ParseFloat(text.substr(comma + 1), value.y);
+	}
+
+	bool ParseTransferMode(const std::string& text, ParticleTransferMode& mode)
+	{
+		static const std::pair<const char*, ParticleTransferMode> s_Modes[] = {
+			{ "passive", ParticleTransferMode::Passive }, { "pic", ParticleTransferMode::PIC },
+			{ "flip", ParticleTransferMode::FLIP }, { "apic", ParticleTransferMode::APIC }
+		};
+		for (const auto& entry : s_Modes)
+		{
+			if (text == entry.first)
+			{
+				mode = entry.second;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// shape,trigger,x0,y0,x1,y1,threshold,rate,lifetime, such as
+	// area,cloud-water,0,0,1,1,0.0001,2,5.
+	bool ParseEmitter(const std::string& text, ParticleEmitter& emitter)
+	{
+		static const std::pair<const char*, EmitterShape> s_Shapes[] = {
+			{ "point", EmitterShape::Point }, { "line", EmitterShape::Line }, { "area", EmitterShape::Area }
+		};
+		static const std::pair<const char*, EmitterTrigger> s_Triggers[] = {
+			{ "always", EmitterTrigger::Always }, { "cloud-water", EmitterTrigger::CloudWater }, { "vapor", EmitterTrigger::Vapor }
+		};
+		std::vector<std::string> values;
+		size_t begin = 0;
+		while (begin <= text.size())
+		{
+			size_t end = text.find(',', begin);
+			if (end == std::string::npos)
+				end = text.size();
+			values.push_back(text.substr(begin, end - begin));
+			begin = end + 1;
+		}
+		if (values.size() != 9)
+			return false;
+
+		bool shapeFound = false, triggerFound = false;
+		for (const auto& shape : s_Shapes)
+		{
+			if (values[0] == shape.first)
+			{
+				emitter.Shape = shape.second;
+				shapeFound = true;
+			}
+		}
+		for (const auto& trigger : s_Triggers)
+		{
+			if (values[1] == trigger.first)
+			{
+				emitter.Trigger = trigger.second;
+				triggerFound = true;
+			}
+		}
+		return shapeFound && triggerFound &&
+			ParseFloat(values[2], emitter.Start.x) && ParseFloat(values[3], emitter.Start.y) &&
+			ParseFloat(values[4], emitter.End.x) && ParseFloat(values[5], emitter.End.y) &&
+			ParseFloat(values[6], emitter.Threshold) &&
+			ParseFloat(values[7], emitter.Rate) && emitter.Rate >= 0.0f &&
+			ParseFloat(values[8], emitter.Lifetime) && emitter.Lifetime >= 0.0f;
+	}
+
+	// type[:value], such as periodic or dirichlet:250. Velocity values are x,y.
+	template<typename T>
+	bool ParseBoundarySide(const std::string& text, BoundarySide<T>& side)
+	{
+		static const std::pair<const char*, BoundaryType> s_Types[] = {
+			{ "dirichlet", BoundaryType::Dirichlet }, { "neumann", BoundaryType::Neumann },
+			{ "periodic", BoundaryType::Periodic }, { "no-slip", BoundaryType::NoSlip },
+			{ "free-slip", BoundaryType::FreeSlip }, { "inflow", BoundaryType::Inflow },
+			{ "outflow", BoundaryType::Outflow }
+		};
+		size_t colon = text.find(':');
+		std::string name = text.substr(0, colon);
+		for (const auto& type : s_Types)
+		{
+			if (name != type.first)
+				continue;
+			side.Type = type.second;
+			side.Value = T();
+			side.Profile = nullptr;
+			return colon == std::string::npos || ParseBoundaryValue(text.substr(colon + 1), side.Value);
+		}
+		return false;
+	}
+
+	// Side of "<field>-<side>", such as vapor-left.
+	template<typename T>
+	BoundarySide<T>* FindBoundarySide(const std::string& key, const std::string& field, FieldBoundaries<T>& boundaries)
+	{
+		if (key.compare(0, field.size() + 1, field + "-") != 0)
+			return nullptr;
+		const std::string side = key.substr(field.size() + 1);
+		if (side == "left")
+			return &boundaries.Left;
+		if (side == "right")
+			return &boundaries.Right;
+		if (side == "bottom")
+			return &boundaries.Bottom;
+		if (side == "top")
+			return &boundaries.Top;
+		return nullptr;
+	}
+
+	// Keys are boundary-<field>-<side> with the fields velocity, temperature, vapor and
+	// cloud-water.
+	bool SetBoundary(const std::string& key, const std::string& value, FieldBoundarySettings& boundaries)
+	{
+		if (BoundarySide<glm::vec2>* side = FindBoundarySide(key, "velocity", boundaries.Velocity))
+			return ParseBoundarySide(value, *side);
+		if (BoundarySide<float>* side = FindBoundarySide(key, "temperature", boundaries.Temperature))
+			return ParseBoundarySide(value, *side);
+		if (BoundarySide<float>* side = FindBoundarySide(key, "vapor", boundaries.Vapor))
+			return ParseBoundarySide(value, *side);
+		if (BoundarySide<float>* side = FindBoundarySide(key, "cloud-water", boundaries.CloudWater))
+			return ParseBoundarySide(value, *side);
+		return false;
+	}
+
+	bool SetValue(const std::string& key, const std::string& value, HeadlessConfig& config)
+	{
+		ParticleSystemProps& sim = config.Simulation;
+		bool valid = false;
+		if (key == "steps")
+			valid = ParseInt(value, config.Steps) && config.Steps >= 0;
+		else if (key == "dt")
+			valid = ParseFloat(value, config.TimeStep) && config.TimeStep > 0.0f;
+		else if (key == "width")
+			valid = ParseInt(value, sim.Width) && sim.Width >= 3;
+		else if (key == "height")
+			valid = ParseInt(value, sim.Height) && sim.Height >= 3;
+		else if (key == "cell-size")
+			valid = ParseFloat(value, sim.CellSize) && sim.CellSize > 0.0f;
+		else if (key == "particles")
+		{
+			uint32_t count;
+			valid = ParseUnsigned(value, count);
+			sim.ParticleCount = count;
+		}
+		else if (key == "particle-capacity")
+		{
+			uint32_t capacity;
+			valid = ParseUnsigned(value, capacity);
+			sim.ParticleCapacity = capacity;
+		}
+		else if (key == "gravity")
+			valid = ParseFloat(value, sim.Gravity);
+		else if (key == "vorticity")
+			valid = ParseFloat(value, sim.VorticityEpsilon);
+		else if (key == "buoyancy")
+			valid = ParseFloat(value, sim.BuoyancyEpsilon);
+		else if (key == "seed")
+			valid = ParseUnsigned(value, config.Seed);
+		else if (key == "threads")
+			valid = ParseUnsigned(value, config.ThreadCount);
+		else if (key == "sparse")
+		{
+			valid = value == "true" || value == "false";
+			config.ActiveTiles.Enabled = value == "true";
+		}
+		else if (key == "sparse-velocity")
+			valid = ParseFloat(value, config.ActiveTiles.VelocityThreshold) && config.ActiveTiles.VelocityThreshold >= 0.0f;
+		else if (key == "sparse-vorticity")
+			valid = ParseFloat(value, config.ActiveTiles.VorticityThreshold) && config.ActiveTiles.VorticityThreshold >= 0.0f;
+		else if (key == "sparse-cloud-water")
+			valid = ParseFloat(value, config.ActiveTiles.CloudWaterThreshold) && config.ActiveTiles.CloudWaterThreshold >= 0.0f;
+		else if (key == "sort-every")
+			valid = ParseUnsigned(value, config.ParticleSortInterval);
+		else if (key == "compact-every")
+			valid = ParseUnsigned(value, config.ParticleCompactInterval);
+		else if (key == "transfer")
+			valid = ParseTransferMode(value, config.ParticleTransfer);
+		else if (key == "flip-ratio")
+			valid = ParseFloat(value, config.FlipRatio) && config.FlipRatio >= 0.0f && config.FlipRatio <= 1.0f;
+		else if (key == "sph")
+		{
+			valid = value == "true" || value == "false";
+			config.Sph.Enabled = value == "true";
+		}
+		else if (key == "sph-radius")
+			valid = ParseFloat(value, config.Sph.Radius) && config.Sph.Radius > 0.0f;
+		else if (key == "sph-rest-density")
+			valid = ParseFloat(value, config.Sph.RestDensity) && config.Sph.RestDensity > 0.0f;
+		else if (key == "sph-stiffness")
+			valid = ParseFloat(value, config.Sph.Stiffness) && config.Sph.Stiffness >= 0.0f;
+		else if (key == "sph-viscosity")
+			valid = ParseFloat(value, config.Sph.Viscosity) && config.Sph.Viscosity >= 0.0f;
+		else if (key == "emitter")
+		{
+			ParticleEmitter emitter;
+			valid = ParseEmitter(value, emitter);
+			config.Emitters.push_back(emitter);
+		}
+		else if (key.compare(0, 9, "boundary-") == 0)
+			valid = SetBoundary(key.substr(9), value, config.Boundaries);
+		else if (key == "schedule")
+		{
+			config.SchedulePath = value;
+			valid = !value.empty();
+		}
+		else if (key == "trace")
+		{
+			config.TracePath = value;
+			valid = !value.empty();
+		}
+		else if (key == "resume")
+		{
+			config.ResumePath = value;
+			valid = !value.empty();
+		}
+		else if (key == "checkpoint")
+		{
+			config.CheckpointPath = value;
+			valid = !value.empty();
+		}
+		else if (key == "checkpoint-every")
+			valid = ParseInt(value, config.CheckpointInterval) && config.CheckpointInterval >= 0;
+		else if (key == "output")
+		{
+			config.Output.Path = value;
+			valid = !value.empty();
+		}
+		else if (key == "output-every")
+			valid = ParseInt(value, config.Output.Interval) && config.Output.Interval > 0;
+		else if (key == "output-fields")
+			valid = ParseFields(value, config.Output.Fields);
+		else if (key == "output-decimate")
+			valid = ParseInt(value, config.Output.Decimation) && config.Output.Decimation > 0;
+		else if (key == "output-queue")
+			valid = ParseInt(value, config.Output.QueueDepth) && config.Output.QueueDepth > 0;
+		else if (key == "output-drop")
+		{
+			valid = value == "true" || value == "false";
+			config.Output.DropWhenFull = value == "true";
+		}
+		else
+		{
+			LOG_ERROR("Unknown setting '{0}'", key);
+			return false;
+		}
+
+		if (!valid)
+			LOG_ERROR("Invalid value '{0}' for setting '{1}'", value, key);
+		return valid;
+	}
+
+	std::string Trim(const std::string& text)
+	{
+		size_t begin = text.find_first_not_of(" \t\r");
+		if (begin == std::string::npos)
+			return "";
+		size_t end = text.find_last_not_of(" \t\r");
+		return text.substr(begin, end - begin + 1);
+	}
+
+}
+
+bool LoadHeadlessConfigFile(const std::string& path, HeadlessConfig& config)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		LOG_ERROR("Could not open config file '{0}'", path);
+		return false;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		++lineNumber;
+		line = Trim(line.substr(0, line.find('#')));
+		if (line.empty())
+			continue;
+
+		size_t separator = line.find('=');
+		if (separator == std::string::npos)
+		{
+			LOG_ERROR("{0}:{1}: expected 'key = value'", path, lineNumber);
+			return false;
+		}
+		if (!SetValue(Trim(line.substr(0, separator)), Trim(line.substr(separator + 1)), config))
+			return false;
+	}
+	return true;
+}
+
+bool ParseHeadlessArgs(int argc, char** argv, HeadlessConfig& config)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--headless") == 0)
+			continue;
+
+		if (std::strncmp(argv[i], "--", 2) != 0 || i + 1 >= argc)
+		{
+			LOG_ERROR("Expected '--key value', got '{0}'", argv[i]);
+			return false;
+		}
+
+		std::string key = argv[i] + 2;
+		std::string value = argv[++i];
+		bool valid = key == "config" ? LoadHeadlessConfigFile(value, config) : SetValue(key, value, config);
+		if (!valid)
+			return false;
+	}
+	return true;
+}
+
+int RunHeadless(const HeadlessConfig& config)
+{
+	ParticleSystemProps sim = config.Simulation;
+	if (!config.ResumePath.empty() && !ParticleSystem::ReadCheckpointProps(config.ResumePath, sim))
+		return 1;
+	LOG_INFO("Headless run: {0} steps of {1}s on a {2}x{3} grid with {4} particles",
+		config.Steps, config.TimeStep, sim.Width, sim.Height, sim.ParticleCount);
+
+	Random::Init(config.Seed);
+	ParticleSystem particleSystem(sim);
+	particleSystem.SetThreadCount(config.ThreadCount);
+	particleSystem.activeTiles = config.ActiveTiles;
+	particleSystem.boundaries = config.Boundaries;
+	particleSystem.particleSortInterval = config.ParticleSortInterval;
+	particleSystem.GetParticleTransfer().Mode = config.ParticleTransfer;
+	particleSystem.GetParticleTransfer().FlipRatio = config.FlipRatio;
+	particleSystem.sph = config.Sph;
+	particleSystem.particleCompactInterval = config.ParticleCompactInterval;
+	particleSystem.emitters = config.Emitters;
+	if (!config.ResumePath.empty())
+	{
+		auto loadStart = std::chrono::steady_clock::now();
+		if (!particleSystem.LoadCheckpoint(config.ResumePath))
+			return 1;
+		LOG_INFO("Resumed from '{0}' in {1:.3f}s", config.ResumePath,
+			std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count());
+	}
+
+	FieldWriter fieldWriter;
+	if (!config.Output.Path.empty() && !fieldWriter.Open(config.Output, sim.Width, sim.Height, sim.CellSize))
+		return 1;
+
+	PROFILE_THREAD("Main");
+	if (!config.TracePath.empty())
+		Profiler::BeginTrace();
+
+	auto start = std::chrono::steady_clock::now();
+	for (int step = 0; step < config.Steps; ++step)
+	{
+		particleSystem.OnUpdate(config.TimeStep);
+		const uint32_t stepIndex = particleSystem.GetStepIndex();
+		if (fieldWriter.ShouldCapture(stepIndex))
+		{
+			fieldWriter.Submit(stepIndex, stepIndex * config.TimeStep, particleSystem.GetTemperatureField(),
+				particleSystem.GetVaporField(), particleSystem.GetCloudWaterField(), particleSystem.GetVelocityField());
+		}
+		const bool periodic = config.CheckpointInterval > 0 && (step + 1) % config.CheckpointInterval == 0 && step + 1 < config.Steps;
+		if (!config.CheckpointPath.empty() && periodic && !particleSystem.SaveCheckpoint(config.CheckpointPath))
+			return 1;
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	const double seconds = std::chrono::duration<double>(end - start).count();
+	const PressureSolveStats& pressure = particleSystem.GetPressureSolveStats();
+	LOG_INFO("Finished in {0:.3f}s on {1} threads: {2:.3f} ms/step, {3:.1f} steps/s",
+		seconds, particleSystem.GetThreadCount(),
+		config.Steps > 0 ? seconds * 1000.0 / config.Steps : 0.0,
+		seconds > 0.0 ? config.Steps / seconds : 0.0);
+	LOG_INFO("Last pressure solve: {0} iterations, residual {1}", pressure.Iterations, pressure.Residual);
+	if (config.ActiveTiles.Enabled)
+		LOG_INFO("Active tiles in the last step: {0:.1f}% of cells", particleSystem.GetActiveTileFraction() * 100.0f);
+	if (!config.Emitters.empty())
+		LOG_INFO("Particles at the end: {0} live in {1} slots of {2}", particleSystem.GetLiveParticleCount(),
+			particleSystem.GetParticles().GetCount(), particleSystem.GetParticlePool().GetCapacity());
+	for (const ProfileScopeSummary& summary : Profiler::GetSummaries())
+	{
+		LOG_INFO("  {0:<24} mean {1:8.3f} ms  p50 {2:8.3f} ms  p99 {3:8.3f} ms",
+			summary.Name, summary.MeanMs, summary.P50Ms, summary.P99Ms);
+	}
+
+	if (!config.TracePath.empty())
+	{
+		if (!Profiler::EndTrace(config.TracePath))
+		{
+			LOG_ERROR("Could not write trace to '{0}'", config.TracePath);
+			return 1;
+		}
+		LOG_INFO("Wrote trace to '{0}'", config.TracePath);
+	}
+
+	if (fieldWriter.IsOpen())
+	{
+		const bool closed = fieldWriter.Close();
+		const FieldOutputStats stats = fieldWriter.GetStats();
+		LOG_INFO("Wrote {0} of {1} field frames ({2:.1f} MB) to '{3}', {4} dropped, peak queue {5}, stalled {6:.3f}s",
+			stats.FramesWritten, stats.FramesSubmitted, stats.BytesWritten / (1024.0 * 1024.0), config.Output.Path,
+			stats.FramesDropped, stats.PeakQueueDepth, stats.StallSeconds);
+		if (!closed)
+			return 1;
+	}
+
+	if (!config.CheckpointPath.empty())
+	{
+		if (!particleSystem.SaveCheckpoint(config.CheckpointPath))
+			return 1;
+		LOG_INFO("Wrote checkpoint '{0}'", config.CheckpointPath);
+	}
+
+	if (!config.SchedulePath.empty())
+	{
+		std::ofstream file(config.SchedulePath);
+		if (!file)
+		{
+			LOG_ERROR("Could not write schedule to '{0}'", config.SchedulePath);
+			return 1;
+		}
+		file << particleSystem.GetStepGraph().DumpSchedule();
+		LOG_INFO("Wrote the schedule of the last step to '{0}'", config.SchedulePath);
+	}
+	return 0;
+}
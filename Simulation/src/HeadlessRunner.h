@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "FieldWriter.h"
+#include "ParticleSystem.h"
+
+struct HeadlessConfig
+{
+	ParticleSystemProps Simulation;
+	int Steps = 1000;
+	float TimeStep = 0.016f;
+	// Same default seed as Random, so this matches the windowed build.
+	uint32_t Seed = 5489;
+	// 0 uses every hardware thread.
+	uint32_t ThreadCount = 0;
+	ActiveTileSettings ActiveTiles;
+	FieldBoundarySettings Boundaries;
+	// Steps between sorts of the particles by cell, 0 never sorts them.
+	uint32_t ParticleSortInterval = 16;
+	// Steps between compactions of the dead particles' slots, 0 leaves them to the sorts.
+	uint32_t ParticleCompactInterval = 16;
+	ParticleTransferMode ParticleTransfer = ParticleTransferMode::Passive;
+	float FlipRatio = 0.95f;
+	SphSettings Sph;
+	std::vector<ParticleEmitter> Emitters;
+	// When set, the schedule of the last step and its critical path are written here.
+	std::string SchedulePath;
+	// When set, a Chrome trace of every step is written here.
+	std::string TracePath;
+	// When set, the run starts from this checkpoint instead of the initial atmosphere,
+	// and takes its grid, particle count, parameters and the settings it saves from it,
+	// over the ones given here.
+	std::string ResumePath;
+	// When set, a checkpoint is written here every CheckpointInterval steps, if that is
+	// not 0, and at the end of the run.
+	std::string CheckpointPath;
+	int CheckpointInterval = 0;
+	// Field snapshots are streamed to Output.Path, when it is set, every Output.Interval
+	// steps.
+	FieldOutputSettings Output;
+};
+
+// Fills config from "--key value" arguments. "--config <file>" reads "key = value"
+// lines from a file at that point, so arguments after it override the file. Keys are
+// steps, dt, width, height, cell-size, particles, particle-capacity, gravity, vorticity,
+// buoyancy, seed, threads, sparse, sparse-velocity, sparse-vorticity, sparse-cloud-water,
+// sort-every, compact-every, transfer (passive, pic, flip or apic), flip-ratio, sph,
+// sph-radius, sph-rest-density, sph-stiffness, sph-viscosity, emitter, schedule, trace, resume, checkpoint, checkpoint-every, output, output-every,
+// output-fields, output-decimate, output-queue and output-drop, plus
+// boundary-<field>-<side> for the fields velocity, temperature, vapor and cloud-water
+// and the sides left, right, bottom and top, set to a type such as periodic or
+// dirichlet:250. Every emitter key adds an emitter, given as
+// shape,trigger,x0,y0,x1,y1,threshold,rate,lifetime with the shape point, line or area
+// and the trigger always, cloud-water or vapor. Returns false and logs the reason on
+// an unknown key or a bad value.
+bool ParseHeadlessArgs(int argc, char** argv, HeadlessConfig& config);
+bool LoadHeadlessConfigFile(const std::string& path, HeadlessConfig& config);
+
+// Runs config.Steps fixed steps of the simulation as fast as possible, without a
+// window or GL context, and logs the timing. Returns the process exit code.
+int RunHeadless(const HeadlessConfig& config);
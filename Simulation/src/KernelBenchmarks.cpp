@@ -0,0 +1,227 @@
+#include "KernelBenchmarks.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "GLCore/Core/Log.h"
+#include "Benchmark.h"
+#include "ParticleKernels.h"
+#include "ParticleSystem.h"
+#include "Random.h"
+
+namespace {
+
+	struct BenchmarkOptions
+	{
+		std::string Filter;
+		double MinSeconds = 0.5;
+		uint32_t ThreadCount = 0;
+		std::string JsonPath;
+	};
+
+	const int s_GridSizes[] = { 64, 256, 1024 };
+	const size_t s_ParticleCounts[] = { 10000, 100000, 1000000 };
+	const int s_ParticleGridSize = 256;
+	const float s_CellSize = 0.01f;
+	const float s_DeltaTime = 0.016f;
+
+	bool ParseOptions(int argc, char** argv, BenchmarkOptions& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			if (std::strcmp(argv[i], "--benchmark") == 0)
+				continue;
+			if (i + 1 >= argc)
+			{
+				LOG_ERROR("Missing value for '{0}'", argv[i]);
+				return false;
+			}
+
+			const char* value = argv[++i];
+			if (std::strcmp(argv[i - 1], "--filter") == 0)
+				options.Filter = value;
+			else if (std::strcmp(argv[i - 1], "--min-time") == 0)
+				options.MinSeconds = std::atof(value);
+			else if (std::strcmp(argv[i - 1], "--threads") == 0)
+				options.ThreadCount = (uint32_t)std::strtoul(value, nullptr, 10);
+			else if (std::strcmp(argv[i - 1], "--json") == 0)
+				options.JsonPath = value;
+			else
+			{
+				LOG_ERROR("Unknown benchmark option '{0}'", argv[i - 1]);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Velocities that move a back-trace up to two cells in either direction, so the
+	// advection kernels read scattered neighbours as they would in a real run.
+	void FillVelocity(Grid2D<glm::vec2>& velocityField)
+	{
+		const float scale = 2.0f * velocityField.GetCellSize() / s_DeltaTime;
+		float* components = &velocityField.GetData()->x;
+		const int count = (int)velocityField.GetSize() * 2;
+		Random::Fill(components, count, 0, 0, 0);
+		for (int i = 0; i < count; ++i)
+			components[i] = (components[i] * 2.0f - 1.0f) * scale;
+	}
+
+	BenchmarkResult GridCase(const char* name, int size, double bytesPerCell)
+	{
+		BenchmarkResult result;
+		result.Name = name;
+		result.Width = size;
+		result.Height = size;
+		result.Items = (size_t)size * size;
+		result.BytesPerItem = bytesPerCell;
+		return result;
+	}
+
+	void RunGridBenchmarks(BenchmarkRunner& runner, const BenchmarkOptions& options, int size)
+	{
+		ParticleSystemProps props;
+		props.Width = size;
+		props.Height = size;
+		props.CellSize = s_CellSize;
+		props.ParticleCount = 0;
+		std::unique_ptr<ParticleSystem> system = std::make_unique<ParticleSystem>(props);
+		system->SetThreadCount(options.ThreadCount);
+
+		Grid2D<glm::vec2> velocity(size, size, s_CellSize), velocityOut(size, size, s_CellSize);
+		Grid2D<float> divergence(size, size, s_CellSize);
+		Grid2D<float> temperature(size, size, s_CellSize, 290.0f);
+		// Vapor stays below saturation and there is no cloud water, so the microphysics
+		// leaves every field unchanged and repeated calls see the same inputs.
+		Grid2D<float> vapor(size, size, s_CellSize, 0.001f), cloudWater(size, size, s_CellSize, 0.0f);
+		FillVelocity(velocity);
+
+		// Bytes per cell count each field the kernel loads or stores once, including the
+		// traced positions the advection kernels write and read back.
+		const AdvectionScheme schemes[] = { AdvectionScheme::Bilinear, AdvectionScheme::MacCormack };
+		const char* velocityNames[] = { "AdvectVelocityField/Bilinear", "AdvectVelocityField/MacCormack" };
+		const char* scalarNames[] = { "AdvectScalarFields/Bilinear", "AdvectScalarFields/MacCormack" };
+		const double velocityBytes[] = { 24.0, 64.0 };
+		const double scalarBytes[] = { 40.0, 100.0 };
+		for (int i = 0; i < 2; ++i)
+		{
+			system->advectionScheme = schemes[i];
+			if (runner.IsEnabled(velocityNames[i]))
+				runner.Run(GridCase(velocityNames[i], size, velocityBytes[i]), [&]() { system->AdvectVelocityField(velocity, velocityOut, s_DeltaTime); });
+			if (runner.IsEnabled(scalarNames[i]))
+				runner.Run(GridCase(scalarNames[i], size, scalarBytes[i]), [&]() { system->AdvectScalarFields(velocity, s_DeltaTime); });
+		}
+
+		// Writes to a second grid, so the shared velocity field is not pushed further every call.
+		if (runner.IsEnabled("ApplyVorticityAndBuoyancy"))
+			runner.Run(GridCase("ApplyVorticityAndBuoyancy", size, 28.0), [&]() { system->ApplyVorticityAndBuoyancy(velocity, velocityOut, s_DeltaTime); });
+		if (runner.IsEnabled("UpdateWaterVaporField"))
+			runner.Run(GridCase("UpdateWaterVaporField", size, 36.0), [&]() { system->UpdateWaterVaporField(temperature, vapor, cloudWater); });
+		if (runner.IsEnabled("ComputeDivergence"))
+			runner.Run(GridCase("ComputeDivergence", size, 12.0), [&]() { system->ComputeDivergence(velocity, divergence); });
+		if (runner.IsEnabled("RandomFill"))
+			runner.Run(GridCase("RandomFill", size, 4.0), [&]() { Random::Fill(divergence.GetData(), (int)divergence.GetSize(), 0, 1, 0); });
+		if (runner.IsEnabled("SetBoundaryConditions"))
+		{
+			// Only the edge cells are touched, so measure per edge cell.
+			BenchmarkResult result = GridCase("SetBoundaryConditions", size, 24.0);
+			result.Items = 2 * (size_t)(size + size);
+			runner.Run(result, [&]() { system->SetBoundaryConditions(); });
+		}
+	}
+
+	void RunParticleBenchmarks(BenchmarkRunner& runner, const BenchmarkOptions& options, size_t count)
+	{
+		if (!runner.IsEnabled("UpdateParticles") && !runner.IsEnabled("SortParticles") &&
+			!runner.IsEnabled("ParticleInteractions") && !runner.IsEnabled("ParticlesToGrid") &&
+			!runner.IsEnabled("GridToParticles") && !runner.IsEnabled("PackParticles"))
+			return;
+
+		ParticleSystemProps props;
+		props.Width = s_ParticleGridSize;
+		props.Height = s_ParticleGridSize;
+		props.CellSize = s_CellSize;
+		props.ParticleCount = count;
+		std::unique_ptr<ParticleSystem> system = std::make_unique<ParticleSystem>(props);
+		system->SetThreadCount(options.ThreadCount);
+
+		BenchmarkResult result;
+		result.Name = "UpdateParticles";
+		result.Width = s_ParticleGridSize;
+		result.Height = s_ParticleGridSize;
+		result.Particles = count;
+		result.Items = count;
+		// Position, velocity and force are loaded and stored, the age is advanced against
+		// the lifetime, and one velocity sample is gathered from the grid.
+		result.BytesPerItem = 68.0;
+		if (runner.IsEnabled("UpdateParticles"))
+			runner.Run(result, [&]() { system->UpdateParticles(s_DeltaTime); });
+
+		// The position is read for the key, and every attribute is gathered through the
+		// order and written back.
+		result.Name = "SortParticles";
+		result.BytesPerItem = 128.0;
+		if (runner.IsEnabled("SortParticles"))
+			runner.Run(result, [&]() { system->SortParticles(); });
+
+		// Every particle is binned and copied out in cell order, then reads its
+		// neighbours twice and adds its force. Neighbour reads mostly hit the cache.
+		result.Name = "ParticleInteractions";
+		result.BytesPerItem = 96.0;
+		if (runner.IsEnabled("ParticleInteractions"))
+			runner.Run(result, [&]() { system->ApplyParticleInteractions(); });
+
+		// FLIP from here on. The position is read to bin the particle, then again with
+		// the velocity and the three scalars to scatter them.
+		system->GetParticleTransfer().Mode = ParticleTransferMode::FLIP;
+		result.Name = "ParticlesToGrid";
+		result.BytesPerItem = 56.0;
+		if (runner.IsEnabled("ParticlesToGrid"))
+			runner.Run(result, [&]() { system->TransferParticlesToGrid(); });
+
+		// Position, velocity, force and scalars are loaded and stored with the age, and
+		// every grid value is gathered twice, now and as scattered.
+		result.Name = "GridToParticles";
+		result.BytesPerItem = 104.0;
+		if (runner.IsEnabled("GridToParticles"))
+			runner.Run(result, [&]() { system->UpdateParticles(s_DeltaTime); });
+
+		// The position is read and one packed word is written for the renderer.
+		result.Name = "PackParticles";
+		result.BytesPerItem = 12.0;
+		if (runner.IsEnabled("PackParticles"))
+		{
+			const ParticleStore& particles = system->GetParticles();
+			std::vector<uint32_t> packed(particles.GetCount());
+			runner.Run(result, [&]() { PackParticlePositions(particles, 0, particles.GetCount(), system->GetDomainSize(), packed.data()); });
+		}
+	}
+
+}
+
+int RunKernelBenchmarks(int argc, char** argv)
+{
+	BenchmarkOptions options;
+	if (!ParseOptions(argc, argv, options))
+		return 1;
+	const uint32_t threadCount = options.ThreadCount ? options.ThreadCount : std::max(1u, std::thread::hardware_concurrency());
+	options.ThreadCount = threadCount;
+
+	Random::Init(1);
+	BenchmarkRunner runner(options.MinSeconds, options.Filter);
+	runner.PrintHeader();
+	for (int size : s_GridSizes)
+		RunGridBenchmarks(runner, options, size);
+	for (size_t count : s_ParticleCounts)
+		RunParticleBenchmarks(runner, options, count);
+
+	if (!options.JsonPath.empty() && !runner.WriteJson(options.JsonPath, threadCount))
+	{
+		LOG_ERROR("Could not write '{0}'", options.JsonPath);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Times every ParticleSystem kernel over a matrix of grid sizes and particle counts.
+// Options: --filter <substring>, --min-time <seconds per case>, --threads <count> and
+// --json <path> to also write the results as JSON. Returns the process exit code.
+int RunKernelBenchmarks(int argc, char** argv);
@@ -0,0 +1,98 @@
+#include "MicrophysicsKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "FastMath.h"
+
+#if defined(__AVX2__)
+	#define MICROPHYSICS_KERNELS_AVX2
+	#include <immintrin.h>
+#endif
+
+namespace {
+
+	const float s_ReferencePressure = 100000.0f;
+	const float s_Kappa = 0.286f;
+	// Saturation mixing ratio in Pa and the Tetens coefficients for temperature in K.
+	const float s_SaturationScale = 380.16f;
+	const float s_SaturationA = 17.67f;
+	const float s_SaturationB = 273.15f;
+	const float s_SaturationC = 29.65f;
+	// Latent heat of vaporization over the specific heat of dry air.
+	const float s_LatentHeatOverCp = 2501000.0f / 1005.0f;
+
+	void UpdateScalar(float* potentialTemperature, float* vapor, float* cloudWater,
+		const float* pressure, const float* exner, const float* invExner, int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			const float temperature = potentialTemperature[i] * exner[i];
+			const float saturation = s_SaturationScale / pressure[i] *
+				FastMath::Exp(s_SaturationA * (temperature - s_SaturationB) / (temperature - s_SaturationC));
+			const float deltaVapor = std::min(saturation - vapor[i], cloudWater[i]);
+			vapor[i] = vapor[i] + deltaVapor;
+			cloudWater[i] = cloudWater[i] - deltaVapor;
+			potentialTemperature[i] = potentialTemperature[i] - s_LatentHeatOverCp * invExner[i] * deltaVapor;
+		}
+	}
+
+#if defined(MICROPHYSICS_KERNELS_AVX2)
+	int UpdateSimd(float* potentialTemperature, float* vapor, float* cloudWater,
+		const float* pressure, const float* exner, const float* invExner, int count)
+	{
+		const __m256 scale = _mm256_set1_ps(s_SaturationScale);
+		const __m256 a = _mm256_set1_ps(s_SaturationA);
+		const __m256 b = _mm256_set1_ps(s_SaturationB);
+		const __m256 c = _mm256_set1_ps(s_SaturationC);
+		const __m256 latent = _mm256_set1_ps(s_LatentHeatOverCp);
+
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 theta = _mm256_loadu_ps(potentialTemperature + i);
+			__m256 qv = _mm256_loadu_ps(vapor + i);
+			__m256 qc = _mm256_loadu_ps(cloudWater + i);
+
+			__m256 temperature = _mm256_mul_ps(theta, _mm256_loadu_ps(exner + i));
+			__m256 exponent = _mm256_div_ps(_mm256_mul_ps(a, _mm256_sub_ps(temperature, b)), _mm256_sub_ps(temperature, c));
+			__m256 saturation = _mm256_mul_ps(_mm256_div_ps(scale, _mm256_loadu_ps(pressure + i)), FastMath::Exp(exponent));
+			// Operands swapped so ties pick the same side as std::min.
+			__m256 deltaVapor = _mm256_min_ps(qc, _mm256_sub_ps(saturation, qv));
+
+			_mm256_storeu_ps(vapor + i, _mm256_add_ps(qv, deltaVapor));
+			_mm256_storeu_ps(cloudWater + i, _mm256_sub_ps(qc, deltaVapor));
+			_mm256_storeu_ps(potentialTemperature + i, _mm256_sub_ps(theta,
+				_mm256_mul_ps(_mm256_mul_ps(latent, _mm256_loadu_ps(invExner + i)), deltaVapor)));
+		}
+		return i;
+	}
+#else
+	int UpdateSimd(float*, float*, float*, const float*, const float*, const float*, int)
+	{
+		return 0;
+	}
+#endif
+
+}
+
+void ComputeExnerRow(const float* pressure, float* exner, float* invExner, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		exner[i] = std::pow(pressure[i] / s_ReferencePressure, s_Kappa);
+		invExner[i] = 1.0f / exner[i];
+	}
+}
+
+float SaturationMixingRatio(float temperature, float pressure)
+{
+	return s_SaturationScale / pressure * FastMath::Exp(s_SaturationA * (temperature - s_SaturationB) / (temperature - s_SaturationC));
+}
+
+void UpdateMicrophysicsRow(float* potentialTemperature, float* vapor, float* cloudWater,
+	const float* pressure, const float* exner, const float* invExner, int count)
+{
+	int begin = UpdateSimd(potentialTemperature, vapor, cloudWater, pressure, exner, invExner, count);
+	UpdateScalar(potentialTemperature, vapor, cloudWater, pressure, exner, invExner, begin, count);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+// Exner function (p / p0)^kappa and its reciprocal for count cells of pressure. They
+// only depend on pressure, so they are worked out once and reused every step.
+void ComputeExnerRow(const float* pressure, float* exner, float* invExner, int count);
+
+// Vapor mixing ratio at which air of this temperature, in K, and pressure, in Pa, is
+// saturated. It rises with temperature and falls with pressure.
+float SaturationMixingRatio(float temperature, float pressure);
+
+// Condenses or evaporates water for count cells in place. Vapor above saturation at
+// the cell's temperature turns into cloud water and cloud water below it evaporates
+// back, as far as there is cloud water to evaporate, and the potential temperature
+// is heated or cooled by the latent heat this releases or absorbs. Uses AVX2 when the
+// build enables it and a scalar loop for the remainder, both paths produce identical
+// results.
+void UpdateMicrophysicsRow(float* potentialTemperature, float* vapor, float* cloudWater,
+	const float* pressure, const float* exner, const float* invExner, int count);
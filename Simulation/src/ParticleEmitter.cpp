@@ -0,0 +1,145 @@
+#include "ParticleEmitter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "Random.h"
+
+namespace {
+
+	// Cells each block of the spawn counts covers.
+	const int s_EmitBlockCells = 1024;
+
+	glm::ivec2 ToCell(glm::vec2 position, int width, int height)
+	{
+		return { std::min(std::max((int)(position.x * width), 0), width - 1),
+			std::min(std::max((int)(position.y * height), 0), height - 1) };
+	}
+
+	// Cells under the emitter's shape. A line covers one cell per step along its
+	// longer axis, an area every cell between its corners.
+	uint32_t GetCellCount(const ParticleEmitter& emitter, int width, int height)
+	{
+		const glm::ivec2 start = ToCell(emitter.Start, width, height);
+		const glm::ivec2 end = ToCell(emitter.End, width, height);
+		switch (emitter.Shape)
+		{
+		case EmitterShape::Line:
+			return (uint32_t)std::max(std::abs(end.x - start.x), std::abs(end.y - start.y)) + 1;
+		case EmitterShape::Area:
+			return (uint32_t)(std::abs(end.x - start.x) + 1) * (uint32_t)(std::abs(end.y - start.y) + 1);
+		default:
+			return 1;
+		}
+	}
+
+	glm::ivec2 GetCell(const ParticleEmitter& emitter, uint32_t index, uint32_t cellCount, int width, int height)
+	{
+		const glm::ivec2 start = ToCell(emitter.Start, width, height);
+		const glm::ivec2 end = ToCell(emitter.End, width, height);
+		switch (emitter.Shape)
+		{
+		case EmitterShape::Line:
+		{
+			if (cellCount == 1)
+				return start;
+			const float t = (float)index / (float)(cellCount - 1);
+			return { start.x + (int)std::lround((end.x - start.x) * t), start.y + (int)std::lround((end.y - start.y) * t) };
+		}
+		case EmitterShape::Area:
+		{
+			const glm::ivec2 low = glm::min(start, end);
+			const uint32_t areaWidth = (uint32_t)(std::abs(end.x - start.x) + 1);
+			return { low.x + (int)(index % areaWidth), low.y + (int)(index / areaWidth) };
+		}
+		default:
+			return start;
+		}
+	}
+
+}
+
+size_t ParticleSpawner::Emit(const std::vector<ParticleEmitter>& emitters, ParticleStore& particles, ParticlePool& particlePool,
+	const Grid2D<glm::vec2>& velocityField, const Grid2D<float>& temperatureField,
+	const Grid2D<float>& vaporField, const Grid2D<float>& cloudWaterField,
+	const EmitParams& params, ThreadPool& pool)
+{
+	const int width = velocityField.GetWidth();
+	const int height = velocityField.GetHeight();
+	const float cellSize = velocityField.GetCellSize();
+	m_EmitterStarts.assign(emitters.size() + 1, 0);
+	for (size_t e = 0; e < emitters.size(); ++e)
+		m_EmitterStarts[e + 1] = m_EmitterStarts[e] + GetCellCount(emitters[e], width, height);
+	const int cellCount = (int)m_EmitterStarts.back();
+	const int blockCount = (cellCount + s_EmitBlockCells - 1) / s_EmitBlockCells;
+	m_BlockStarts.assign(blockCount + 1, 0);
+
+	// Calls fn(cell, spawns) for every cell of a block, in order. The counts only depend
+	// on the step and the cell, so both passes see the same ones.
+	auto forEachCell = [&](int block, auto&& fn) {
+		const uint32_t begin = (uint32_t)block * s_EmitBlockCells;
+		const uint32_t end = std::min(begin + s_EmitBlockCells, (uint32_t)cellCount);
+		size_t e = std::upper_bound(m_EmitterStarts.begin(), m_EmitterStarts.end(), begin) - m_EmitterStarts.begin() - 1;
+		for (uint32_t k = begin; k < end; ++k)
+		{
+			while (k >= m_EmitterStarts[e + 1])
+				++e;
+			const ParticleEmitter& emitter = emitters[e];
+			const glm::ivec2 cell = GetCell(emitter, k - m_EmitterStarts[e], m_EmitterStarts[e + 1] - m_EmitterStarts[e], width, height);
+			if (emitter.Trigger == EmitterTrigger::CloudWater && !(cloudWaterField[cell.y][cell.x] > emitter.Threshold))
+				continue;
+			if (emitter.Trigger == EmitterTrigger::Vapor && !(vaporField[cell.y][cell.x] > emitter.Threshold))
+				continue;
+			const uint32_t spawns = (uint32_t)(emitter.Rate * params.DeltaTime + Random::Float(params.FirstStream, params.StepIndex, k));
+			if (spawns > 0)
+				fn(emitter, cell, spawns);
+		}
+	};
+
+	pool.ParallelFor(0, blockCount, [&](int begin, int end) {
+		for (int block = begin; block < end; ++block)
+		{
+			uint32_t spawns = 0;
+			forEachCell(block, [&](const ParticleEmitter&, glm::ivec2, uint32_t cellSpawns) { spawns += cellSpawns; });
+			m_BlockStarts[block + 1] = spawns;
+		}
+	});
+	for (int block = 1; block <= blockCount; ++block)
+		m_BlockStarts[block] += m_BlockStarts[block - 1];
+	const size_t requested = m_BlockStarts[blockCount];
+	if (requested == 0)
+		return 0;
+
+	const size_t granted = particlePool.Allocate(particles, requested);
+	pool.ParallelFor(0, blockCount, [&](int begin, int end) {
+		for (int block = begin; block < end; ++block)
+		{
+			uint32_t spawn = m_BlockStarts[block];
+			forEachCell(block, [&](const ParticleEmitter& emitter, glm::ivec2 cell, uint32_t cellSpawns) {
+				const glm::vec2 velocity = velocityField[cell.y][cell.x];
+				for (uint32_t s = 0; s < cellSpawns && spawn < granted; ++s, ++spawn)
+				{
+					const uint32_t i = particlePool.GetAllocatedSlot(spawn);
+					particles.PositionX[i] = (cell.x + Random::Float(params.FirstStream + 1, params.StepIndex, spawn)) * cellSize;
+					particles.PositionY[i] = (cell.y + Random::Float(params.FirstStream + 2, params.StepIndex, spawn)) * cellSize;
+					particles.VelocityX[i] = velocity.x;
+					particles.VelocityY[i] = velocity.y;
+					particles.ForceX[i] = 0.0f;
+					particles.ForceY[i] = 0.0f;
+					particles.Density[i] = 0.0f;
+					particles.Temperature[i] = temperatureField[cell.y][cell.x];
+					particles.Qv[i] = vaporField[cell.y][cell.x];
+					particles.Qc[i] = cloudWaterField[cell.y][cell.x];
+					particles.AffineXX[i] = 0.0f;
+					particles.AffineXY[i] = 0.0f;
+					particles.AffineYX[i] = 0.0f;
+					particles.AffineYY[i] = 0.0f;
+					particles.Age[i] = 0.0f;
+					particles.Lifetime[i] = emitter.Lifetime;
+				}
+			});
+		}
+	});
+	return granted;
+}
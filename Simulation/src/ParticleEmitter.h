@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Grid2D.h"
+#include "ParticlePool.h"
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+
+enum class EmitterShape
+{
+	Point = 0,
+	Line,
+	Area
+};
+
+// Field a cell has to exceed the emitter's threshold in to emit particles.
+enum class EmitterTrigger
+{
+	Always = 0,
+	CloudWater,
+	Vapor
+};
+
+struct ParticleEmitter
+{
+	EmitterShape Shape = EmitterShape::Area;
+	EmitterTrigger Trigger = EmitterTrigger::CloudWater;
+	// The point, the ends of the line or opposite corners of the area, as fractions of
+	// the domain. A point only uses Start.
+	glm::vec2 Start = { 0.0f, 0.0f };
+	glm::vec2 End = { 1.0f, 1.0f };
+	float Threshold = 1e-4f;
+	// Particles per second each cell under the shape spawns while it is triggered.
+	float Rate = 2.0f;
+	// Seconds the particles live for, 0 keeps them for ever.
+	float Lifetime = 5.0f;
+};
+
+struct EmitParams
+{
+	float DeltaTime;
+	uint32_t StepIndex;
+	// Random streams for the spawn counts and the x and y positions, in that order.
+	uint32_t FirstStream;
+};
+
+// Spawns the particles of a set of emitters. Every cell under an emitter spawns its
+// share of the rate, rounded up or down at random, at random places in the cell and
+// with the grid's values there. The cells are counted in blocks on the pool, one
+// allocation from the ParticlePool covers the whole step and every block then fills
+// its own run of the slots, so the spawns land in the same slots on any thread count.
+class ParticleSpawner
+{
+public:
+	// Returns the number of particles spawned, fewer than the emitters asked for once
+	// the pool is full.
+	size_t Emit(const std::vector<ParticleEmitter>& emitters, ParticleStore& particles, ParticlePool& particlePool,
+		const Grid2D<glm::vec2>& velocityField, const Grid2D<float>& temperatureField,
+		const Grid2D<float>& vaporField, const Grid2D<float>& cloudWaterField,
+		const EmitParams& params, ThreadPool& pool);
+private:
+	// Index of each emitter's first cell, the cells of all of them are numbered in turn.
+	std::vector<uint32_t> m_EmitterStarts;
+	// Spawns in each block of cells, then where each block's spawns start.
+	std::vector<uint32_t> m_BlockStarts;
+};
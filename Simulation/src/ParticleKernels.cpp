@@ -0,0 +1,261 @@
+#include "ParticleKernels.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+	#define PARTICLE_KERNELS_AVX2
+	#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define PARTICLE_KERNELS_SSE2
+	#include <emmintrin.h>
+#endif
+
+namespace {
+
+	// Shared per-call constants, so each path below reads the same values.
+	struct StepConstants
+	{
+		const float* Velocity;
+		int Width;
+		float MaxX, MaxY;
+		float DeltaTime, Gravity, InvCellSize;
+		float DomainX, DomainY;
+	};
+
+	void IntegrateScalar(ParticleStore& p, size_t begin, size_t end, const StepConstants& c)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			float px = p.PositionX[i], py = p.PositionY[i];
+			float vx = p.VelocityX[i], vy = p.VelocityY[i];
+			float fx = p.ForceX[i], fy = p.ForceY[i];
+
+			// Approximate the position of the particle at the previous timestep and
+			// convert it to coordinates on the velocity field grid.
+			float prevX = (px - vx * c.DeltaTime) * c.InvCellSize;
+			float prevY = (py - vy * c.DeltaTime) * c.InvCellSize;
+			prevX = std::min(std::max(prevX, 0.0f), c.MaxX);
+			prevY = std::min(std::max(prevY, 0.0f), c.MaxY);
+			size_t cell = (size_t)(int)prevY * c.Width + (size_t)(int)prevX;
+			float sampledX = c.Velocity[2 * cell];
+			float sampledY = c.Velocity[2 * cell + 1];
+
+			fy += c.Gravity;
+
+			// Handles collisions with the 4 walls. If a particle hits a wall it is put
+			// back on the wall and bounces off with 0.3 of its velocity in that direction.
+			if (px < 0.0f || px > c.DomainX)
+				vx *= -0.3f;
+			if (py < 0.0f || py > c.DomainY)
+				vy *= -0.3f;
+			px = std::min(std::max(px, 0.0f), c.DomainX);
+			py = std::min(std::max(py, 0.0f), c.DomainY);
+
+			vx += fx * c.DeltaTime + sampledX;
+			vy += fy * c.DeltaTime + sampledY;
+			px += vx * c.DeltaTime;
+			py += vy * c.DeltaTime;
+
+			p.PositionX[i] = px; p.PositionY[i] = py;
+			p.VelocityX[i] = vx; p.VelocityY[i] = vy;
+			p.ForceX[i] = 0.0f; p.ForceY[i] = 0.0f;
+		}
+	}
+
+#if defined(PARTICLE_KERNELS_AVX2)
+	size_t IntegrateSimd(ParticleStore& p, size_t begin, size_t end, const StepConstants& c)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 bounce = _mm256_set1_ps(-0.3f);
+		const __m256 dt = _mm256_set1_ps(c.DeltaTime);
+		const __m256 gravity = _mm256_set1_ps(c.Gravity);
+		const __m256 invCellSize = _mm256_set1_ps(c.InvCellSize);
+		const __m256 maxX = _mm256_set1_ps(c.MaxX), maxY = _mm256_set1_ps(c.MaxY);
+		const __m256 domainX = _mm256_set1_ps(c.DomainX), domainY = _mm256_set1_ps(c.DomainY);
+		const __m256i width = _mm256_set1_epi32(c.Width);
+
+		size_t i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			__m256 px = _mm256_loadu_ps(&p.PositionX[i]), py = _mm256_loadu_ps(&p.PositionY[i]);
+			__m256 vx = _mm256_loadu_ps(&p.VelocityX[i]), vy = _mm256_loadu_ps(&p.VelocityY[i]);
+			__m256 fx = _mm256_loadu_ps(&p.ForceX[i]), fy = _mm256_loadu_ps(&p.ForceY[i]);
+
+			__m256 prevX = _mm256_mul_ps(_mm256_sub_ps(px, _mm256_mul_ps(vx, dt)), invCellSize);
+			__m256 prevY = _mm256_mul_ps(_mm256_sub_ps(py, _mm256_mul_ps(vy, dt)), invCellSize);
+			prevX = _mm256_min_ps(_mm256_max_ps(prevX, zero), maxX);
+			prevY = _mm256_min_ps(_mm256_max_ps(prevY, zero), maxY);
+			__m256i cell = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(prevY), width), _mm256_cvttps_epi32(prevX));
+			__m256i component = _mm256_slli_epi32(cell, 1);
+			__m256 sampledX = _mm256_i32gather_ps(c.Velocity, component, 4);
+			__m256 sampledY = _mm256_i32gather_ps(c.Velocity + 1, component, 4);
+
+			fy = _mm256_add_ps(fy, gravity);
+
+			__m256 outX = _mm256_or_ps(_mm256_cmp_ps(px, zero, _CMP_LT_OQ), _mm256_cmp_ps(px, domainX, _CMP_GT_OQ));
+			__m256 outY = _mm256_or_ps(_mm256_cmp_ps(py, zero, _CMP_LT_OQ), _mm256_cmp_ps(py, domainY, _CMP_GT_OQ));
+			vx = _mm256_blendv_ps(vx, _mm256_mul_ps(vx, bounce), outX);
+			vy = _mm256_blendv_ps(vy, _mm256_mul_ps(vy, bounce), outY);
+			px = _mm256_min_ps(_mm256_max_ps(px, zero), domainX);
+			py = _mm256_min_ps(_mm256_max_ps(py, zero), domainY);
+
+			vx = _mm256_add_ps(vx, _mm256_add_ps(_mm256_mul_ps(fx, dt), sampledX));
+			vy = _mm256_add_ps(vy, _mm256_add_ps(_mm256_mul_ps(fy, dt), sampledY));
+			px = _mm256_add_ps(px, _mm256_mul_ps(vx, dt));
+			py = _mm256_add_ps(py, _mm256_mul_ps(vy, dt));
+
+			_mm256_storeu_ps(&p.PositionX[i], px); _mm256_storeu_ps(&p.PositionY[i], py);
+			_mm256_storeu_ps(&p.VelocityX[i], vx); _mm256_storeu_ps(&p.VelocityY[i], vy);
+			_mm256_storeu_ps(&p.ForceX[i], zero); _mm256_storeu_ps(&p.ForceY[i], zero);
+		}
+		return i;
+	}
+#elif defined(PARTICLE_KERNELS_SSE2)
+	size_t IntegrateSimd(ParticleStore& p, size_t begin, size_t end, const StepConstants& c)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 bounce = _mm_set1_ps(-0.3f);
+		const __m128 dt = _mm_set1_ps(c.DeltaTime);
+		const __m128 gravity = _mm_set1_ps(c.Gravity);
+		const __m128 invCellSize = _mm_set1_ps(c.InvCellSize);
+		const __m128 maxX = _mm_set1_ps(c.MaxX), maxY = _mm_set1_ps(c.MaxY);
+		const __m128 domainX = _mm_set1_ps(c.DomainX), domainY = _mm_set1_ps(c.DomainY);
+
+		alignas(16) int cellX[4], cellY[4];
+		alignas(16) float sampled[2][4];
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 px = _mm_loadu_ps(&p.PositionX[i]), py = _mm_loadu_ps(&p.PositionY[i]);
+			__m128 vx = _mm_loadu_ps(&p.VelocityX[i]), vy = _mm_loadu_ps(&p.VelocityY[i]);
+			__m128 fx = _mm_loadu_ps(&p.ForceX[i]), fy = _mm_loadu_ps(&p.ForceY[i]);
+
+			__m128 prevX = _mm_mul_ps(_mm_sub_ps(px, _mm_mul_ps(vx, dt)), invCellSize);
+			__m128 prevY = _mm_mul_ps(_mm_sub_ps(py, _mm_mul_ps(vy, dt)), invCellSize);
+			prevX = _mm_min_ps(_mm_max_ps(prevX, zero), maxX);
+			prevY = _mm_min_ps(_mm_max_ps(prevY, zero), maxY);
+			_mm_store_si128((__m128i*)cellX, _mm_cvttps_epi32(prevX));
+			_mm_store_si128((__m128i*)cellY, _mm_cvttps_epi32(prevY));
+			// SSE2 has no gather, so the four grid reads are done lane by lane.
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				size_t cell = (size_t)cellY[lane] * c.Width + (size_t)cellX[lane];
+				sampled[0][lane] = c.Velocity[2 * cell];
+				sampled[1][lane] = c.Velocity[2 * cell + 1];
+			}
+			__m128 sampledX = _mm_load_ps(sampled[0]);
+			__m128 sampledY = _mm_load_ps(sampled[1]);
+
+			fy = _mm_add_ps(fy, gravity);
+
+			__m128 outX = _mm_or_ps(_mm_cmplt_ps(px, zero), _mm_cmpgt_ps(px, domainX));
+			__m128 outY = _mm_or_ps(_mm_cmplt_ps(py, zero), _mm_cmpgt_ps(py, domainY));
+			vx = _mm_or_ps(_mm_andnot_ps(outX, vx), _mm_and_ps(outX, _mm_mul_ps(vx, bounce)));
+			vy = _mm_or_ps(_mm_andnot_ps(outY, vy), _mm_and_ps(outY, _mm_mul_ps(vy, bounce)));
+			px = _mm_min_ps(_mm_max_ps(px, zero), domainX);
+			py = _mm_min_ps(_mm_max_ps(py, zero), domainY);
+
+			vx = _mm_add_ps(vx, _mm_add_ps(_mm_mul_ps(fx, dt), sampledX));
+			vy = _mm_add_ps(vy, _mm_add_ps(_mm_mul_ps(fy, dt), sampledY));
+			px = _mm_add_ps(px, _mm_mul_ps(vx, dt));
+			py = _mm_add_ps(py, _mm_mul_ps(vy, dt));
+
+			_mm_storeu_ps(&p.PositionX[i], px); _mm_storeu_ps(&p.PositionY[i], py);
+			_mm_storeu_ps(&p.VelocityX[i], vx); _mm_storeu_ps(&p.VelocityY[i], vy);
+			_mm_storeu_ps(&p.ForceX[i], zero); _mm_storeu_ps(&p.ForceY[i], zero);
+		}
+		return i;
+	}
+#else
+	size_t IntegrateSimd(ParticleStore&, size_t begin, size_t, const StepConstants&)
+	{
+		return begin;
+	}
+#endif
+
+	// Both quantized coordinates of a particle, x in the low half. NaN lands on 0 like
+	// it does in the SIMD paths.
+	uint32_t PackPosition(float x, float y, float scaleX, float scaleY)
+	{
+		const uint32_t qx = (uint32_t)(std::min(std::max(0.0f, x * scaleX), 1.0f) * 65535.0f + 0.5f);
+		const uint32_t qy = (uint32_t)(std::min(std::max(0.0f, y * scaleY), 1.0f) * 65535.0f + 0.5f);
+		return qx | (qy << 16);
+	}
+
+#if defined(PARTICLE_KERNELS_AVX2)
+	size_t PackSimd(const ParticleStore& p, size_t begin, size_t end, float scaleX, float scaleY, uint32_t* out)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 range = _mm256_set1_ps(65535.0f);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 sx = _mm256_set1_ps(scaleX), sy = _mm256_set1_ps(scaleY);
+
+		size_t i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			__m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&p.PositionX[i]), sx), zero), one);
+			__m256 y = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&p.PositionY[i]), sy), zero), one);
+			__m256i qx = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(x, range), half));
+			__m256i qy = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(y, range), half));
+			_mm256_storeu_si256((__m256i*)(out + i), _mm256_or_si256(qx, _mm256_slli_epi32(qy, 16)));
+		}
+		return i;
+	}
+#elif defined(PARTICLE_KERNELS_SSE2)
+	size_t PackSimd(const ParticleStore& p, size_t begin, size_t end, float scaleX, float scaleY, uint32_t* out)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 range = _mm_set1_ps(65535.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 sx = _mm_set1_ps(scaleX), sy = _mm_set1_ps(scaleY);
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 x = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&p.PositionX[i]), sx), zero), one);
+			__m128 y = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&p.PositionY[i]), sy), zero), one);
+			__m128i qx = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(x, range), half));
+			__m128i qy = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(y, range), half));
+			_mm_storeu_si128((__m128i*)(out + i), _mm_or_si128(qx, _mm_slli_epi32(qy, 16)));
+		}
+		return i;
+	}
+#else
+	size_t PackSimd(const ParticleStore&, size_t begin, size_t, float, float, uint32_t*)
+	{
+		return begin;
+	}
+#endif
+
+}
+
+void IntegrateParticles(ParticleStore& particles, size_t begin, size_t end,
+	const Grid2D<glm::vec2>& velocityField, const ParticleStepParams& params)
+{
+	StepConstants c;
+	c.Velocity = &velocityField.GetData()->x;
+	c.Width = velocityField.GetWidth();
+	c.MaxX = (float)(velocityField.GetWidth() - 1);
+	c.MaxY = (float)(velocityField.GetHeight() - 1);
+	c.DeltaTime = params.DeltaTime;
+	c.Gravity = params.Gravity;
+	c.InvCellSize = params.InvCellSize;
+	c.DomainX = params.DomainSize.x;
+	c.DomainY = params.DomainSize.y;
+
+	size_t i = IntegrateSimd(particles, begin, end, c);
+	IntegrateScalar(particles, i, end, c);
+}
+
+void PackParticlePositions(const ParticleStore& particles, size_t begin, size_t end,
+	glm::vec2 domainSize, uint32_t* out)
+{
+	const float scaleX = 1.0f / domainSize.x;
+	const float scaleY = 1.0f / domainSize.y;
+	size_t i = PackSimd(particles, begin, end, scaleX, scaleY, out);
+	for (; i < end; ++i)
+		out[i] = PackPosition(particles.PositionX[i], particles.PositionY[i], scaleX, scaleY);
+}
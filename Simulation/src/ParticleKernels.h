@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "Grid2D.h"
+#include "ParticleStore.h"
+
+struct ParticleStepParams
+{
+	float DeltaTime;
+	float Gravity;
+	float InvCellSize;
+	glm::vec2 DomainSize;
+};
+
+// Advances particles [begin, end) by one step: samples the grid velocity at the
+// back-traced position, applies gravity, bounces particles off the walls and
+// integrates them. Uses AVX2 or SSE2 when the build enables them and a
+// scalar loop for the remainder, all three paths produce identical results.
+void IntegrateParticles(ParticleStore& particles, size_t begin, size_t end,
+	const Grid2D<glm::vec2>& velocityField, const ParticleStepParams& params);
+
+// Quantizes the positions of particles [begin, end) to 16 bits per axis over the domain
+// and writes them to out[begin, end), x in the low half, for the renderer to stream.
+// Positions outside the domain are clamped onto it. The same SIMD paths as above, all
+// giving identical results.
+void PackParticlePositions(const ParticleStore& particles, size_t begin, size_t end,
+	glm::vec2 domainSize, uint32_t* out);
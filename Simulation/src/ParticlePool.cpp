@@ -0,0 +1,156 @@
+#include "ParticlePool.h"
+
+#include <algorithm>
+#include <functional>
+
+#if defined(__AVX2__)
+	#define PARTICLE_POOL_AVX2
+	#include <immintrin.h>
+#endif
+
+namespace {
+
+	// Particles each block of the compaction counts and moves.
+	const int s_CompactBlockParticles = 4096;
+
+}
+
+void ParticlePool::Reset(ParticleStore& particles, size_t capacity)
+{
+	m_Capacity = std::max(capacity, particles.GetCount());
+	particles.Reserve(m_Capacity);
+	m_Scratch.reserve(m_Capacity);
+	m_FreeSlots.resize(m_Capacity);
+	m_MergedSlots.resize(m_Capacity);
+	uint32_t freeCount = 0;
+	for (size_t i = particles.GetCount(); i-- > 0;)
+	{
+		if (!particles.IsAlive(i))
+			m_FreeSlots[freeCount++] = (uint32_t)i;
+	}
+	m_FreeCount.store(freeCount, std::memory_order_relaxed);
+	m_SortedFreeCount = freeCount;
+	m_AllocatedTop = m_AllocatedEnd = m_AllocatedFree = 0;
+}
+
+void ParticlePool::Expire(ParticleStore& particles, size_t begin, size_t end, float deltaTime)
+{
+	float* ages = particles.Age.data();
+	float* lifetimes = particles.Lifetime.data();
+	auto release = [&](size_t i) {
+		lifetimes[i] = ParticleStore::FreeLifetime;
+		m_FreeSlots[m_FreeCount.fetch_add(1, std::memory_order_relaxed)] = (uint32_t)i;
+	};
+	size_t i = begin;
+#if defined(PARTICLE_POOL_AVX2)
+	// Eight particles at a time, deaths are rare enough to be picked out of the mask.
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 step = _mm256_set1_ps(deltaTime);
+	for (; i + 8 <= end; i += 8)
+	{
+		const __m256 lifetime = _mm256_loadu_ps(lifetimes + i);
+		const __m256 live = _mm256_cmp_ps(lifetime, zero, _CMP_GE_OQ);
+		const __m256 age = _mm256_add_ps(_mm256_loadu_ps(ages + i), _mm256_and_ps(live, step));
+		_mm256_storeu_ps(ages + i, age);
+		const __m256 expired = _mm256_and_ps(_mm256_cmp_ps(lifetime, zero, _CMP_GT_OQ), _mm256_cmp_ps(age, lifetime, _CMP_GE_OQ));
+		const int mask = _mm256_movemask_ps(expired);
+		for (int lane = 0; mask != 0 && lane < 8; ++lane)
+		{
+			if (mask & (1 << lane))
+				release(i + lane);
+		}
+	}
+#endif
+	for (; i < end; ++i)
+	{
+		const float lifetime = lifetimes[i];
+		if (lifetime < 0.0f)
+			continue;
+		ages[i] += deltaTime;
+		if (lifetime > 0.0f && ages[i] >= lifetime)
+			release(i);
+	}
+}
+
+size_t ParticlePool::Allocate(ParticleStore& particles, size_t count)
+{
+	// The slots were pushed in whatever order the threads freed them in. Sorting them
+	// hands out the same slots on any thread count. std::inplace_merge would allocate a
+	// buffer for the merge, so it goes through m_MergedSlots instead.
+	const uint32_t freeCount = m_FreeCount.load(std::memory_order_relaxed);
+	if (freeCount > m_SortedFreeCount)
+	{
+		auto sorted = m_FreeSlots.begin() + m_SortedFreeCount;
+		auto pushed = m_FreeSlots.begin() + freeCount;
+		std::sort(sorted, pushed, std::greater<uint32_t>());
+		if (m_SortedFreeCount > 0)
+		{
+			std::merge(m_FreeSlots.begin(), sorted, sorted, pushed, m_MergedSlots.begin(), std::greater<uint32_t>());
+			std::copy(m_MergedSlots.begin(), m_MergedSlots.begin() + freeCount, m_FreeSlots.begin());
+		}
+	}
+
+	const size_t end = particles.GetCount();
+	const size_t granted = std::min(count, freeCount + (m_Capacity - end));
+	m_AllocatedTop = freeCount;
+	m_AllocatedEnd = end;
+	m_AllocatedFree = std::min(granted, (size_t)freeCount);
+	m_FreeCount.store(freeCount - (uint32_t)m_AllocatedFree, std::memory_order_relaxed);
+	m_SortedFreeCount = freeCount - (uint32_t)m_AllocatedFree;
+	particles.Resize(end + granted - m_AllocatedFree);
+	return granted;
+}
+
+void ParticlePool::Compact(ParticleStore& particles, std::vector<uint32_t>& order, ThreadPool& pool)
+{
+	const int count = (int)particles.GetCount();
+	const int blockCount = (count + s_CompactBlockParticles - 1) / s_CompactBlockParticles;
+	m_BlockStarts.assign(blockCount + 1, 0);
+	pool.ParallelFor(0, blockCount, [&](int begin, int end) {
+		for (int block = begin; block < end; ++block)
+		{
+			const int particleEnd = std::min((block + 1) * s_CompactBlockParticles, count);
+			uint32_t live = 0;
+			for (int i = block * s_CompactBlockParticles; i < particleEnd; ++i)
+				live += particles.IsAlive(i) ? 1 : 0;
+			m_BlockStarts[block + 1] = live;
+		}
+	});
+	for (int block = 1; block <= blockCount; ++block)
+		m_BlockStarts[block] += m_BlockStarts[block - 1];
+	const int liveCount = (int)m_BlockStarts[blockCount];
+
+	order.resize(liveCount);
+	pool.ParallelFor(0, blockCount, [&](int begin, int end) {
+		for (int block = begin; block < end; ++block)
+		{
+			const int particleEnd = std::min((block + 1) * s_CompactBlockParticles, count);
+			uint32_t next = m_BlockStarts[block];
+			for (int i = block * s_CompactBlockParticles; i < particleEnd; ++i)
+			{
+				if (particles.IsAlive(i))
+					order[next++] = (uint32_t)i;
+			}
+		}
+	});
+
+	for (AlignedVector<float>* attribute : particles.GetAttributes())
+	{
+		m_Scratch.resize(liveCount);
+		const float* source = attribute->data();
+		float* destination = m_Scratch.data();
+		pool.ParallelFor(0, liveCount, [&](int begin, int end) {
+			for (int i = begin; i < end; ++i)
+				destination[i] = source[order[i]];
+		});
+		attribute->swap(m_Scratch);
+	}
+	particles.Resize(liveCount);
+	Clear();
+}
+
+void ParticlePool::Clear()
+{
+	m_FreeCount.store(0, std::memory_order_relaxed);
+	m_SortedFreeCount = 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+
+// Keeps track of the slots of a ParticleStore as particles are spawned and die. The
+// store grows up to a fixed capacity and no further. A particle that dies leaves its
+// slot marked free and pushes it onto a free list, and spawning takes slots from the
+// free list before it grows the store. The free slots stay in the store until Compact
+// moves the live particles in front of them, every pass that bins the particles skips
+// them until then.
+//
+// Slots are only freed by Expire and only handed out by Allocate, which must not run at
+// the same time. Both are safe to use from every worker, Expire pushes with one atomic
+// add and the slots of an allocation are looked up without any synchronization.
+class ParticlePool
+{
+public:
+	// Lets particles grow to capacity particles and rebuilds the free list from the
+	// slots that are marked free.
+	void Reset(ParticleStore& particles, size_t capacity);
+
+	size_t GetCapacity() const { return m_Capacity; }
+	size_t GetFreeCount() const { return m_FreeCount.load(std::memory_order_relaxed); }
+
+	// Ages particles [begin, end) by deltaTime and frees the ones that outlived their
+	// lifetime.
+	void Expire(ParticleStore& particles, size_t begin, size_t end, float deltaTime);
+
+	// Hands out up to count slots, as many as the capacity allows, and returns how many.
+	// The lowest free slots go first, then new slots at the end of the store. The
+	// caller fills every one of them in before the particles are used again.
+	size_t Allocate(ParticleStore& particles, size_t count);
+	// Slot of the index-th particle of the last allocation.
+	uint32_t GetAllocatedSlot(size_t index) const
+	{
+		return index < m_AllocatedFree ? m_FreeSlots[m_AllocatedTop - 1 - index] : (uint32_t)(m_AllocatedEnd + index - m_AllocatedFree);
+	}
+
+	// Moves the live particles in front of the free slots, keeping their order, and
+	// shrinks the store to them. order[i] is the index particle i had before.
+	void Compact(ParticleStore& particles, std::vector<uint32_t>& order, ThreadPool& pool);
+	// Forgets the free slots, for when something else has dropped them from the store.
+	void Clear();
+private:
+	size_t m_Capacity = 0;
+	// Free slots, a stack whose top is the lowest slot once Allocate has sorted it.
+	std::vector<uint32_t> m_FreeSlots;
+	// Where Allocate merges newly freed slots into the sorted ones.
+	std::vector<uint32_t> m_MergedSlots;
+	std::atomic<uint32_t> m_FreeCount{ 0 };
+	// The free slots below this are sorted, the ones above were pushed since.
+	uint32_t m_SortedFreeCount = 0;
+	// Top of the free list and end of the store before the last allocation, and the
+	// number of free slots it took.
+	size_t m_AllocatedTop = 0, m_AllocatedEnd = 0, m_AllocatedFree = 0;
+	// Live particles in each block, then where each block's particles go.
+	std::vector<uint32_t> m_BlockStarts;
+	AlignedVector<float> m_Scratch;
+};
@@ -0,0 +1,138 @@
+#include "ParticleRenderer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Profiler.h"
+
+// Particles fade from the low colour at the bottom of the domain to the high one at the top.
+static const glm::vec4 s_LowParticleColour = { 13 / 255.0f, 38 / 255.0f, 212 / 255.0f, 1.0f };
+static const glm::vec4 s_HighParticleColour = { 0.9f, 0.9f, 0.9f, 1.0f };
+static const glm::vec4 s_BarColour = { 0.3f, 0.3f, 0.3f, 1.0f };
+
+void ParticleRenderer::OnRender(const ParticleSnapshot& snapshot, float interpolation, GLCore::Utils::OrthographicCamera& camera)
+{
+	PROFILE_SCOPE("Render");
+	if (!m_QuadVA)
+	{
+		float vertices[] = {
+			 -0.1f, -0.1f, 0.0f,
+			  0.1f, -0.1f, 0.0f,
+			  0.1f,  0.1f, 0.0f,
+			 -0.1f,  0.1f, 0.0f
+		};
+
+		uint32_t indices[] = {
+			0, 1, 2, 2, 3, 0
+		};
+
+		GLuint quadVB, quadIB;
+		glCreateBuffers(1, &quadVB);
+		glNamedBufferData(quadVB, sizeof(vertices), vertices, GL_STATIC_DRAW);
+		glCreateBuffers(1, &quadIB);
+		glNamedBufferData(quadIB, sizeof(indices), indices, GL_STATIC_DRAW);
+
+		// The bar only uses the quad itself. Its positions come from the generic
+		// attribute value set before it is drawn.
+		glCreateVertexArrays(1, &m_BarVA);
+		glBindVertexArray(m_BarVA);
+		glBindBuffer(GL_ARRAY_BUFFER, quadVB);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIB);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0);
+
+		// Particles share the quad and read both of their packed positions per instance,
+		// as four normalized shorts. The instance buffer is bound to binding 1 when a
+		// section of it is drawn.
+		glCreateVertexArrays(1, &m_QuadVA);
+		glBindVertexArray(m_QuadVA);
+		glBindBuffer(GL_ARRAY_BUFFER, quadVB);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIB);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0);
+		glBindVertexArray(0);
+
+		glEnableVertexArrayAttrib(m_QuadVA, 1);
+		glVertexArrayAttribFormat(m_QuadVA, 1, 4, GL_UNSIGNED_SHORT, GL_TRUE, 0);
+		glVertexArrayAttribBinding(m_QuadVA, 1, 1);
+		glVertexArrayBindingDivisor(m_QuadVA, 1, 1);
+
+		m_ParticleShader = std::unique_ptr<GLCore::Utils::Shader>(GLCore::Utils::Shader::FromGLSLTextFiles("assets/shader.glsl.vert", "assets/shader.glsl.frag"));
+		const GLuint program = m_ParticleShader->GetRendererID();
+		m_ParticleShaderViewProj = glGetUniformLocation(program, "u_ViewProj");
+		m_ParticleShaderScale = glGetUniformLocation(program, "u_Scale");
+		m_ParticleShaderDomainSize = glGetUniformLocation(program, "u_DomainSize");
+		m_ParticleShaderInterpolation = glGetUniformLocation(program, "u_Interpolation");
+		m_ParticleShaderLowColor = glGetUniformLocation(program, "u_LowColor");
+		m_ParticleShaderHighColor = glGetUniformLocation(program, "u_HighColor");
+	}
+
+	glUseProgram(m_ParticleShader->GetRendererID());
+	glUniformMatrix4fv(m_ParticleShaderViewProj, 1, GL_FALSE, glm::value_ptr(camera.GetViewProjectionMatrix()));
+
+	// Draw the horizontal bar at y = 0, wide and flat and in one colour.
+	auto width = GLCore::Application::Get().GetWindow().GetWidth();
+	glUniform2f(m_ParticleShaderScale, (float)width, 0.1f);
+	glUniform4fv(m_ParticleShaderLowColor, 1, glm::value_ptr(s_BarColour));
+	glUniform4fv(m_ParticleShaderHighColor, 1, glm::value_ptr(s_BarColour));
+	glVertexAttrib4f(1, 0.0f, 0.0f, 0.0f, 0.0f);
+	glBindVertexArray(m_BarVA);
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+
+	const size_t count = snapshot.Particles.size();
+	if (count == 0)
+		return;
+	ReserveInstances(count);
+
+	// Wait for the GPU to finish with the section before it is written over. With three
+	// sections that is the draw from two frames ago, which is normally long done.
+	GLsync& fence = m_SectionFences[m_Section];
+	if (fence)
+	{
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+			;
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	const size_t first = (size_t)m_Section * m_InstanceCapacity;
+	std::memcpy(m_MappedInstances + first, snapshot.Particles.data(), count * sizeof(ParticleVertex));
+	glVertexArrayVertexBuffer(m_QuadVA, 1, m_InstanceVB, (GLintptr)(first * sizeof(ParticleVertex)), sizeof(ParticleVertex));
+
+	glUniform2f(m_ParticleShaderScale, 0.01f, 0.01f);
+	glUniform2fv(m_ParticleShaderDomainSize, 1, glm::value_ptr(snapshot.DomainSize));
+	glUniform1f(m_ParticleShaderInterpolation, interpolation);
+	glUniform4fv(m_ParticleShaderLowColor, 1, glm::value_ptr(s_LowParticleColour));
+	glUniform4fv(m_ParticleShaderHighColor, 1, glm::value_ptr(s_HighParticleColour));
+	glBindVertexArray(m_QuadVA);
+	glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr, (GLsizei)count);
+
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_Section = (m_Section + 1) % s_InstanceSections;
+}
+
+void ParticleRenderer::ReserveInstances(size_t count)
+{
+	if (count <= m_InstanceCapacity)
+		return;
+
+	// The old buffer stays alive until the draws reading it are done, so it can be
+	// deleted straight away. Deleting it unmaps it as well.
+	for (GLsync& fence : m_SectionFences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+		fence = nullptr;
+	}
+	if (m_InstanceVB)
+		glDeleteBuffers(1, &m_InstanceVB);
+
+	// Grow in steps so emitters filling the pool don't recreate the buffer every frame.
+	m_InstanceCapacity = std::max(count, m_InstanceCapacity * 3 / 2);
+	const GLsizeiptr bytes = (GLsizeiptr)(m_InstanceCapacity * s_InstanceSections * sizeof(ParticleVertex));
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &m_InstanceVB);
+	glNamedBufferStorage(m_InstanceVB, bytes, nullptr, flags);
+	m_MappedInstances = (ParticleVertex*)glMapNamedBufferRange(m_InstanceVB, 0, bytes, flags);
+	m_Section = 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <GLCore.h>
+#include <GLCoreUtils.h>
+
+#include "SimulationThread.h"
+
+// Draws a snapshot of the particles with a single instanced call. Kept apart from the
+// simulation so ParticleSystem can run without a GL context.
+//
+// The snapshot's packed ParticleVertex stream is copied as it is into a persistently
+// mapped instance buffer, split into sections that are written in turn. A fence after
+// each draw keeps a section from being written again before the GPU is done reading
+// it. Interpolation, placement and colour are all worked out in the vertex shader.
+class ParticleRenderer
+{
+public:
+	// Particles are drawn at the given fraction of the way from the snapshot's previous
+	// positions to its current ones.
+	void OnRender(const ParticleSnapshot& snapshot, float interpolation, GLCore::Utils::OrthographicCamera& camera);
+private:
+	// Makes every section of the instance buffer hold at least count particles.
+	void ReserveInstances(size_t count);
+private:
+	static constexpr int s_InstanceSections = 3;
+
+	GLuint m_QuadVA = 0, m_BarVA = 0;
+	GLuint m_InstanceVB = 0;
+	// Particles each section holds.
+	size_t m_InstanceCapacity = 0;
+	ParticleVertex* m_MappedInstances = nullptr;
+	GLsync m_SectionFences[s_InstanceSections] = {};
+	int m_Section = 0;
+	std::unique_ptr<GLCore::Utils::Shader> m_ParticleShader;
+	GLint m_ParticleShaderViewProj, m_ParticleShaderScale, m_ParticleShaderDomainSize;
+	GLint m_ParticleShaderInterpolation, m_ParticleShaderLowColor, m_ParticleShaderHighColor;
+};
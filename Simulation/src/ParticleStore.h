@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+
+#include "AlignedAllocator.h"
+
+// Structure-of-arrays particle storage. Each attribute lives in its own 64-byte
+// aligned array so the update kernels only pull the attributes they touch through
+// the cache and can load eight particles per AVX2 register.
+class ParticleStore
+{
+public:
+	void Resize(size_t count)
+	{
+		for (AlignedVector<float>* attribute : GetAttributes())
+			attribute->resize(count, 0.0f);
+		m_Count = count;
+	}
+	// Makes room for capacity particles, so Resize up to it keeps every attribute where
+	// it is.
+	void Reserve(size_t capacity)
+	{
+		for (AlignedVector<float>* attribute : GetAttributes())
+			attribute->reserve(capacity);
+	}
+
+	size_t GetCount() const { return m_Count; }
+	// Slots the ParticlePool has freed hold no particle until it hands them out again.
+	bool IsAlive(size_t index) const { return Lifetime[index] >= 0.0f; }
+
+	static constexpr size_t AttributeCount = 16;
+
+	// Every attribute in a fixed order, GetAttributeName(i) names the i-th one. Returned
+	// by value in a fixed-size array, so the sorts and compactions that walk them every
+	// few steps do not allocate.
+	std::array<AlignedVector<float>*, AttributeCount> GetAttributes()
+	{
+		return { &PositionX, &PositionY, &VelocityX, &VelocityY, &ForceX, &ForceY, &Density,
+			&Temperature, &Qv, &Qc, &AffineXX, &AffineXY, &AffineYX, &AffineYY, &Age, &Lifetime };
+	}
+	std::array<const AlignedVector<float>*, AttributeCount> GetAttributes() const
+	{
+		return { &PositionX, &PositionY, &VelocityX, &VelocityY, &ForceX, &ForceY, &Density,
+			&Temperature, &Qv, &Qc, &AffineXX, &AffineXY, &AffineYX, &AffineYY, &Age, &Lifetime };
+	}
+	static const char* GetAttributeName(size_t index)
+	{
+		static const char* const names[AttributeCount] = { "position_x", "position_y", "velocity_x", "velocity_y", "force_x", "force_y", "density",
+			"temperature", "qv", "qc", "affine_xx", "affine_xy", "affine_yx", "affine_yy", "age", "lifetime" };
+		return names[index];
+	}
+	// Attributes from this index on were added after the first checkpoint version and
+	// may be missing from a checkpoint, they are zeroed when they are.
+	static constexpr size_t RequiredAttributeCount = 10;
+
+	AlignedVector<float> PositionX, PositionY;
+	AlignedVector<float> VelocityX, VelocityY;
+	AlignedVector<float> ForceX, ForceY;
+	AlignedVector<float> Density;
+	AlignedVector<float> Temperature;
+	AlignedVector<float> Qv;
+	AlignedVector<float> Qc;
+	// Velocity gradient around the particle, row-major, kept by APIC transfers.
+	AlignedVector<float> AffineXX, AffineXY, AffineYX, AffineYY;
+	// Seconds since the particle was spawned, and how long it lives. A lifetime of 0
+	// never runs out, FreeLifetime marks a free slot.
+	AlignedVector<float> Age, Lifetime;
+	static constexpr float FreeLifetime = -1.0f;
+private:
+	size_t m_Count = 0;
+};
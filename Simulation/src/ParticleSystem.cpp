@@ -1,46 +1,152 @@
 ﻿#include "ParticleSystem.h"
 
+#include "AdvectionKernels.h"
+#include "BoundaryConditions.h"
+#include "Checkpoint.h"
+#include "ForceKernels.h"
+#include "MicrophysicsKernels.h"
+#include "ParticleKernels.h"
+#include "Profiler.h"
 #include "Random.h"
 
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
 #include <glm/gtc/constants.hpp>
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/compatibility.hpp>
 
-ParticleSystem::ParticleSystem()
+#include "GLCore/Core/Log.h"
+
+// Everything a checkpoint holds besides the fields and particles. Its layout is part
+// of the checkpoint version.
+struct CheckpointParameters
 {
-	m_ParticlePool.resize(10000);
-	gravity = -0.1f;
-	vorticityEpsilon = 0.001f;
-	buoyancyEpsilon = 0.02f;
-	frames_per_second = "FPS: 0";
-	for (int i = 0; i < m_ParticlePool.size(); ++i) {
-		m_ParticlePool[i].Position = { Random::Float(), Random::Float() };
-		m_ParticlePool[i].Velocity = { (Random::Float() - 0.5f) / 10.0f, (Random::Float() - 0.5f) / 10.0f };
-		m_ParticlePool[i].Forces = { 0.0f, 0.0f }; 
-		m_ParticlePool[i].Colour = { 13 / 255.0f, 38 / 255.0f, 212 / 255.0f, 1.0f };
-		m_ParticlePool[i].Temperature = Random::Float() * 60.0f + 250.0f;
-		m_ParticlePool[i].Qv = Random::Float();
-		m_ParticlePool[i].Qc = 0.0f;
-	}
+	int32_t Width, Height;
+	float CellSize;
+	uint32_t StepIndex;
+	uint64_t ParticleCount;
+	float Gravity, VorticityEpsilon, BuoyancyEpsilon;
+	uint32_t AdvectionScheme;
+	uint32_t PressureSolverType;
+	float PressureTolerance;
+	int32_t PressureMaxIterations;
+	float PressureOmega;
+	uint32_t Seed;
+	// 0 in checkpoints from before emitters, which could not grow past ParticleCount.
+	uint32_t ParticleCapacity;
+};
+
+// Settings added after the first checkpoint version, in a section of their own that
+// version 1 checkpoints do not have. Its layout is part of the checkpoint version too.
+struct CheckpointSettings
+{
+	uint32_t TransferMode;
+	// Mode the particles were last seeded for, see ParticleTransfer::GetSeededMode.
+	uint32_t SeededTransferMode;
+	float FlipRatio;
+	uint32_t SphEnabled;
+	float SphRadius, SphRestDensity, SphStiffness, SphViscosity;
+	uint32_t ParticleSortInterval;
+	uint32_t ParticleCompactInterval;
+	uint32_t ActiveTilesEnabled;
+	float ActiveVelocityThreshold, ActiveVorticityThreshold, ActiveCloudWaterThreshold;
+};
+
+// Streams of random numbers the particle system draws, so no two uses see the same values.
+enum RandomStream : uint32_t
+{
+	StreamParticlePositionX = 0,
+	StreamParticlePositionY,
+	StreamParticleVelocityX,
+	StreamParticleVelocityY,
+	StreamParticleTemperature,
+	StreamParticleVapor,
+	StreamInitialTemperature,
+	StreamBoundaryTemperature,
+	StreamBoundaryVapor,
+	StreamEmitterCount,
+	StreamEmitterPositionX,
+	StreamEmitterPositionY
+};
+
+ParticleSystem::ParticleSystem(const ParticleSystemProps& props)
+	: m_Width(props.Width), m_Height(props.Height), m_CellSize(props.CellSize), m_InvCellSize(1.0f / props.CellSize),
+	m_DomainSize(props.Width * props.CellSize, props.Height * props.CellSize)
+{
+	const int width = m_Width, height = m_Height;
+	const float cellSize = m_CellSize;
+	m_VelocityField.Resize(width, height, cellSize);
+	m_TemperatureField.Resize(width, height, cellSize);
+	m_VaporField.Resize(width, height, cellSize);
+	m_CloudWaterField.Resize(width, height, cellSize);
+	m_PressureField.Resize(width, height, cellSize);
+	m_ExnerField.Resize(width, height, cellSize);
+	m_InvExnerField.Resize(width, height, cellSize);
+	m_VelocityFieldBack.Resize(width, height, cellSize);
+	m_TemperatureFieldBack.Resize(width, height, cellSize);
+	m_VaporFieldBack.Resize(width, height, cellSize);
+	m_CloudWaterFieldBack.Resize(width, height, cellSize);
+	m_DivergenceField.Resize(width, height, cellSize);
+	m_BackTrace.Resize(width, height, cellSize);
+	m_ForwardTrace.Resize(width, height, cellSize);
+	m_MacCormackVelocity.Resize(width, height, cellSize);
+	for (Grid2D<float>& scalars : m_MacCormackScalars)
+		scalars.Resize(width, height, cellSize);
+	m_ProjectionPressureField.Resize(width, height, cellSize);
+	m_PressureSolver.Resize(width, height, cellSize);
+	m_ParticleTransfer.Resize(width, height, cellSize);
+	m_TileMask.Resize(width, height);
+	m_CellIndex.Resize(width, height);
+
+	m_Particles.Resize(props.ParticleCount);
+	gravity = props.Gravity;
+	vorticityEpsilon = props.VorticityEpsilon;
+	buoyancyEpsilon = props.BuoyancyEpsilon;
+	advectionScheme = AdvectionScheme::Bilinear;
+	particleSortInterval = 16;
+	particleCompactInterval = 16;
+	// Every particle draws its own numbers, so the bands can be filled in any order.
+	m_ThreadPool.ParallelFor(0, (int)m_Particles.GetCount(), [&](int begin, int end) {
+		const int count = end - begin;
+		Random::Fill(m_Particles.PositionX.data() + begin, count, StreamParticlePositionX, 0, begin);
+		Random::Fill(m_Particles.PositionY.data() + begin, count, StreamParticlePositionY, 0, begin);
+		Random::Fill(m_Particles.VelocityX.data() + begin, count, StreamParticleVelocityX, 0, begin);
+		Random::Fill(m_Particles.VelocityY.data() + begin, count, StreamParticleVelocityY, 0, begin);
+		Random::Fill(m_Particles.Temperature.data() + begin, count, StreamParticleTemperature, 0, begin);
+		Random::Fill(m_Particles.Qv.data() + begin, count, StreamParticleVapor, 0, begin);
+		for (int i = begin; i < end; ++i) {
+			m_Particles.PositionX[i] = m_Particles.PositionX[i] * m_DomainSize.x;
+			m_Particles.PositionY[i] = m_Particles.PositionY[i] * m_DomainSize.y;
+			m_Particles.VelocityX[i] = (m_Particles.VelocityX[i] - 0.5f) / 10.0f;
+			m_Particles.VelocityY[i] = (m_Particles.VelocityY[i] - 0.5f) / 10.0f;
+			m_Particles.ForceX[i] = 0.0f;
+			m_Particles.ForceY[i] = 0.0f;
+			m_Particles.Temperature[i] = m_Particles.Temperature[i] * 60.0f + 250.0f;
+			m_Particles.Qc[i] = 0.0f;
+		}
+	});
+	m_ParticlePool.Reset(m_Particles, props.ParticleCapacity);
+	m_CellIndex.Reserve(m_ParticlePool.GetCapacity());
+	m_ParticleOrder.reserve(m_ParticlePool.GetCapacity());
 	// Set the velocity field to random values
-	for (int y = 0; y < 100; ++y) {
-		for (int x = 0; x < 50; ++x) {
+	for (int y = 0; y < m_Height; ++y) {
+		for (int x = 0; x < m_Width / 2; ++x) {
 			m_VelocityField[y][x] = { 0.0000f, 0.0001f };
 			// Set bottom boundary to 0 velocity
 			m_VelocityField[0][x] = { 0.0f, 0.0f };
-			m_VelocityField[99][x] = m_VelocityField[98][x];
+			m_VelocityField[m_Height - 1][x] = m_VelocityField[m_Height - 2][x];
 			// Ensure no vertical velocity at the top;
-			m_VelocityField[99][x].y = 0.0f;
+			m_VelocityField[m_Height - 1][x].y = 0.0f;
 		}
 	}
-	for (int y = 0; y < 100; ++y) {
-		for (int x = 50; x < 100; ++x) {
+	for (int y = 0; y < m_Height; ++y) {
+		for (int x = m_Width / 2; x < m_Width; ++x) {
 			m_VelocityField[y][x] = { 0.0000f, 0.0001f };
 			// Set bottom boundary to 0 velocity
 			m_VelocityField[0][x] = { 0.0f, 0.0f };
-			m_VelocityField[99][x] = m_VelocityField[98][x];
+			m_VelocityField[m_Height - 1][x] = m_VelocityField[m_Height - 2][x];
 			// Ensure no vertical velocity at the top.
-			m_VelocityField[99][x].y = 0.0f;
+			m_VelocityField[m_Height - 1][x].y = 0.0f;
 		}
 	}
 
@@ -53,398 +159,546 @@ ParticleSystem::ParticleSystem()
 
 	// Initializes the condensed cloud water field (Qc) to be 0 everywhere. 
 	// Because we are not simulating any clouds at the start. 
-	for (int y = 0; y < 100; ++y) {
-		for (int x = 0; x < 100; ++x) {
-			m_TemperatureField[y][x] = {300.0f - 50.0f * ((float)y)/100.0f};
-			m_TemperatureField[99][x] = 300.0f;
-			m_TemperatureField[0][x] = 300.0f + Random::Float() * 5.0f;
-			m_VaporField[y][x] = { 0.02f + (0.001f - 0.02f) * ((float)y) / 100.0f };
-			m_VaporField[99][x] = { 0.0f };
+	for (int y = 0; y < m_Height; ++y) {
+		for (int x = 0; x < m_Width; ++x) {
+			m_TemperatureField[y][x] = {300.0f - 50.0f * ((float)y)/m_Height};
+			m_TemperatureField[m_Height - 1][x] = 300.0f;
+			m_VaporField[y][x] = { 0.02f + (0.001f - 0.02f) * ((float)y) / m_Height };
+			m_VaporField[m_Height - 1][x] = { 0.0f };
 			m_CloudWaterField[y][x] = 0.0f;
 		}
 	}
+	// Randomly perturb the temperature at the bottom.
+	Random::Fill(m_TemperatureField[0], m_Width, StreamInitialTemperature, 0, 0);
+	for (int x = 0; x < m_Width; ++x) {
+		m_TemperatureField[0][x] = 300.0f + m_TemperatureField[0][x] * 5.0f;
+	}
 
 	// Initializes the pressure field to be decreasing from the bottom to the top.
-	for (int y = 0; y < 100; ++y) {
-		for (int x = 0; x < 100; ++x) {
-			m_PressureField[y][x] = {100000.0f * std::pow((1.0f - (static_cast<float>(y)/100.0f * 15.0f * 10.0f )/m_TemperatureField[y][x]), (- 1.0f * gravity) / (10.0f * 287.0f))};
+	for (int y = 0; y < m_Height; ++y) {
+		for (int x = 0; x < m_Width; ++x) {
+			m_PressureField[y][x] = {100000.0f * std::pow((1.0f - (static_cast<float>(y)/m_Height * 15.0f * 10.0f )/m_TemperatureField[y][x]), (- 1.0f * gravity) / (10.0f * 287.0f))};
 		}
 	}
+	UpdateExnerFields();
+	BuildStepGraph();
 }
 
-// Handles collisions with the 4 walls. If a particle hits a wall, it bounces off it -
-// with half the velocity it had before in that direction.
-void ParticleSystem::CheckCollisions(const int i) {
-
-	if (m_ParticlePool[i].Position.y < 0.0f)
-	{
-		m_ParticlePool[i].Position.y = 0.0f;
-		m_ParticlePool[i].Velocity.y *= -0.3f;
-	}
-	else if (m_ParticlePool[i].Position.y > 1.0f)
-	{
-		m_ParticlePool[i].Position.y = 1.0f;
-		m_ParticlePool[i].Velocity.y *= -0.3f;
-	}
-	if (m_ParticlePool[i].Position.x < 0.0f)
-	{
-		m_ParticlePool[i].Position.x = 0.0f;
-		m_ParticlePool[i].Velocity.x *= -0.3f;
-	}
-	else if (m_ParticlePool[i].Position.x > 1.0f)
-	{
-		m_ParticlePool[i].Position.x = 1.0f;
-		m_ParticlePool[i].Velocity.x *= -0.3f;
-	}
+void ParticleSystem::UpdateExnerFields() {
+	for (int y = 0; y < m_Height; ++y)
+		ComputeExnerRow(m_PressureField[y], m_ExnerField[y], m_InvExnerField[y], m_Width);
+	m_TileMask.UpdatePressureBounds(m_PressureField, m_ExnerField);
 }
 
-float ParticleSystem::CalculateBuoyancyForce(const int x, const int y) {
-	const float theta_v0 = 295.0f; 
-	float theta_v = m_TemperatureField[y][x] * (1.0f + 0.61f * m_VaporField[y][x]);
-
-	float buoyancy = -1.0f * buoyancyEpsilon * gravity * ((theta_v / theta_v0) - m_CloudWaterField[y][x]);
-
-	return buoyancy;
+// Implemented from 2001 paper. The velocity is written to newVelocity, the curl of a
+// row reads the rows around it, so they cannot be updated in place.
+void ParticleSystem::ApplyVorticityAndBuoyancy(const Grid2D<glm::vec2>& velocityField,
+	Grid2D<glm::vec2>& newVelocity, float deltaTime) {
+	ForceParams params;
+	params.VorticityEpsilon = vorticityEpsilon;
+	params.BuoyancyScale = -1.0f * buoyancyEpsilon * gravity;
+	params.DeltaTime = deltaTime;
+	auto apply = [&](const TileRange& tile, bool confine) {
+		ApplyForces(velocityField, m_TemperatureField, m_VaporField, m_CloudWaterField, newVelocity, tile, confine, params);
+	};
+	if (!m_TileMask.IsSparse()) {
+		// Bands of whole rows, so each row's curl is only worked out once.
+		m_ThreadPool.ParallelFor(0, m_Height, [&](int yBegin, int yEnd) {
+			apply({ 0, m_Width, yBegin, yEnd }, true);
+		});
+		return;
+	}
+	// The buoyancy acts everywhere, the confinement only where the flow is active.
+	ForEachTile(m_TileMask.GetActiveTiles(), [&](const TileRange& tile) { apply(tile, true); });
+	ForEachTile(m_TileMask.GetInactiveTiles(), [&](const TileRange& tile) { apply(tile, false); });
 }
 
-// Implemented from 2001 paper.
-std::array<std::array<float, 100>, 100> ParticleSystem::CalculateVorticity(const std::array<std::array<glm::vec2, 100>, 100>& velocityField) {
-	std::array<std::array<float, 100>, 100> vorticityField;
-	vorticityField.fill({ 0 });
-	for (int y = 1; y < 99; ++y) {
-		for (int x = 1; x < 99; ++x) {
-			vorticityField[y][x] = (velocityField[y][x + 1].x - velocityField[y][x - 1].x) / 0.02f - (velocityField[y + 1][x].y - velocityField[y - 1][x].y) / 0.02f;
+void ParticleSystem::UpdateWaterVaporField(Grid2D<float>& temperatureField,
+	Grid2D<float>& vaporField, Grid2D<float>& cloudWaterField) {
+	ForEachTile(m_TileMask.GetActiveTiles(), [&](const TileRange& tile) {
+		const int x = tile.XBegin;
+		for (int y = tile.YBegin; y < tile.YEnd; ++y) {
+			UpdateMicrophysicsRow(temperatureField[y] + x, vaporField[y] + x, cloudWaterField[y] + x,
+				m_PressureField[y] + x, m_ExnerField[y] + x, m_InvExnerField[y] + x, tile.XEnd - x);
 		}
-	}
-	for (int y = 0; y < 100; ++y) {
-		vorticityField[y][0] = vorticityField[y][1];
-		vorticityField[y][99] = vorticityField[y][98];
-	}
-	for (int x = 0; x < 100; ++x) {
-		vorticityField[0][x] = vorticityField[1][x];
-		vorticityField[99][x] = vorticityField[98][x];
-	}
-	return vorticityField;
+	});
 }
-
-std::array<std::array<glm::vec2, 100>, 100> ParticleSystem::ComputeNormalizedVorticityGradient(
-	const std::array<std::array<float, 100>, 100>& vorticityField) {
-	std::array<std::array<glm::vec2, 100>, 100> vorticityGradient;
-	for (int y = 1; y < 99; ++y) {
-		for (int x = 1; x < 99; ++x) {
-			float nx = (std::abs(vorticityField[y][x + 1]) - std::abs(vorticityField[y][x])) / 0.01f;
-			float ny = (std::abs(vorticityField[y+1][x]) - std::abs(vorticityField[y][x])) / 0.01f;
-			glm::vec2 n = { nx, ny };
-			float magnitude = glm::length(n);
-			if (magnitude > 0.000001) {
-				vorticityGradient[y][x] = n / magnitude;
-			}
-			else {
-				vorticityGradient[y][x] = { 0.0f, 0.0f };
+// Compute divergence using 2001 method.
+void ParticleSystem::ComputeDivergence(const Grid2D<glm::vec2>& velocityField, Grid2D<float>& divergenceField) {
+	const int width = velocityField.GetWidth();
+	const int height = velocityField.GetHeight();
+	const float cellSize = velocityField.GetCellSize();
+	// Edge cells are never written and keep the zero they were allocated with.
+	m_ThreadPool.ParallelFor(1, height - 1, [&](int yBegin, int yEnd) {
+		for (int y = yBegin; y < yEnd; ++y) {
+			for (int x = 1; x < width - 1; ++x) {
+				divergenceField[y][x] = ((velocityField[y][x + 1].x + velocityField[y][x].x)/2.0f - 
+					(velocityField[y][x - 1].x + velocityField[y][x].x) / 2.0f + 
+					(velocityField[y + 1][x].y + velocityField[y][x].y) / 2.0f - 
+					(velocityField[y - 1][x].y + velocityField[y][x].y) / 2.0f)/cellSize;
 			}
 		}
-	}
-	return vorticityGradient;
-}
-
-void ParticleSystem::ApplyVorticityConfinement(
-	std::array<std::array<glm::vec2, 100>, 100>& velocityField,
-	const std::array<std::array<float, 100>, 100>& vorticityField,
-	const std::array<std::array<glm::vec2, 100>, 100>& vorticityGradient, float deltaTime) {
-	for (int y = 1; y < 99; ++y) {
-		for (int x = 1; x < 99; ++x) {
-			float forceX = -vorticityEpsilon * vorticityGradient[y][x].y * vorticityField[y][x];
-			float forceY = vorticityEpsilon * vorticityGradient[y][x].x * vorticityField[y][x];
-			glm::vec2 force = { forceX, forceY };
-			velocityField[y][x] += force * (float)deltaTime;
-		}
-	}
+	});
 }
 
-void ParticleSystem::UpdateWaterVaporField(std::array<std::array<float, 100>, 100>& temperatureField, 
-	const std::array<std::array<float, 100>, 100>& pressureField, std::array<std::array<float, 100>, 100> vaporField,
-	std::array<std::array<float, 100>, 100> cloudWaterField) {
-	for (int y = 0; y < 100; ++y) {
-		for (int x = 0; x < 100; ++x) {
-			float T = temperatureField[y][x] / std::pow((100000.0f / pressureField[y][x]), 0.286f);
-			float q_vs = 380.16f / pressureField[y][x] * glm::exp(17.67f * (T - 273.15f) / (T - 29.65f));
-			float delta_qv = std::min(q_vs - vaporField[y][x], cloudWaterField[y][x]);
-			vaporField[y][x] = vaporField[y][x] + delta_qv; 
-			cloudWaterField[y][x] = cloudWaterField[y][x] - delta_qv;
-			// θ = θ' + L/(cp * exner) * -1.0f * delta_qv
-			temperatureField[y][x] += 2501000.0f / (1005.0f * 1.0f / std::pow((100000.0f / pressureField[y][x]), 0.286f)) * -1.0f * delta_qv;
-		}
-	}
-}
-// Compute divergence using 2001 method.
-std::array<std::array<float, 100>, 100> ParticleSystem::ComputeDivergence(const std::array<std::array<glm::vec2, 100>, 100>& velocityField) {
-	std::array<std::array<float, 100>, 100> divergenceField = {};
-	for (int y = 1; y < 99; ++y) {
-		for (int x = 1; x < 99; ++x) {
-			divergenceField[y][x] = ((velocityField[y][x + 1].x + velocityField[y][x].x)/2.0f - 
-				(velocityField[y][x - 1].x + velocityField[y][x].x) / 2.0f + 
-				(velocityField[y + 1][x].y + velocityField[y][x].y) / 2.0f - 
-				(velocityField[y - 1][x].y + velocityField[y][x].y) / 2.0f)/0.01f;
+// Subtract the central-difference gradient of the projection pressure, which removes
+// the divergent part of the velocity measured by ComputeDivergence.
+void ParticleSystem::SubtractPressureGradient(Grid2D<glm::vec2>& velocityField, const Grid2D<float>& pressureField) {
+	const int width = velocityField.GetWidth();
+	const int height = velocityField.GetHeight();
+	const float halfInvCellSize = 0.5f / velocityField.GetCellSize();
+	m_ThreadPool.ParallelFor(1, height - 1, [&](int yBegin, int yEnd) {
+		for (int y = yBegin; y < yEnd; ++y) {
+			for (int x = 1; x < width - 1; ++x) {
+				velocityField[y][x].x -= (pressureField[y][x + 1] - pressureField[y][x - 1]) * halfInvCellSize;
+				velocityField[y][x].y -= (pressureField[y + 1][x] - pressureField[y - 1][x]) * halfInvCellSize;
+			}
 		}
-	}
-	return divergenceField;
+	});
 }
 
 void ParticleSystem::SetBoundaryConditions() {
-	// Velocity
-	for (int x = 0; x < 100; ++x) {
-		// Bottom (no-slip)
-		m_VelocityField[0][x] = glm::vec2(0.0f, 0.0f);
-		// Top (free-slip)
-		m_VelocityField[99][x] = m_VelocityField[98][x];
-		m_VelocityField[99][x].y = 0.0f;
-	}
-	for (int y = 0; y < 100; ++y) {
-		m_VelocityField[y][0].y = 0.0f;
-		m_VelocityField[y][99].y = 0.0f; 
-	}
-
-	float ambientTemperature = 250.0f;
-	for (int x = 0; x < 100; ++x) {
-		// Set ambient temperature at the top.
-		m_TemperatureField[99][x] = ambientTemperature;
-	}
-	for (int y = 0; y < 100; ++y) {
-		// Set ambiernt temperature at the sides.
-		m_TemperatureField[y][0] = ambientTemperature;
-		m_TemperatureField[y][99] = ambientTemperature;
-	}
-	for (int x = 0; x < 100; ++x) {
-		// Randomly perturb the temperature at the bottom.
-		m_TemperatureField[0][x] = 300.0f + Random::Float() * 5.0f - 2.5f;
-	}
+	SetVelocityBoundaryConditions();
+	SetScalarBoundaryConditions();
+}
 
-	// Vapor
-	for (int x = 0; x < 100; ++x) {
-		// Set top qv boundary to 0.0f.
-		m_VaporField[99][x] = 0.0f;
-	}
-	for (int y = 0; y < 100; ++y) {
-		m_VaporField[y][0] = m_VaporField[y][99];
-	}
-	for (int x = 0; x < 100; ++x) {
-		// Randomly perturb the water vapor at the bottom.
-		m_VaporField[0][x] = 0.02f + Random::Float() * 0.005f - 0.0025f;
-	}
+void ParticleSystem::SetVelocityBoundaryConditions() {
+	ApplyBoundaries(m_VelocityField, boundaries.Velocity);
+}
 
-	// Set all qc boundaries to 0.0f.
-	for (int x = 0; x < 100; ++x) {
-		m_CloudWaterField[99][x] = 0.0f;
-		m_CloudWaterField[0][x] = 0.0f;
-	}
-	for (int y = 0; y < 100; ++y) {
-		m_CloudWaterField[y][0] = 0.0f;
-		m_CloudWaterField[y][99] = 0.0f;
-	}
+void ParticleSystem::SetScalarBoundaryConditions() {
+	FieldBoundaries<float> temperature = boundaries.Temperature;
+	FieldBoundaries<float> vapor = boundaries.Vapor;
+	// Randomly perturb the temperature and water vapor at the bottom.
+	if (temperature.Bottom.Type == BoundaryType::Inflow && !temperature.Bottom.Profile) {
+		m_GroundTemperature.resize(m_Width);
+		Random::Fill(m_GroundTemperature.data(), m_Width, StreamBoundaryTemperature, m_StepIndex, 0);
+		for (float& value : m_GroundTemperature)
+			value = 300.0f + value * 5.0f - 2.5f;
+		temperature.Bottom.Profile = m_GroundTemperature.data();
+	}
+	if (vapor.Bottom.Type == BoundaryType::Inflow && !vapor.Bottom.Profile) {
+		m_GroundVapor.resize(m_Width);
+		Random::Fill(m_GroundVapor.data(), m_Width, StreamBoundaryVapor, m_StepIndex, 0);
+		for (float& value : m_GroundVapor)
+			value = 0.02f + value * 0.005f - 0.0025f;
+		vapor.Bottom.Profile = m_GroundVapor.data();
+	}
+
+	ApplyBoundaries(m_TemperatureField, temperature);
+	ApplyBoundaries(m_VaporField, vapor);
+	ApplyBoundaries(m_CloudWaterField, boundaries.CloudWater);
 }
 
 void ParticleSystem::AdvectVelocityField(
-	const std::array<std::array<glm::vec2, 100>, 100>& oldVelocity,
-	std::array<std::array<glm::vec2, 100>, 100>& newVelocity, float timeStep) {
-	for (int y = 0; y < 100; ++y) {
-		for (int x = 0; x < 100; ++x) {
-
-			// Converts current x/y index in loop to a normalized position in grid.
-			// (x, y) = (50, 50) -> (0.5, 0.5).
-			glm::vec2 currentPosition = glm::vec2(x * 0.01, y * 0.01);
-
-			// Get the velocity at that position in the previous field.
-			glm::vec2 velocity = oldVelocity[y][x];
-
-			// Calculate the position of the particle at the previous time step. 
-			// If position = (0.5, 0.5) and velocity = (0.1, 0.0), old position = (0.4, 0.5), etc.
-			glm::vec2 previousPosition = currentPosition - velocity * timeStep;
-
-			// Gets the velocity at that previous position by sampling old velocity field.
-			int previousX = static_cast<int>(previousPosition.x * 100.0f);
-			int previousY = static_cast<int>(previousPosition.y * 100.0f);
-
-			if (previousX < 0) {
-				previousX = 0;
-			}
-			else if (previousX > 99) {
-				previousX = 99;
-			}
-			if (previousY < 0) {
-				previousY = 0;
-			}
-			else if (previousY > 99) {
-				previousY = 99;
+	const Grid2D<glm::vec2>& oldVelocity,
+	Grid2D<glm::vec2>& newVelocity, float timeStep) {
+	// Trace each cell back through the old velocity and bilinearly sample it there.
+	ForEachTile(m_TileMask.GetActiveTiles(), [&](const TileRange& tile) {
+		for (int y = tile.YBegin; y < tile.YEnd; ++y) {
+			glm::vec2* trace = m_BackTrace[y];
+			TraceRow(oldVelocity, y, tile.XBegin, tile.XEnd, timeStep, trace);
+			for (int x = tile.XBegin; x < tile.XEnd; ++x)
+				newVelocity[y][x] = SampleBilinear(oldVelocity, trace[x]);
+		}
+	});
+	CopyInactiveTiles(oldVelocity, newVelocity);
+	if (advectionScheme != AdvectionScheme::MacCormack)
+		return;
+
+	// Carry the result forward again. Half the difference from the old field is the
+	// error of one bilinear pass, so add it back, clamped to the values sampled from.
+	ForEachTile(m_TileMask.GetActiveTiles(), [&](const TileRange& tile) {
+		for (int y = tile.YBegin; y < tile.YEnd; ++y) {
+			glm::vec2* forward = m_ForwardTrace[y];
+			TraceRow(oldVelocity, y, tile.XBegin, tile.XEnd, -timeStep, forward);
+			for (int x = tile.XBegin; x < tile.XEnd; ++x) {
+				glm::vec2 roundTrip = SampleBilinear(newVelocity, forward[x]);
+				glm::vec2 low, high;
+				SampleRange(oldVelocity, m_BackTrace[y][x], low, high);
+				m_MacCormackVelocity[y][x] = glm::clamp(newVelocity[y][x] + 0.5f * (oldVelocity[y][x] - roundTrip), low, high);
 			}
-			newVelocity[y][x] = oldVelocity[previousY][previousX];
 		}
-	}
+	});
+	CopyInactiveTiles(newVelocity, m_MacCormackVelocity);
+	newVelocity.Swap(m_MacCormackVelocity);
 }
 
-void ParticleSystem::AdvectScalarField(const std::array<std::array<float, 100>, 100>& oldField,
-	const std::array<std::array<glm::vec2, 100>, 100>& velocityField,
-	std::array<std::array<float, 100>, 100>& newField,
-	float deltaTime) {
-	for (int y = 0; y < 100; ++y) {
-		for (int x = 0; x < 100; ++x) {
-			// Converts current x/y index in loop to a normalized position in grid.
-			// (x, y) = (50, 50) -> (0.5, 0.5).
-			glm::vec2 currentPosition = glm::vec2(x * 0.01, y * 0.01);
-
-			// Get the velocity at that position in the velocity field.
-			glm::vec2 velocity = velocityField[y][x];
-
-			// Calculate the position of the particle at the previous time step. 
-			// If position = (0.5, 0.5) and velocity = (0.1, 0.0), old position = (0.4, 0.5), etc.
-
-			glm::vec2 previousPosition = currentPosition - velocity * deltaTime;
-
-			// Gets the velocity at that previous position by sampling old velocity field.
-			int previousX = (int)glm::clamp(previousPosition.x * 100.0f, 0.0f, 99.0f);
-			int previousY = (int)glm::clamp(previousPosition.y * 100.0f, 0.0f, 99.0f);
-			newField[y][x] = oldField[previousY][previousX];
+// Advects temperature, vapor and cloud water into their back buffers. Each cell is
+// traced once and the same position and weights are used for all three fields.
+void ParticleSystem::AdvectScalarFields(const Grid2D<glm::vec2>& velocityField, float deltaTime) {
+	const Grid2D<float>* oldFields[] = { &m_TemperatureField, &m_VaporField, &m_CloudWaterField };
+	Grid2D<float>* newFields[] = { &m_TemperatureFieldBack, &m_VaporFieldBack, &m_CloudWaterFieldBack };
+	const int fieldCount = 3;
+
+	ForEachTile(m_TileMask.GetActiveTiles(), [&](const TileRange& tile) {
+		const int x0 = tile.XBegin;
+		const int count = tile.XEnd - x0;
+		for (int y = tile.YBegin; y < tile.YEnd; ++y) {
+			float* out[] = { (*newFields[0])[y] + x0, (*newFields[1])[y] + x0, (*newFields[2])[y] + x0 };
+			TraceRow(velocityField, y, x0, tile.XEnd, deltaTime, m_BackTrace[y]);
+			SampleScalarRow(m_BackTrace[y] + x0, count, oldFields, out, fieldCount);
+		}
+	});
+	for (int f = 0; f < fieldCount; ++f)
+		CopyInactiveTiles(*oldFields[f], *newFields[f]);
+	if (advectionScheme != AdvectionScheme::MacCormack)
+		return;
+
+	// Same correction as the velocity, the round trip is sampled into the output rows
+	// and then replaced by the corrected value.
+	ForEachTile(m_TileMask.GetActiveTiles(), [&](const TileRange& tile) {
+		const int x0 = tile.XBegin;
+		const int count = tile.XEnd - x0;
+		for (int y = tile.YBegin; y < tile.YEnd; ++y) {
+			float* out[] = { m_MacCormackScalars[0][y] + x0, m_MacCormackScalars[1][y] + x0, m_MacCormackScalars[2][y] + x0 };
+			TraceRow(velocityField, y, x0, tile.XEnd, -deltaTime, m_ForwardTrace[y]);
+			SampleScalarRow(m_ForwardTrace[y] + x0, count, newFields, out, fieldCount);
+			for (int f = 0; f < fieldCount; ++f) {
+				for (int i = 0; i < count; ++i) {
+					const int x = x0 + i;
+					float low, high;
+					SampleRange(*oldFields[f], m_BackTrace[y][x], low, high);
+					float corrected = (*newFields[f])[y][x] + 0.5f * ((*oldFields[f])[y][x] - out[f][i]);
+					out[f][i] = std::min(std::max(corrected, low), high);
+				}
+			}
 		}
+	});
+	for (int f = 0; f < fieldCount; ++f) {
+		CopyInactiveTiles(*newFields[f], m_MacCormackScalars[f]);
+		newFields[f]->Swap(m_MacCormackScalars[f]);
 	}
 }
 
 void ParticleSystem::OnUpdate(GLCore::Timestep ts)
 {
-	frames_per_second = "FPS: " + std::to_string(int(1.0f / ts.GetSeconds()));
+	PROFILE_SCOPE("Step");
+	m_StepTime = (float)ts;
+	m_StepGraph.Run(m_ThreadPool);
+	++m_StepIndex;
+}
+
+// Each field is still updated by its stages in the order of the original sequential
+// step, only stages that touch different fields are left free to overlap.
+void ParticleSystem::BuildStepGraph()
+{
+	// Pick the tiles the sparse kernels cover this step.
+	TaskGraph::TaskId activeTileMask = m_StepGraph.AddTask("ActiveTiles", [this]() {
+		m_TileMask.Rebuild(m_VelocityField, m_TemperatureField, m_VaporField, m_CloudWaterField, activeTiles, m_ThreadPool);
+	});
+
 	// 1. Advect velocity field (u') 
-	{
-		std::array<std::array<glm::vec2, 100>, 100> newVelocityField = m_VelocityField;
-		AdvectVelocityField(m_VelocityField, newVelocityField, (float)ts);
-		m_VelocityField = newVelocityField;
-	}
+	TaskGraph::TaskId advectVelocity = m_StepGraph.AddTask("AdvectVelocity", [this]() {
+		AdvectVelocityField(m_VelocityField, m_VelocityFieldBack, m_StepTime);
+		m_VelocityField.Swap(m_VelocityFieldBack);
+	}, { activeTileMask });
 
 	// 2. Advect scalar fields: θ, qv, qc 
-	{
-		std::array<std::array<float, 100>, 100> newTemperatureField = m_TemperatureField;
-		std::array<std::array<float, 100>, 100> newVaporField = m_VaporField;
-		std::array<std::array<float, 100>, 100> newCloudWaterField = m_CloudWaterField;
-
-		AdvectScalarField(m_TemperatureField, m_VelocityField, newTemperatureField, (float)ts);
-		AdvectScalarField(m_VaporField, m_VelocityField, newVaporField, (float)ts);
-		AdvectScalarField(m_CloudWaterField, m_VelocityField, newCloudWaterField, (float)ts);
-
-		m_TemperatureField = newTemperatureField;
-		m_VaporField = newVaporField;
-		m_CloudWaterField = newCloudWaterField;
-	}
-	// Calculate and apply vorticity 
-	{
-		auto vorticityField = CalculateVorticity(m_VelocityField);
+	TaskGraph::TaskId advectScalars = m_StepGraph.AddTask("AdvectScalars", [this]() {
+		AdvectScalarFields(m_VelocityField, m_StepTime);
+
+		m_TemperatureField.Swap(m_TemperatureFieldBack);
+		m_VaporField.Swap(m_VaporFieldBack);
+		m_CloudWaterField.Swap(m_CloudWaterFieldBack);
+	}, { advectVelocity });
+
+	// Keep the particles in cell order, and the slots of dead ones out of the way.
+	// Nothing else touches them until they are scattered or updated, so this overlaps
+	// the fluid stages.
+	TaskGraph::TaskId sortParticles = m_StepGraph.AddTask("SortParticles", [this]() {
+		if (particleSortInterval > 0 && m_StepIndex % particleSortInterval == 0)
+			SortParticles();
+		else if (particleCompactInterval > 0 && m_StepIndex % particleCompactInterval == 0 && m_ParticlePool.GetFreeCount() > 0)
+			CompactParticles();
+	});
+
+	// Forces between the particles, from where they are at the start of the step. They
+	// are applied when the particles are updated.
+	TaskGraph::TaskId particleInteractions = m_StepGraph.AddTask("ParticleInteractions", [this]() {
+		if (sph.Enabled)
+			ApplyParticleInteractions();
+	}, { sortParticles });
+
+	// In the hybrid modes the particles carry the fields, and overwrite what the grid
+	// advection left in every cell they reach.
+	TaskGraph::TaskId particlesToGrid = m_StepGraph.AddTask("ParticlesToGrid", [this]() {
+		TransferParticlesToGrid();
+	}, { advectScalars, particleInteractions });
+
+	// Apply the vorticity confinement and buoyancy forces. They change the velocity the
+	// scalar advection traces through and read the scalars it writes, so they wait for it.
+	TaskGraph::TaskId forces = m_StepGraph.AddTask("Forces", [this]() {
+		ApplyVorticityAndBuoyancy(m_VelocityField, m_VelocityFieldBack, m_StepTime);
+		m_VelocityField.Swap(m_VelocityFieldBack);
+	}, { particlesToGrid });
+
+	// From here on the scalar and velocity fields are independent. The microphysics
+	// and scalar boundaries run alongside the projection and the particles.
 
-		auto vorticityGradient = ComputeNormalizedVorticityGradient(vorticityField);
+	// Update Qv and Qc (water vapor and cloud water) fields 
+	// Also updates the temperature field based on the change in water vapor field.
+	TaskGraph::TaskId microphysics = m_StepGraph.AddTask("Microphysics", [this]() {
+		UpdateWaterVaporField(m_TemperatureField, m_VaporField, m_CloudWaterField);
+	}, { forces });
 
-		ApplyVorticityConfinement(m_VelocityField, vorticityField, vorticityGradient, (float)ts);
-	}
+	// Set boundary conditions for fields described in the paper.
+	TaskGraph::TaskId scalarBoundaries = m_StepGraph.AddTask("ScalarBoundaries", [this]() {
+		SetScalarBoundaryConditions();
+	}, { microphysics });
+	TaskGraph::TaskId velocityBoundaries = m_StepGraph.AddTask("VelocityBoundaries", [this]() {
+		SetVelocityBoundaryConditions();
+	}, { forces });
+
+	// Project the velocity field onto its divergence-free part. This runs after the
+	// boundary conditions, so the wall velocities they impose are part of the field.
+	TaskGraph::TaskId divergence = m_StepGraph.AddTask("Divergence", [this]() {
+		ComputeDivergence(m_VelocityField, m_DivergenceField);
+	}, { velocityBoundaries });
+	TaskGraph::TaskId pressureSolve = m_StepGraph.AddTask("PressureSolve", [this]() {
+		m_PressureSolveStats = m_PressureSolver.Solve(m_ProjectionPressureField, m_DivergenceField, m_ThreadPool);
+	}, { divergence });
+	TaskGraph::TaskId projection = m_StepGraph.AddTask("SubtractPressureGradient", [this]() {
+		SubtractPressureGradient(m_VelocityField, m_ProjectionPressureField);
+	}, { pressureSolve });
+
+	// Update particles based on calculated velocity field. The hybrid modes also take
+	// the scalars back, so the particles wait for those to be final too.
+	TaskGraph::TaskId particles = m_StepGraph.AddTask("Particles", [this]() {
+		UpdateParticles(m_StepTime);
+	}, { projection, scalarBoundaries });
+
+	// Spawn new particles from the final fields, into the slots this step's dead left.
+	m_StepGraph.AddTask("Emitters", [this]() {
+		if (!emitters.empty())
+			EmitParticles(m_StepTime);
+	}, { particles });
+}
 
-	// Calculate and apply buoyancy force
-	{
-		for (int y = 0; y < 100; ++y) {
-			for (int x = 0; x < 100; ++x) {
-				float buoyancy = CalculateBuoyancyForce(x, y);
-				m_VelocityField[y][x].y += buoyancy * float(ts);
-			}
-		}
-	}
+void ParticleSystem::SortParticles() {
+	m_CellIndex.Sort(m_Particles, m_InvCellSize, m_ThreadPool);
+	// The sort left the free slots behind.
+	m_ParticlePool.Clear();
+	m_ParticleOrder = m_CellIndex.GetOrder();
+	++m_ParticleOrderVersion;
+}
 
-	// Update Qv and Qc (water vapor and cloud water) fields 
-	// Also updates the temperature field based on the change in water vapor field.
-	{
-		UpdateWaterVaporField(m_TemperatureField, m_PressureField, m_VaporField, m_CloudWaterField);
-	}
+void ParticleSystem::CompactParticles() {
+	m_ParticlePool.Compact(m_Particles, m_ParticleOrder, m_ThreadPool);
+	++m_ParticleOrderVersion;
+}
 
-	// Calculate divergence of velocity field
-	{
-		//std::array<std::array<float, 100>, 100> divergenceField = ComputeDivergence(m_VelocityField);
-	}
+void ParticleSystem::EmitParticles(float deltaTime) {
+	EmitParams params;
+	params.DeltaTime = deltaTime;
+	params.StepIndex = m_StepIndex;
+	params.FirstStream = StreamEmitterCount;
+	m_ParticleSpawner.Emit(emitters, m_Particles, m_ParticlePool,
+		m_VelocityField, m_TemperatureField, m_VaporField, m_CloudWaterField, params, m_ThreadPool);
+}
 
-	// Set boundary conditions for fields described in the paper.
-	{
-		SetBoundaryConditions();
-	}
-	// Update particles based on calculated velocity field.
-	for (int i = 0; i < m_ParticlePool.size(); ++i)
-	{
-		// Approximate the position of the particle at the previous timestep.
-		glm::vec2 prevPos = m_ParticlePool[i].Position - m_ParticlePool[i].Velocity * (float)ts;
-		// Convert that position to coordinates on the 100x100 velocity field grid.
-		prevPos *= 100.0f;
-		prevPos = glm::clamp(prevPos, 0.0f, 99.0f);
-		// Get the velocity at the previous point.
-		glm::vec2 sampledVelocityAtGrid = m_VelocityField[(int)(prevPos.y)][(int)(prevPos.x)];
-
-
-		m_ParticlePool[i].Forces.y += gravity;
-
-		CheckCollisions(i);
-
-		m_ParticlePool[i].Velocity += m_ParticlePool[i].Forces * (float)ts  +sampledVelocityAtGrid;
-		m_ParticlePool[i].Position += m_ParticlePool[i].Velocity * (float)ts;
-		// Colour of particle based on height.
-		m_ParticlePool[i].Colour = glm::lerp(glm::vec4(13 / 255.0f, 38 / 255.0f, 212 / 255.0f, 1.0f), glm::vec4(0.9f, 0.9f, 0.9f, 1.0f), m_ParticlePool[i].Position.y);
-		m_ParticlePool[i].Forces = { 0.0f, 0.0f };
-	}
+void ParticleSystem::TransferParticlesToGrid() {
+	m_ParticleTransfer.ParticlesToGrid(m_Particles, m_CellIndex, m_InvCellSize,
+		m_VelocityField, m_TemperatureField, m_VaporField, m_CloudWaterField, m_ThreadPool);
 }
 
-void ParticleSystem::OnRender(GLCore::Utils::OrthographicCamera& camera)
-{
-	if (!m_QuadVA)
-	{
-		float vertices[] = {
-			 -0.1f, -0.1f, 0.0f,
-			  0.1f, -0.1f, 0.0f,
-			  0.1f,  0.1f, 0.0f,
-			 -0.1f,  0.1f, 0.0f
-		};
-
-		glCreateVertexArrays(1, &m_QuadVA);
-		glBindVertexArray(m_QuadVA);
-
-		GLuint quadVB, quadIB;
-		glCreateBuffers(1, &quadVB);
-		glBindBuffer(GL_ARRAY_BUFFER, quadVB);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-		glEnableVertexArrayAttrib(quadVB, 0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0);
-
-		uint32_t indices[] = {
-			0, 1, 2, 2, 3, 0
-		};
-
-		glCreateBuffers(1, &quadIB);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIB);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-		m_ParticleShader = std::unique_ptr<GLCore::Utils::Shader>(GLCore::Utils::Shader::FromGLSLTextFiles("assets/shader.glsl.vert", "assets/shader.glsl.frag"));
-		m_ParticleShaderViewProj = glGetUniformLocation(m_ParticleShader->GetRendererID(), "u_ViewProj");
-		m_ParticleShaderTransform = glGetUniformLocation(m_ParticleShader->GetRendererID(), "u_Transform");
-		m_ParticleShaderColor = glGetUniformLocation(m_ParticleShader->GetRendererID(), "u_Color");
-	}
+void ParticleSystem::ApplyParticleInteractions() {
+	m_SphSolver.Apply(m_Particles, m_CellIndex, sph, m_CellSize, m_DomainSize, m_ThreadPool);
+}
 
-	glUseProgram(m_ParticleShader->GetRendererID());
-	glUniformMatrix4fv(m_ParticleShaderViewProj, 1, GL_FALSE, glm::value_ptr(camera.GetViewProjectionMatrix()));
-
-	// Draw the horizontal bar at y = 0
-	auto width = GLCore::Application::Get().GetWindow().GetWidth();
-	glm::mat4 barTransform = glm::translate(glm::mat4(1.0f), { 0.0f, 0.0f, 0.0f })  // Position at y = 0
-		* glm::scale(glm::mat4(1.0f), { width, 0.1f, 1.0f });  // Scale to make it wide and flat
-	glUniformMatrix4fv(m_ParticleShaderTransform, 1, GL_FALSE, glm::value_ptr(barTransform));
-	glUniform4f(m_ParticleShaderColor, 0.3f, 0.3f, 0.3f, 1.0f);  // Set color to grey
-	glBindVertexArray(m_QuadVA);
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-
-	for (auto& particle : m_ParticlePool)
-	{	
-		// Render
-		glm::mat4 transform = glm::translate(glm::mat4(1.0f), { particle.Position.x, particle.Position.y, 0.0f })
-			* glm::scale(glm::mat4(1.0f), { 0.01f, 0.01f, 1.0f });
-		glUniformMatrix4fv(m_ParticleShaderTransform, 1, GL_FALSE, glm::value_ptr(transform));
-		glUniform4fv(m_ParticleShaderColor, 1, glm::value_ptr(particle.Colour));
-		glBindVertexArray(m_QuadVA);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-	}
+void ParticleSystem::UpdateParticles(float deltaTime) {
+	if (m_ParticleTransfer.Mode != ParticleTransferMode::Passive) {
+		GridToParticleParams params;
+		params.DeltaTime = deltaTime;
+		params.InvCellSize = m_InvCellSize;
+		params.DomainSize = m_DomainSize;
+		m_ThreadPool.ParallelFor(0, (int)m_Particles.GetCount(), [&](int begin, int end) {
+			m_ParticleTransfer.GridToParticles(m_Particles, begin, end,
+				m_VelocityField, m_TemperatureField, m_VaporField, m_CloudWaterField, params);
+			m_ParticlePool.Expire(m_Particles, begin, end, deltaTime);
+		});
+		return;
+	}
+
+	ParticleStepParams params;
+	params.DeltaTime = deltaTime;
+	params.Gravity = gravity;
+	params.InvCellSize = m_InvCellSize;
+	params.DomainSize = m_DomainSize;
+	m_ThreadPool.ParallelFor(0, (int)m_Particles.GetCount(), [&](int begin, int end) {
+		IntegrateParticles(m_Particles, begin, end, m_VelocityField, params);
+		m_ParticlePool.Expire(m_Particles, begin, end, deltaTime);
+	});
+}
+
+bool ParticleSystem::SaveCheckpoint(const std::string& path) {
+	CheckpointParameters parameters = {};
+	parameters.Width = m_Width;
+	parameters.Height = m_Height;
+	parameters.CellSize = m_CellSize;
+	parameters.StepIndex = m_StepIndex;
+	parameters.ParticleCount = m_Particles.GetCount();
+	parameters.Gravity = gravity;
+	parameters.VorticityEpsilon = vorticityEpsilon;
+	parameters.BuoyancyEpsilon = buoyancyEpsilon;
+	parameters.AdvectionScheme = (uint32_t)advectionScheme;
+	parameters.PressureSolverType = (uint32_t)m_PressureSolver.Type;
+	parameters.PressureTolerance = m_PressureSolver.Tolerance;
+	parameters.PressureMaxIterations = m_PressureSolver.MaxIterations;
+	parameters.PressureOmega = m_PressureSolver.Omega;
+	parameters.Seed = Random::GetSeed();
+	parameters.ParticleCapacity = (uint32_t)m_ParticlePool.GetCapacity();
+
+	CheckpointSettings settings = {};
+	settings.TransferMode = (uint32_t)m_ParticleTransfer.Mode;
+	settings.SeededTransferMode = (uint32_t)m_ParticleTransfer.GetSeededMode();
+	settings.FlipRatio = m_ParticleTransfer.FlipRatio;
+	settings.SphEnabled = sph.Enabled ? 1 : 0;
+	settings.SphRadius = sph.Radius;
+	settings.SphRestDensity = sph.RestDensity;
+	settings.SphStiffness = sph.Stiffness;
+	settings.SphViscosity = sph.Viscosity;
+	settings.ParticleSortInterval = particleSortInterval;
+	settings.ParticleCompactInterval = particleCompactInterval;
+	settings.ActiveTilesEnabled = activeTiles.Enabled ? 1 : 0;
+	settings.ActiveVelocityThreshold = activeTiles.VelocityThreshold;
+	settings.ActiveVorticityThreshold = activeTiles.VorticityThreshold;
+	settings.ActiveCloudWaterThreshold = activeTiles.CloudWaterThreshold;
+
+	CheckpointWriter writer;
+	writer.AddSection("parameters", CheckpointElement::Bytes, &parameters, sizeof(parameters), sizeof(parameters));
+	writer.AddSection("settings", CheckpointElement::Bytes, &settings, sizeof(settings), sizeof(settings));
+	writer.AddSection("velocity", CheckpointElement::Vec2Float32, m_VelocityField.GetData(), m_VelocityField.GetSize(), m_VelocityField.GetSize() * sizeof(glm::vec2));
+	const std::pair<const char*, const Grid2D<float>*> fields[] = {
+		{ "temperature", &m_TemperatureField }, { "vapor", &m_VaporField }, { "cloud_water", &m_CloudWaterField },
+		{ "pressure", &m_PressureField }, { "projection_pressure", &m_ProjectionPressureField } };
+	for (const auto& field : fields)
+		writer.AddSection(field.first, CheckpointElement::Float32, field.second->GetData(), field.second->GetSize(), field.second->GetSize() * sizeof(float));
+
+	const auto attributes = m_Particles.GetAttributes();
+	std::vector<std::string> names(attributes.size());
+	for (size_t i = 0; i < attributes.size(); ++i) {
+		names[i] = std::string("particle_") + ParticleStore::GetAttributeName(i);
+		writer.AddSection(names[i].c_str(), CheckpointElement::Float32, attributes[i]->data(), m_Particles.GetCount(), m_Particles.GetCount() * sizeof(float));
+	}
+	return writer.Write(path, m_ThreadPool);
+}
+
+bool ParticleSystem::ReadCheckpointProps(const std::string& path, ParticleSystemProps& props) {
+	CheckpointReader reader;
+	CheckpointParameters parameters;
+	ThreadPool pool(1);
+	if (!reader.Open(path) || !reader.ReadSection("parameters", CheckpointElement::Bytes, &parameters, sizeof(parameters), sizeof(parameters), pool))
+		return false;
+
+	props.Width = parameters.Width;
+	props.Height = parameters.Height;
+	props.CellSize = parameters.CellSize;
+	props.ParticleCount = (size_t)parameters.ParticleCount;
+	props.ParticleCapacity = parameters.ParticleCapacity;
+	props.Gravity = parameters.Gravity;
+	props.VorticityEpsilon = parameters.VorticityEpsilon;
+	props.BuoyancyEpsilon = parameters.BuoyancyEpsilon;
+	return true;
+}
+
+bool ParticleSystem::LoadCheckpoint(const std::string& path) {
+	CheckpointReader reader;
+	CheckpointParameters parameters;
+	if (!reader.Open(path) || !reader.ReadSection("parameters", CheckpointElement::Bytes, &parameters, sizeof(parameters), sizeof(parameters), m_ThreadPool))
+		return false;
+	if (parameters.Width != m_Width || parameters.Height != m_Height || parameters.CellSize != m_CellSize ||
+		parameters.ParticleCount > m_ParticlePool.GetCapacity()) {
+		LOG_ERROR("Checkpoint '{0}' holds a {1}x{2} grid with {3} particles, this system has a {4}x{5} grid with room for {6}",
+			path, parameters.Width, parameters.Height, parameters.ParticleCount, m_Width, m_Height, m_ParticlePool.GetCapacity());
+		return false;
+	}
+
+	// Version 1 checkpoints leave the settings as they are.
+	CheckpointSettings settings;
+	const bool hasSettings = reader.FindSection("settings") != nullptr;
+	if (hasSettings && !reader.ReadSection("settings", CheckpointElement::Bytes, &settings, sizeof(settings), sizeof(settings), m_ThreadPool))
+		return false;
+	const uint32_t lastTransferMode = (uint32_t)ParticleTransferMode::APIC;
+	if (parameters.AdvectionScheme > (uint32_t)AdvectionScheme::MacCormack || parameters.PressureSolverType > (uint32_t)PressureSolverType::Multigrid ||
+		(hasSettings && (settings.TransferMode > lastTransferMode || settings.SeededTransferMode > lastTransferMode))) {
+		LOG_ERROR("Checkpoint '{0}' names an unknown advection scheme, pressure solver or transfer mode", path);
+		return false;
+	}
+
+	// Every section is checked before any of them is copied, so a damaged or mismatched
+	// checkpoint leaves the system as it was.
+	const size_t particleCount = (size_t)parameters.ParticleCount;
+	const std::pair<const char*, Grid2D<float>*> fields[] = {
+		{ "temperature", &m_TemperatureField }, { "vapor", &m_VaporField }, { "cloud_water", &m_CloudWaterField },
+		{ "pressure", &m_PressureField }, { "projection_pressure", &m_ProjectionPressureField } };
+	std::string attributeNames[ParticleStore::AttributeCount];
+	bool hasAttribute[ParticleStore::AttributeCount];
+	bool valid = reader.VerifySection("velocity", CheckpointElement::Vec2Float32, m_VelocityField.GetSize(), m_VelocityField.GetSize() * sizeof(glm::vec2), m_ThreadPool);
+	for (const auto& field : fields)
+		valid = valid && reader.VerifySection(field.first, CheckpointElement::Float32, field.second->GetSize(), field.second->GetSize() * sizeof(float), m_ThreadPool);
+	for (size_t i = 0; i < ParticleStore::AttributeCount; ++i) {
+		attributeNames[i] = std::string("particle_") + ParticleStore::GetAttributeName(i);
+		// Attributes added after a checkpoint was written start at zero.
+		hasAttribute[i] = i < ParticleStore::RequiredAttributeCount || reader.FindSection(attributeNames[i].c_str());
+		if (hasAttribute[i])
+			valid = valid && reader.VerifySection(attributeNames[i].c_str(), CheckpointElement::Float32, particleCount, particleCount * sizeof(float), m_ThreadPool);
+	}
+	if (!valid)
+		return false;
+
+	reader.CopySection("velocity", m_VelocityField.GetData(), m_ThreadPool);
+	for (const auto& field : fields)
+		reader.CopySection(field.first, field.second->GetData(), m_ThreadPool);
+	m_Particles.Resize(particleCount);
+	const auto attributes = m_Particles.GetAttributes();
+	for (size_t i = 0; i < attributes.size(); ++i) {
+		if (hasAttribute[i])
+			reader.CopySection(attributeNames[i].c_str(), attributes[i]->data(), m_ThreadPool);
+		else
+			std::fill(attributes[i]->begin(), attributes[i]->end(), 0.0f);
+	}
+
+	m_StepIndex = parameters.StepIndex;
+	gravity = parameters.Gravity;
+	vorticityEpsilon = parameters.VorticityEpsilon;
+	buoyancyEpsilon = parameters.BuoyancyEpsilon;
+	advectionScheme = (AdvectionScheme)parameters.AdvectionScheme;
+	m_PressureSolver.Type = (PressureSolverType)parameters.PressureSolverType;
+	m_PressureSolver.Tolerance = parameters.PressureTolerance;
+	m_PressureSolver.MaxIterations = parameters.PressureMaxIterations;
+	m_PressureSolver.Omega = parameters.PressureOmega;
+	Random::Init(parameters.Seed);
+	UpdateExnerFields();
+	if (hasSettings) {
+		m_ParticleTransfer.Mode = (ParticleTransferMode)settings.TransferMode;
+		m_ParticleTransfer.FlipRatio = settings.FlipRatio;
+		// The particles carry on with the state they were saved with, and are only
+		// seeded again if the mode changes before the next step.
+		m_ParticleTransfer.SetSeededMode((ParticleTransferMode)settings.SeededTransferMode);
+		sph.Enabled = settings.SphEnabled != 0;
+		sph.Radius = settings.SphRadius;
+		sph.RestDensity = settings.SphRestDensity;
+		sph.Stiffness = settings.SphStiffness;
+		sph.Viscosity = settings.SphViscosity;
+		particleSortInterval = settings.ParticleSortInterval;
+		particleCompactInterval = settings.ParticleCompactInterval;
+		activeTiles.Enabled = settings.ActiveTilesEnabled != 0;
+		activeTiles.VelocityThreshold = settings.ActiveVelocityThreshold;
+		activeTiles.VorticityThreshold = settings.ActiveVorticityThreshold;
+		activeTiles.CloudWaterThreshold = settings.ActiveCloudWaterThreshold;
+	}
+	else
+		m_ParticleTransfer.Reset();
+
+	// Nothing that described the old particles applies to the loaded ones. The free
+	// slots are the ones the checkpoint marks free, the cell index is rebuilt for them,
+	// and the order says every particle stayed where it is, since none of them can be
+	// followed across the load.
+	m_ParticlePool.Reset(m_Particles, m_ParticlePool.GetCapacity());
+	m_CellIndex.Bin(m_Particles, m_InvCellSize, m_ThreadPool);
+	m_ParticleOrder.resize(particleCount);
+	std::iota(m_ParticleOrder.begin(), m_ParticleOrder.end(), 0u);
+	++m_ParticleOrderVersion;
+	return true;
 }
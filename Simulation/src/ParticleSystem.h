@@ -1,8 +1,24 @@
 #pragma once
 
-#include <GLCore.h>
-#include <GLCoreUtils.h>
-#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include "GLCore/Core/Timestep.h"
+#include "ActiveTiles.h"
+#include "AdvectionKernels.h"
+#include "BoundaryConditions.h"
+#include "CellIndex.h"
+#include "Grid2D.h"
+#include "ParticleEmitter.h"
+#include "ParticlePool.h"
+#include "ParticleStore.h"
+#include "ParticleTransfer.h"
+#include "PressureSolver.h"
+#include "SphSolver.h"
+#include "TaskGraph.h"
+#include "ThreadPool.h"
 
 struct Particle
 {
@@ -16,48 +32,222 @@ struct Particle
 	float Qc;
 };
 
+struct ParticleSystemProps
+{
+	int Width = 100;
+	int Height = 100;
+	float CellSize = 0.01f;
+	size_t ParticleCount = 10000;
+	// Most particles the emitters can grow the system to, ParticleCount when it is less.
+	size_t ParticleCapacity = 0;
+	float Gravity = -0.1f;
+	float VorticityEpsilon = 0.001f;
+	float BuoyancyEpsilon = 0.02f;
+};
+
+// Boundary conditions of the fields the particle system keeps. An inflow bottom without
+// a profile on the temperature or vapor is fed the randomly perturbed ground values
+// the atmosphere is heated and moistened by.
+struct FieldBoundarySettings
+{
+	FieldBoundaries<glm::vec2> Velocity = {
+		{ BoundaryType::NoSlip }, { BoundaryType::NoSlip }, { BoundaryType::NoSlip }, { BoundaryType::FreeSlip } };
+	FieldBoundaries<float> Temperature = {
+		{ BoundaryType::Dirichlet, 250.0f }, { BoundaryType::Dirichlet, 250.0f }, { BoundaryType::Inflow }, { BoundaryType::Dirichlet, 250.0f } };
+	FieldBoundaries<float> Vapor = {
+		{ BoundaryType::Periodic }, { BoundaryType::Periodic }, { BoundaryType::Inflow }, { BoundaryType::Dirichlet, 0.0f } };
+	FieldBoundaries<float> CloudWater = FieldBoundaries<float>::All(BoundaryType::Dirichlet, 0.0f);
+};
+
 class ParticleSystem
 {
 public:
-	ParticleSystem();
+	ParticleSystem(const ParticleSystemProps& props = ParticleSystemProps());
 
 	void OnUpdate(GLCore::Timestep ts);
-	void OnRender(GLCore::Utils::OrthographicCamera& camera);
-	void CheckCollisions(const int particleIndex);
-	float CalculateBuoyancyForce(const int x, const int y);
-	std::array<std::array<float, 100>, 100> CalculateVorticity(const std::array<std::array<glm::vec2, 100>, 100>& velocityField);
-	std::array<std::array<glm::vec2, 100>, 100> ComputeNormalizedVorticityGradient(
-		const std::array<std::array<float, 100>, 100>& vorticityField);
-	void ApplyVorticityConfinement(
-		std::array<std::array<glm::vec2, 100>, 100>& velocityField,
-		const std::array<std::array<float, 100>, 100>& vorticityField,
-		const std::array<std::array<glm::vec2, 100>, 100>& vorticityGradient,
-		float deltaTime);
-	void UpdateWaterVaporField(std::array<std::array<float, 100>, 100>& temperatureField,
-		const std::array<std::array<float, 100>, 100>& pressureField, std::array<std::array<float, 100>, 100> vaporField,
-		std::array<std::array<float, 100>, 100> cloudWaterField);
-	std::array<std::array<float, 100>, 100> ComputeDivergence(
-		const std::array<std::array<glm::vec2, 100>, 100>& velocityField);
+	// Adds the vorticity confinement and buoyancy forces to velocityField in one pass,
+	// writing the result to newVelocity.
+	void ApplyVorticityAndBuoyancy(const Grid2D<glm::vec2>& velocityField,
+		Grid2D<glm::vec2>& newVelocity, float deltaTime);
+	// Condenses and evaporates water in place against the base pressure field, heating
+	// or cooling the temperature field by the latent heat involved.
+	void UpdateWaterVaporField(Grid2D<float>& temperatureField,
+		Grid2D<float>& vaporField, Grid2D<float>& cloudWaterField);
+	void ComputeDivergence(
+		const Grid2D<glm::vec2>& velocityField, Grid2D<float>& divergenceField);
+	void SubtractPressureGradient(
+		Grid2D<glm::vec2>& velocityField, const Grid2D<float>& pressureField);
 	void SetBoundaryConditions();
+	void SetVelocityBoundaryConditions();
+	void SetScalarBoundaryConditions();
 	void AdvectVelocityField(
-		const std::array<std::array<glm::vec2, 100>, 100>& oldField,
-		std::array<std::array<glm::vec2, 100>, 100>& newField, float timeStep);
-	void AdvectScalarField(const std::array<std::array<float, 100>, 100>& oldField,
-		const std::array<std::array<glm::vec2, 100>, 100>& velocityField,
-		std::array<std::array<float, 100>, 100>& newField,
-		float deltaTime);
+		const Grid2D<glm::vec2>& oldField,
+		Grid2D<glm::vec2>& newField, float timeStep);
+	void AdvectScalarFields(const Grid2D<glm::vec2>& velocityField, float deltaTime);
+	void UpdateParticles(float deltaTime);
+	// Reorders the particles by cell and rebuilds the cell index.
+	void SortParticles();
+	// Carries the particles onto the grid in the hybrid transfer modes.
+	void TransferParticlesToGrid();
+	// Computes the SPH density of the particles and the forces between them.
+	void ApplyParticleInteractions();
+	// Drops the free slots the dead particles left, keeping the live ones in order.
+	void CompactParticles();
+	// Spawns the particles of the emitters for the next step.
+	void EmitParticles(float deltaTime);
+	int GetWidth() const { return m_Width; }
+	int GetHeight() const { return m_Height; }
+	float GetCellSize() const { return m_CellSize; }
+	glm::vec2 GetDomainSize() const { return m_DomainSize; }
+	// Every slot of the store, including the free ones ParticleStore::IsAlive is false for.
+	const ParticleStore& GetParticles() const { return m_Particles; }
+	const ParticlePool& GetParticlePool() const { return m_ParticlePool; }
+	size_t GetLiveParticleCount() const { return m_Particles.GetCount() - m_ParticlePool.GetFreeCount(); }
+	const Grid2D<glm::vec2>& GetVelocityField() const { return m_VelocityField; }
+	const Grid2D<float>& GetTemperatureField() const { return m_TemperatureField; }
+	const Grid2D<float>& GetVaporField() const { return m_VaporField; }
+	const Grid2D<float>& GetCloudWaterField() const { return m_CloudWaterField; }
+	// Base pressure the microphysics works against, and the pressure of the last projection.
+	const Grid2D<float>& GetPressureField() const { return m_PressureField; }
+	const Grid2D<float>& GetProjectionPressureField() const { return m_ProjectionPressureField; }
+	// Number of steps taken, carried over by checkpoints.
+	uint32_t GetStepIndex() const { return m_StepIndex; }
+
+	// Number of threads the solver kernels are split across, including the caller.
+	void SetThreadCount(uint32_t threadCount) { m_ThreadPool.SetThreadCount(threadCount); }
+	uint32_t GetThreadCount() const { return m_ThreadPool.GetThreadCount(); }
+
+	// Solver used by the projection step, its settings can be changed between steps.
+	PressureSolver& GetPressureSolver() { return m_PressureSolver; }
+	const PressureSolveStats& GetPressureSolveStats() const { return m_PressureSolveStats; }
+
+	// Couples the particles to the grid, passive unless its mode is changed. The mode
+	// and FLIP ratio can be changed between steps.
+	ParticleTransfer& GetParticleTransfer() { return m_ParticleTransfer; }
+	const ParticleTransfer& GetParticleTransfer() const { return m_ParticleTransfer; }
+
+	// Writes everything a run needs to carry on: the fields that persist between steps,
+	// the particles, the step count, the random seed, the parameters and the transfer,
+	// SPH, sorting and active tile settings. The boundaries and emitters are left to the
+	// caller, the boundaries may point at profiles the system does not own.
+	bool SaveCheckpoint(const std::string& path);
+	// Restores a checkpoint saved by a system with the same grid and room for its
+	// particles, ReadCheckpointProps gives the props to construct one with. The saved
+	// settings replace the current ones. A checkpoint that cannot be loaded, damaged or
+	// saved by a different system, leaves this one as it was.
+	bool LoadCheckpoint(const std::string& path);
+	static bool ReadCheckpointProps(const std::string& path, ParticleSystemProps& props);
+
+	// Particles bucketed by cell as of their last sort, or their last scatter in the
+	// hybrid transfer modes.
+	const CellIndex& GetCellIndex() const { return m_CellIndex; }
+	// Goes up every time the particles are reordered, by a sort or a compaction.
+	// Particle i before a change is not particle i after it, GetParticleOrder gives the
+	// index each particle had before the last one.
+	uint32_t GetParticleOrderVersion() const { return m_ParticleOrderVersion; }
+	const std::vector<uint32_t>& GetParticleOrder() const { return m_ParticleOrder; }
+
+	// Stages OnUpdate runs, with the timings of the last step.
+	const TaskGraph& GetStepGraph() const { return m_StepGraph; }
+
+	// Share of the grid the advection, vorticity and microphysics kernels covered in the
+	// last step, 1 unless activeTiles is enabled.
+	float GetActiveTileFraction() const { return m_TileMask.GetActiveFraction(); }
+
 	float vorticityEpsilon;
 	float buoyancyEpsilon;
 	float gravity;
-	std::string frames_per_second;
+	AdvectionScheme advectionScheme;
+	// Lets the advection, vorticity and microphysics kernels skip tiles where nothing
+	// is happening. Quiescent tiles keep their values, which is an approximation as
+	// long as the thresholds are not 0.
+	ActiveTileSettings activeTiles;
+	// Applied to the edge cells of every field, the ghost layer the kernels read.
+	FieldBoundarySettings boundaries;
+	// The particles are sorted by cell every this many steps, so their grid gathers
+	// stay close to sequential. 0 never sorts them.
+	uint32_t particleSortInterval;
+	// Density, pressure and viscosity between the particles, off by default.
+	SphSettings sph;
+	// The free slots of dead particles are compacted away every this many steps, when
+	// no sort does it first. 0 leaves them to the sorts.
+	uint32_t particleCompactInterval;
+	// Sources of new particles, none by default.
+	std::vector<ParticleEmitter> emitters;
 private:
-	std::vector<Particle> m_ParticlePool;
-	std::array<std::array<glm::vec2, 100>, 100> m_VelocityField;
-	std::array<std::array<float, 100>, 100> m_TemperatureField;
-	std::array<std::array<float, 100>, 100> m_VaporField;
-	std::array<std::array<float, 100>, 100> m_CloudWaterField;
-	std::array<std::array<float, 100>, 100> m_PressureField;
-	GLuint m_QuadVA = 0;
-	std::unique_ptr<GLCore::Utils::Shader> m_ParticleShader;
-	GLint m_ParticleShaderViewProj, m_ParticleShaderTransform, m_ParticleShaderColor;
+	// Recomputes the Exner fields, must be called whenever m_PressureField changes.
+	void UpdateExnerFields();
+	void BuildStepGraph();
+	// Runs fn(tile) for every tile, spread across the pool.
+	template<typename Fn>
+	void ForEachTile(const std::vector<TileRange>& tiles, Fn&& fn)
+	{
+		m_ThreadPool.ParallelFor(0, (int)tiles.size(), [&](int begin, int end) {
+			for (int i = begin; i < end; ++i)
+				fn(tiles[i]);
+		});
+	}
+	// Carries source over to destination on the tiles the kernels skipped, so fields
+	// that are swapped with their back buffers keep their values there.
+	template<typename T>
+	void CopyInactiveTiles(const Grid2D<T>& source, Grid2D<T>& destination)
+	{
+		ForEachTile(m_TileMask.GetInactiveTiles(), [&](const TileRange& tile) {
+			for (int y = tile.YBegin; y < tile.YEnd; ++y)
+				std::copy(source[y] + tile.XBegin, source[y] + tile.XEnd, destination[y] + tile.XBegin);
+		});
+	}
+	int m_Width, m_Height;
+	float m_CellSize, m_InvCellSize;
+	// Physical extent of the grid, particles live in [0, m_DomainSize].
+	glm::vec2 m_DomainSize;
+
+	ThreadPool m_ThreadPool;
+	ParticleStore m_Particles;
+	ParticlePool m_ParticlePool;
+	ParticleSpawner m_ParticleSpawner;
+	Grid2D<glm::vec2> m_VelocityField;
+	Grid2D<float> m_TemperatureField;
+	Grid2D<float> m_VaporField;
+	Grid2D<float> m_CloudWaterField;
+	Grid2D<float> m_PressureField;
+	// (p / p0)^kappa and its reciprocal, derived from m_PressureField.
+	Grid2D<float> m_ExnerField;
+	Grid2D<float> m_InvExnerField;
+
+	// Back buffers written by advection and swapped with the fields above,
+	// plus scratch fields reused every step so OnUpdate does not allocate.
+	Grid2D<glm::vec2> m_VelocityFieldBack;
+	Grid2D<float> m_TemperatureFieldBack;
+	Grid2D<float> m_VaporFieldBack;
+	Grid2D<float> m_CloudWaterFieldBack;
+	Grid2D<float> m_DivergenceField;
+	// Traced sample positions, and the MacCormack outputs swapped into the back buffers.
+	Grid2D<glm::vec2> m_BackTrace, m_ForwardTrace;
+	Grid2D<glm::vec2> m_MacCormackVelocity;
+	Grid2D<float> m_MacCormackScalars[3];
+
+	// Pressure that makes the velocity divergence free. It is kept between steps as the
+	// solver's initial guess and is separate from the base pressure in m_PressureField.
+	Grid2D<float> m_ProjectionPressureField;
+	PressureSolver m_PressureSolver;
+	PressureSolveStats m_PressureSolveStats;
+
+	ParticleTransfer m_ParticleTransfer;
+	SphSolver m_SphSolver;
+
+	CellIndex m_CellIndex;
+	uint32_t m_ParticleOrderVersion = 0;
+	std::vector<uint32_t> m_ParticleOrder;
+
+	// Tiles the sparse kernels cover this step, rebuilt at the start of every step.
+	ActiveTileMask m_TileMask;
+
+	// Stages of OnUpdate and the time step the current run of them uses.
+	TaskGraph m_StepGraph;
+	float m_StepTime = 0.0f;
+	// Steps taken so far, which keys the random boundary forcing of the next step.
+	uint32_t m_StepIndex = 0;
+	// Ground values of the current step, for inflow bottoms without a profile.
+	std::vector<float> m_GroundTemperature, m_GroundVapor;
 };
\ No newline at end of file
@@ -0,0 +1,254 @@
+#include "ParticleTransfer.h"
+
+#include <algorithm>
+
+namespace {
+
+	// Rows of cells in a scatter band. A particle writes its own row and the one above,
+	// so a band writes one row past its end and bands two apart never share a row.
+	const int s_BandRows = 8;
+
+	// The four cells around a particle and their bilinear weights, on the grid the
+	// advection samples, where cell (x, y) sits at (x, y) * cellSize. The particle is
+	// clamped to the grid the same way CellIndex bins it, so (X0, Y0) is its cell.
+	struct Stencil
+	{
+		size_t Index00, Index10, Index01, Index11;
+		float FracX, FracY;
+		float Weight00, Weight10, Weight01, Weight11;
+	};
+
+	inline Stencil Locate(float positionX, float positionY, float invCellSize, int width, int height)
+	{
+		const float x = std::min(std::max(positionX * invCellSize, 0.0f), (float)(width - 1));
+		const float y = std::min(std::max(positionY * invCellSize, 0.0f), (float)(height - 1));
+		const int x0 = (int)x, y0 = (int)y;
+		const int x1 = std::min(x0 + 1, width - 1);
+		const int y1 = std::min(y0 + 1, height - 1);
+
+		Stencil s;
+		s.Index00 = (size_t)y0 * width + x0;
+		s.Index10 = (size_t)y0 * width + x1;
+		s.Index01 = (size_t)y1 * width + x0;
+		s.Index11 = (size_t)y1 * width + x1;
+		s.FracX = x - (float)x0;
+		s.FracY = y - (float)y0;
+		s.Weight00 = (1.0f - s.FracX) * (1.0f - s.FracY);
+		s.Weight10 = s.FracX * (1.0f - s.FracY);
+		s.Weight01 = (1.0f - s.FracX) * s.FracY;
+		s.Weight11 = s.FracX * s.FracY;
+		return s;
+	}
+
+	template<typename T>
+	inline T Blend(const T* data, const Stencil& s)
+	{
+		return data[s.Index00] * s.Weight00 + data[s.Index10] * s.Weight10 + data[s.Index01] * s.Weight01 + data[s.Index11] * s.Weight11;
+	}
+
+	// Velocity and scalar fields the gather reads, as the grid has them now or as the
+	// scatter left them.
+	struct FieldSet
+	{
+		const glm::vec2* Velocity;
+		const float* Scalars[3];
+	};
+
+	// Sets particle i from the grid. previous is what FLIP measures the change against
+	// and is only read in FLIP mode.
+	void Gather(ParticleStore& p, size_t i, const Stencil& s, const FieldSet& current, const FieldSet& previous,
+		ParticleTransferMode mode, float flipRatio, float invCellSize)
+	{
+		float* scalars[] = { p.Temperature.data(), p.Qv.data(), p.Qc.data() };
+		const glm::vec2 velocity = Blend(current.Velocity, s);
+		if (mode == ParticleTransferMode::FLIP)
+		{
+			const glm::vec2 change = velocity - Blend(previous.Velocity, s);
+			const glm::vec2 flip = glm::vec2(p.VelocityX[i], p.VelocityY[i]) + change;
+			const glm::vec2 blended = flip * flipRatio + velocity * (1.0f - flipRatio);
+			p.VelocityX[i] = blended.x;
+			p.VelocityY[i] = blended.y;
+			for (int f = 0; f < 3; ++f)
+			{
+				const float value = Blend(current.Scalars[f], s);
+				const float flipValue = scalars[f][i] + value - Blend(previous.Scalars[f], s);
+				scalars[f][i] = flipValue * flipRatio + value * (1.0f - flipRatio);
+			}
+			return;
+		}
+
+		p.VelocityX[i] = velocity.x;
+		p.VelocityY[i] = velocity.y;
+		for (int f = 0; f < 3; ++f)
+			scalars[f][i] = Blend(current.Scalars[f], s);
+		if (mode != ParticleTransferMode::APIC)
+			return;
+
+		// Gradient of the bilinear interpolant, sum of each cell's velocity times the
+		// gradient of its weight.
+		const glm::vec2* v = current.Velocity;
+		const float gx0 = (1.0f - s.FracY) * invCellSize, gx1 = s.FracY * invCellSize;
+		const float gy0 = (1.0f - s.FracX) * invCellSize, gy1 = s.FracX * invCellSize;
+		const glm::vec2 dx = (v[s.Index10] - v[s.Index00]) * gx0 + (v[s.Index11] - v[s.Index01]) * gx1;
+		const glm::vec2 dy = (v[s.Index01] - v[s.Index00]) * gy0 + (v[s.Index11] - v[s.Index10]) * gy1;
+		p.AffineXX[i] = dx.x;
+		p.AffineXY[i] = dy.x;
+		p.AffineYX[i] = dx.y;
+		p.AffineYY[i] = dy.y;
+	}
+
+}
+
+void ParticleTransfer::Resize(int width, int height, float cellSize)
+{
+	m_Velocity.Resize(width, height, cellSize);
+	for (Grid2D<float>& scalars : m_Scalars)
+		scalars.Resize(width, height, cellSize);
+	m_Weight.Resize(width, height, cellSize);
+	m_SeededMode = ParticleTransferMode::Passive;
+}
+
+void ParticleTransfer::ParticlesToGrid(ParticleStore& particles, CellIndex& cellIndex, float invCellSize,
+	Grid2D<glm::vec2>& velocityField, Grid2D<float>& temperatureField,
+	Grid2D<float>& vaporField, Grid2D<float>& cloudWaterField, ThreadPool& pool)
+{
+	m_SeededMode = m_SeededMode == Mode ? m_SeededMode : ParticleTransferMode::Passive;
+	if (Mode == ParticleTransferMode::Passive)
+		return;
+
+	const int width = velocityField.GetWidth();
+	const int height = velocityField.GetHeight();
+	const float cellSize = velocityField.GetCellSize();
+	Grid2D<float>* fields[] = { &temperatureField, &vaporField, &cloudWaterField };
+	const FieldSet current = { velocityField.GetData(), { fields[0]->GetData(), fields[1]->GetData(), fields[2]->GetData() } };
+
+	if (m_SeededMode == ParticleTransferMode::Passive)
+	{
+		const ParticleTransferMode seedMode = Mode == ParticleTransferMode::APIC ? ParticleTransferMode::APIC : ParticleTransferMode::PIC;
+		pool.ParallelFor(0, (int)particles.GetCount(), [&](int begin, int end) {
+			for (int i = begin; i < end; ++i)
+			{
+				const Stencil s = Locate(particles.PositionX[i], particles.PositionY[i], invCellSize, width, height);
+				Gather(particles, i, s, current, current, seedMode, FlipRatio, invCellSize);
+			}
+		});
+		m_SeededMode = Mode;
+	}
+
+	pool.ParallelFor(0, height, [&](int begin, int end) {
+		for (int y = begin; y < end; ++y)
+		{
+			std::fill(m_Velocity[y], m_Velocity[y] + width, glm::vec2(0.0f));
+			for (Grid2D<float>& scalars : m_Scalars)
+				std::fill(scalars[y], scalars[y] + width, 0.0f);
+			std::fill(m_Weight[y], m_Weight[y] + width, 0.0f);
+		}
+	});
+
+	cellIndex.Bin(particles, invCellSize, pool);
+	const std::vector<uint32_t>& cellParticles = cellIndex.GetCellParticles();
+	const bool affine = Mode == ParticleTransferMode::APIC;
+	const float* scalars[] = { particles.Temperature.data(), particles.Qv.data(), particles.Qc.data() };
+	auto scatterBand = [&](int band) {
+		glm::vec2* momentum = m_Velocity.GetData();
+		float* sums[] = { m_Scalars[0].GetData(), m_Scalars[1].GetData(), m_Scalars[2].GetData() };
+		float* weight = m_Weight.GetData();
+		const int yEnd = std::min((band + 1) * s_BandRows, height);
+		for (int y = band * s_BandRows; y < yEnd; ++y)
+		{
+			for (uint32_t k = cellIndex.GetCellStart(0, y); k < cellIndex.GetCellEnd(width - 1, y); ++k)
+			{
+				const uint32_t i = cellParticles[k];
+				const Stencil s = Locate(particles.PositionX[i], particles.PositionY[i], invCellSize, width, height);
+				const size_t cells[] = { s.Index00, s.Index10, s.Index01, s.Index11 };
+				const float weights[] = { s.Weight00, s.Weight10, s.Weight01, s.Weight11 };
+				const glm::vec2 velocity = { particles.VelocityX[i], particles.VelocityY[i] };
+				// Offsets from the particle to the four cells, for the affine velocity.
+				const float offsetX[] = { -s.FracX, 1.0f - s.FracX, -s.FracX, 1.0f - s.FracX };
+				const float offsetY[] = { -s.FracY, -s.FracY, 1.0f - s.FracY, 1.0f - s.FracY };
+				for (int c = 0; c < 4; ++c)
+				{
+					glm::vec2 cellVelocity = velocity;
+					if (affine)
+					{
+						const float dx = offsetX[c] * cellSize, dy = offsetY[c] * cellSize;
+						cellVelocity.x += particles.AffineXX[i] * dx + particles.AffineXY[i] * dy;
+						cellVelocity.y += particles.AffineYX[i] * dx + particles.AffineYY[i] * dy;
+					}
+					momentum[cells[c]] += cellVelocity * weights[c];
+					for (int f = 0; f < 3; ++f)
+						sums[f][cells[c]] += scalars[f][i] * weights[c];
+					weight[cells[c]] += weights[c];
+				}
+			}
+		}
+	};
+	// Even bands, then odd ones.
+	const int bandCount = (height + s_BandRows - 1) / s_BandRows;
+	for (int parity = 0; parity < 2; ++parity)
+	{
+		pool.ParallelFor(0, (bandCount - parity + 1) / 2, [&](int begin, int end) {
+			for (int b = begin; b < end; ++b)
+				scatterBand(2 * b + parity);
+		});
+	}
+
+	// Cells no particle reached keep the field's value, so FLIP sees only the grid's
+	// own change there too.
+	pool.ParallelFor(0, height, [&](int begin, int end) {
+		for (int y = begin; y < end; ++y)
+		{
+			const float* weight = m_Weight[y];
+			for (int x = 0; x < width; ++x)
+			{
+				if (weight[x] > 0.0f)
+				{
+					const float invWeight = 1.0f / weight[x];
+					velocityField[y][x] = m_Velocity[y][x] *= invWeight;
+					for (int f = 0; f < 3; ++f)
+						(*fields[f])[y][x] = m_Scalars[f][y][x] *= invWeight;
+				}
+				else
+				{
+					m_Velocity[y][x] = velocityField[y][x];
+					for (int f = 0; f < 3; ++f)
+						m_Scalars[f][y][x] = (*fields[f])[y][x];
+				}
+			}
+		}
+	});
+}
+
+void ParticleTransfer::GridToParticles(ParticleStore& particles, size_t begin, size_t end,
+	const Grid2D<glm::vec2>& velocityField, const Grid2D<float>& temperatureField,
+	const Grid2D<float>& vaporField, const Grid2D<float>& cloudWaterField,
+	const GridToParticleParams& params) const
+{
+	const int width = velocityField.GetWidth();
+	const int height = velocityField.GetHeight();
+	const FieldSet current = { velocityField.GetData(), { temperatureField.GetData(), vaporField.GetData(), cloudWaterField.GetData() } };
+	const FieldSet previous = { m_Velocity.GetData(), { m_Scalars[0].GetData(), m_Scalars[1].GetData(), m_Scalars[2].GetData() } };
+	ParticleStore& p = particles;
+	for (size_t i = begin; i < end; ++i)
+	{
+		const Stencil s = Locate(p.PositionX[i], p.PositionY[i], params.InvCellSize, width, height);
+		Gather(p, i, s, current, previous, Mode, FlipRatio, params.InvCellSize);
+		p.VelocityX[i] += p.ForceX[i] * params.DeltaTime;
+		p.VelocityY[i] += p.ForceY[i] * params.DeltaTime;
+
+		float px = p.PositionX[i] + p.VelocityX[i] * params.DeltaTime;
+		float py = p.PositionY[i] + p.VelocityY[i] * params.DeltaTime;
+		// Same walls as the passive particles, put back on the wall with 0.3 of the
+		// velocity into it, reversed.
+		if (px < 0.0f || px > params.DomainSize.x)
+			p.VelocityX[i] *= -0.3f;
+		if (py < 0.0f || py > params.DomainSize.y)
+			p.VelocityY[i] *= -0.3f;
+		px = std::min(std::max(px, 0.0f), params.DomainSize.x);
+		py = std::min(std::max(py, 0.0f), params.DomainSize.y);
+		p.PositionX[i] = px;
+		p.PositionY[i] = py;
+		p.ForceX[i] = 0.0f;
+		p.ForceY[i] = 0.0f;
+	}
+}
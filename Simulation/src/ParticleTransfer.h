@@ -0,0 +1,79 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "CellIndex.h"
+#include "Grid2D.h"
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+
+enum class ParticleTransferMode
+{
+	// Particles are tracers that read the grid velocity and never write back.
+	Passive = 0,
+	PIC,
+	FLIP,
+	APIC
+};
+
+struct GridToParticleParams
+{
+	float DeltaTime;
+	float InvCellSize;
+	glm::vec2 DomainSize;
+};
+
+// Couples the particles to the grid in the hybrid modes. Each step the particles carry
+// their velocity, temperature, vapor and cloud water onto the grid, the grid applies
+// the forces, the microphysics and the projection, and the particles take the result
+// back and move with it. The grid's own advection only fills the cells no particle
+// reached.
+//
+// PIC takes the grid values back as they are, which is stable but smooths away
+// anything smaller than a cell. FLIP only adds the change the grid made since the
+// scatter, which keeps that detail at the cost of some noise, FlipRatio blends the
+// two. APIC takes the grid velocity like PIC but also keeps its gradient around each
+// particle and scatters it back, which keeps the rotation PIC loses without FLIP's
+// noise. The scalars follow the velocity's blend, in APIC mode they are PIC.
+class ParticleTransfer
+{
+public:
+	void Resize(int width, int height, float cellSize);
+
+	// Bins the particles with cellIndex, splats them onto the grid with bilinear
+	// weights and overwrites every cell they reached. Rows are split into bands and
+	// every other band is scattered at once, so no two threads write the same cell and
+	// the sums are added in the same order on any thread count. Does nothing in
+	// passive mode. The first call after the mode changes or Reset seeds the
+	// particles from the grid before scattering, so no stale values reach it.
+	void ParticlesToGrid(ParticleStore& particles, CellIndex& cellIndex, float invCellSize,
+		Grid2D<glm::vec2>& velocityField, Grid2D<float>& temperatureField,
+		Grid2D<float>& vaporField, Grid2D<float>& cloudWaterField, ThreadPool& pool);
+
+	// Updates particles [begin, end) from the grid as the mode says, adds their forces,
+	// moves them with their new velocity and bounces them off the walls.
+	void GridToParticles(ParticleStore& particles, size_t begin, size_t end,
+		const Grid2D<glm::vec2>& velocityField, const Grid2D<float>& temperatureField,
+		const Grid2D<float>& vaporField, const Grid2D<float>& cloudWaterField,
+		const GridToParticleParams& params) const;
+
+	// Makes the next ParticlesToGrid seed the particles again, for when they no longer
+	// match the grid, like after loading a checkpoint that does not say what they hold.
+	void Reset() { m_SeededMode = ParticleTransferMode::Passive; }
+	// Mode the particles hold the state of, Passive when they have to be seeded. A
+	// checkpoint saves it so a resumed run carries on without seeding them again.
+	ParticleTransferMode GetSeededMode() const { return m_SeededMode; }
+	void SetSeededMode(ParticleTransferMode mode) { m_SeededMode = mode; }
+
+	ParticleTransferMode Mode = ParticleTransferMode::Passive;
+	// Share of the FLIP update in FLIP mode, the rest is PIC.
+	float FlipRatio = 0.95f;
+private:
+	// Accumulate the weighted sums during the scatter, then hold the fields as the
+	// scatter left them, which FLIP measures the grid's change against.
+	Grid2D<glm::vec2> m_Velocity;
+	Grid2D<float> m_Scalars[3];
+	Grid2D<float> m_Weight;
+	// Mode the particles were last seeded for, Passive when they have to be again.
+	ParticleTransferMode m_SeededMode = ParticleTransferMode::Passive;
+};
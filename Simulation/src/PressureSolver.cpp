@@ -0,0 +1,362 @@
+#include "PressureSolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+	// Sum of the neighbours of (x, y) that lie inside the grid. Neighbours beyond the
+	// walls are left out, which imposes the zero-gradient (Neumann) condition.
+	inline float NeighbourSum(const Grid2D<float>& p, int x, int y, int& count)
+	{
+		const int width = p.GetWidth();
+		const int height = p.GetHeight();
+		float sum = 0.0f;
+		count = 0;
+		if (x > 0) { sum += p[y][x - 1]; ++count; }
+		if (x < width - 1) { sum += p[y][x + 1]; ++count; }
+		if (y > 0) { sum += p[y - 1][x]; ++count; }
+		if (y < height - 1) { sum += p[y + 1][x]; ++count; }
+		return sum;
+	}
+
+	inline int NeighbourCount(int x, int y, int width, int height)
+	{
+		return (x > 0) + (x < width - 1) + (y > 0) + (y < height - 1);
+	}
+
+	double SumInOrder(const std::vector<double>& rowSums, int rows)
+	{
+		double total = 0.0;
+		for (int y = 0; y < rows; ++y)
+			total += rowSums[y];
+		return total;
+	}
+
+}
+
+void PressureSolver::Resize(int width, int height, float cellSize)
+{
+	m_Rhs.Resize(width, height, cellSize);
+	m_Scratch.Resize(width, height, cellSize);
+	m_Residual.Resize(width, height, cellSize);
+	m_Preconditioned.Resize(width, height, cellSize);
+	m_Direction.Resize(width, height, cellSize);
+	m_AppliedDirection.Resize(width, height, cellSize);
+	m_RowSums.assign(height, 0.0);
+
+	m_Levels.clear();
+	int levelWidth = width, levelHeight = height;
+	float levelCellSize = cellSize;
+	while (std::min(levelWidth, levelHeight) > 4)
+	{
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+		levelCellSize *= 2.0f;
+		Level level;
+		level.Pressure.Resize(levelWidth, levelHeight, levelCellSize);
+		level.Rhs.Resize(levelWidth, levelHeight, levelCellSize);
+		level.Residual.Resize(levelWidth, levelHeight, levelCellSize);
+		m_Levels.push_back(std::move(level));
+	}
+}
+
+PressureSolveStats PressureSolver::Solve(Grid2D<float>& pressure, const Grid2D<float>& rhs, ThreadPool& pool)
+{
+	const int width = rhs.GetWidth();
+	const int height = rhs.GetHeight();
+
+	// With walls on every side the solution is only defined up to a constant and the
+	// right-hand side must integrate to zero, so remove its mean first.
+	pool.ParallelFor(0, height, [&](int yBegin, int yEnd) {
+		for (int y = yBegin; y < yEnd; ++y) {
+			double rowSum = 0.0;
+			for (int x = 0; x < width; ++x)
+				rowSum += rhs[y][x];
+			m_RowSums[y] = rowSum;
+		}
+	});
+	const float mean = (float)(SumInOrder(m_RowSums, height) / ((double)width * height));
+	pool.ParallelFor(0, height, [&](int yBegin, int yEnd) {
+		for (int y = yBegin; y < yEnd; ++y) {
+			double rowSum = 0.0;
+			for (int x = 0; x < width; ++x) {
+				m_Rhs[y][x] = rhs[y][x] - mean;
+				rowSum += (double)m_Rhs[y][x] * m_Rhs[y][x];
+			}
+			m_RowSums[y] = rowSum;
+		}
+	});
+	m_RhsNorm = (float)std::sqrt(SumInOrder(m_RowSums, height));
+
+	PressureSolveStats stats;
+	if (m_RhsNorm == 0.0f)
+		return stats;
+
+	switch (Type)
+	{
+		case PressureSolverType::Jacobi:            stats.Iterations = SolveJacobi(pressure, stats.Residual, pool); break;
+		case PressureSolverType::RedBlackSOR:       stats.Iterations = SolveRedBlackSOR(pressure, stats.Residual, pool); break;
+		case PressureSolverType::ConjugateGradient: stats.Iterations = SolveConjugateGradient(pressure, stats.Residual, pool); break;
+		case PressureSolverType::Multigrid:         stats.Iterations = SolveMultigrid(pressure, stats.Residual, pool); break;
+	}
+	return stats;
+}
+
+int PressureSolver::SolveJacobi(Grid2D<float>& pressure, float& residual, ThreadPool& pool)
+{
+	const int width = pressure.GetWidth();
+	const int height = pressure.GetHeight();
+	const float cellSizeSq = pressure.GetCellSize() * pressure.GetCellSize();
+
+	int iteration = 0;
+	while (iteration < MaxIterations)
+	{
+		// The residual of the current iterate falls out of the same sweep that updates it.
+		pool.ParallelFor(0, height, [&](int yBegin, int yEnd) {
+			for (int y = yBegin; y < yEnd; ++y) {
+				double rowSum = 0.0;
+				for (int x = 0; x < width; ++x) {
+					int count;
+					float sum = NeighbourSum(pressure, x, y, count);
+					float r = m_Rhs[y][x] - (sum - count * pressure[y][x]) / cellSizeSq;
+					rowSum += (double)r * r;
+					m_Scratch[y][x] = (sum - cellSizeSq * m_Rhs[y][x]) / count;
+				}
+				m_RowSums[y] = rowSum;
+			}
+		});
+		residual = (float)std::sqrt(SumInOrder(m_RowSums, height)) / m_RhsNorm;
+		if (residual < Tolerance)
+			break;
+		pressure.Swap(m_Scratch);
+		++iteration;
+	}
+	// Stopping at the cap leaves the residual of the iterate before the last sweep, so
+	// measure the one that is returned.
+	if (iteration == MaxIterations)
+	{
+		ComputeResidual(pressure, m_Rhs, m_Scratch, pool);
+		residual = (float)std::sqrt(SumInOrder(m_RowSums, height)) / m_RhsNorm;
+	}
+	return iteration;
+}
+
+void PressureSolver::RedBlackSweep(Grid2D<float>& pressure, const Grid2D<float>& rhs, float omega, ThreadPool& pool)
+{
+	const int width = pressure.GetWidth();
+	const int height = pressure.GetHeight();
+	const float cellSizeSq = pressure.GetCellSize() * pressure.GetCellSize();
+
+	for (int colour = 0; colour < 2; ++colour)
+	{
+		pool.ParallelFor(0, height, [&](int yBegin, int yEnd) {
+			for (int y = yBegin; y < yEnd; ++y) {
+				for (int x = (y + colour) & 1; x < width; x += 2) {
+					int count;
+					float sum = NeighbourSum(pressure, x, y, count);
+					float gaussSeidel = (sum - cellSizeSq * rhs[y][x]) / count;
+					pressure[y][x] += omega * (gaussSeidel - pressure[y][x]);
+				}
+			}
+		});
+	}
+}
+
+void PressureSolver::ComputeResidual(const Grid2D<float>& pressure, const Grid2D<float>& rhs, Grid2D<float>& residual, ThreadPool& pool)
+{
+	const int width = pressure.GetWidth();
+	const int height = pressure.GetHeight();
+	const float cellSizeSq = pressure.GetCellSize() * pressure.GetCellSize();
+
+	pool.ParallelFor(0, height, [&](int yBegin, int yEnd) {
+		for (int y = yBegin; y < yEnd; ++y) {
+			double rowSum = 0.0;
+			for (int x = 0; x < width; ++x) {
+				int count;
+				float sum = NeighbourSum(pressure, x, y, count);
+				float r = rhs[y][x] - (sum - count * pressure[y][x]) / cellSizeSq;
+				residual[y][x] = r;
+				rowSum += (double)r * r;
+			}
+			// Coarser levels have fewer rows and reuse the front of the array.
+			m_RowSums[y] = rowSum;
+		}
+	});
+}
+
+double PressureSolver::Dot(const Grid2D<float>& a, const Grid2D<float>& b, ThreadPool& pool)
+{
+	const int width = a.GetWidth();
+	const int height = a.GetHeight();
+	pool.ParallelFor(0, height, [&](int yBegin, int yEnd) {
+		for (int y = yBegin; y < yEnd; ++y) {
+			double rowSum = 0.0;
+			for (int x = 0; x < width; ++x)
+				rowSum += (double)a[y][x] * b[y][x];
+			m_RowSums[y] = rowSum;
+		}
+	});
+	return SumInOrder(m_RowSums, height);
+}
+
+int PressureSolver::SolveRedBlackSOR(Grid2D<float>& pressure, float& residual, ThreadPool& pool)
+{
+	const int height = pressure.GetHeight();
+
+	int iteration = 0;
+	ComputeResidual(pressure, m_Rhs, m_Scratch, pool);
+	residual = (float)std::sqrt(SumInOrder(m_RowSums, height)) / m_RhsNorm;
+	while (iteration < MaxIterations && residual >= Tolerance)
+	{
+		RedBlackSweep(pressure, m_Rhs, Omega, pool);
+		ComputeResidual(pressure, m_Rhs, m_Scratch, pool);
+		residual = (float)std::sqrt(SumInOrder(m_RowSums, height)) / m_RhsNorm;
+		++iteration;
+	}
+	return iteration;
+}
+
+int PressureSolver::SolveConjugateGradient(Grid2D<float>& pressure, float& residual, ThreadPool& pool)
+{
+	const int width = pressure.GetWidth();
+	const int height = pressure.GetHeight();
+	const float cellSizeSq = pressure.GetCellSize() * pressure.GetCellSize();
+
+	// CG needs a positive definite operator, so solve -lap(p) = -rhs. The diagonal of
+	// -lap is the neighbour count over h^2 and serves as a Jacobi preconditioner.
+	ComputeResidual(pressure, m_Rhs, m_Residual, pool);
+	pool.ParallelFor(0, height, [&](int yBegin, int yEnd) {
+		for (int y = yBegin; y < yEnd; ++y) {
+			for (int x = 0; x < width; ++x) {
+				m_Residual[y][x] = -m_Residual[y][x];
+				m_Preconditioned[y][x] = m_Residual[y][x] * cellSizeSq / NeighbourCount(x, y, width, height);
+				m_Direction[y][x] = m_Preconditioned[y][x];
+			}
+		}
+	});
+	double residualDotPreconditioned = Dot(m_Residual, m_Preconditioned, pool);
+	residual = (float)std::sqrt(Dot(m_Residual, m_Residual, pool)) / m_RhsNorm;
+
+	int iteration = 0;
+	while (iteration < MaxIterations && residual >= Tolerance)
+	{
+		// q = -lap(d)
+		pool.ParallelFor(0, height, [&](int yBegin, int yEnd) {
+			for (int y = yBegin; y < yEnd; ++y) {
+				for (int x = 0; x < width; ++x) {
+					int count;
+					float sum = NeighbourSum(m_Direction, x, y, count);
+					m_AppliedDirection[y][x] = (count * m_Direction[y][x] - sum) / cellSizeSq;
+				}
+			}
+		});
+		double curvature = Dot(m_Direction, m_AppliedDirection, pool);
+		if (curvature <= 0.0)
+			break;
+		const float alpha = (float)(residualDotPreconditioned / curvature);
+
+		pool.ParallelFor(0, height, [&](int yBegin, int yEnd) {
+			for (int y = yBegin; y < yEnd; ++y) {
+				double rowSum = 0.0;
+				for (int x = 0; x < width; ++x) {
+					pressure[y][x] += alpha * m_Direction[y][x];
+					m_Residual[y][x] -= alpha * m_AppliedDirection[y][x];
+					m_Preconditioned[y][x] = m_Residual[y][x] * cellSizeSq / NeighbourCount(x, y, width, height);
+					rowSum += (double)m_Residual[y][x] * m_Residual[y][x];
+				}
+				m_RowSums[y] = rowSum;
+			}
+		});
+		residual = (float)std::sqrt(SumInOrder(m_RowSums, height)) / m_RhsNorm;
+		++iteration;
+		if (residual < Tolerance)
+			break;
+
+		double newResidualDotPreconditioned = Dot(m_Residual, m_Preconditioned, pool);
+		const float beta = (float)(newResidualDotPreconditioned / residualDotPreconditioned);
+		residualDotPreconditioned = newResidualDotPreconditioned;
+		pool.ParallelFor(0, height, [&](int yBegin, int yEnd) {
+			for (int y = yBegin; y < yEnd; ++y) {
+				for (int x = 0; x < width; ++x)
+					m_Direction[y][x] = m_Preconditioned[y][x] + beta * m_Direction[y][x];
+			}
+		});
+	}
+	return iteration;
+}
+
+void PressureSolver::VCycle(size_t depth, Grid2D<float>& pressure, const Grid2D<float>& rhs, ThreadPool& pool)
+{
+	if (depth == m_Levels.size())
+	{
+		// The coarsest grid is tiny, relax it until it is effectively solved.
+		for (int i = 0; i < 50; ++i)
+			RedBlackSweep(pressure, rhs, 1.0f, pool);
+		return;
+	}
+
+	const int width = pressure.GetWidth();
+	const int height = pressure.GetHeight();
+	Grid2D<float>& residual = depth == 0 ? m_Scratch : m_Levels[depth - 1].Residual;
+	Level& coarse = m_Levels[depth];
+	const int coarseWidth = coarse.Rhs.GetWidth();
+	const int coarseHeight = coarse.Rhs.GetHeight();
+
+	RedBlackSweep(pressure, rhs, 1.0f, pool);
+	RedBlackSweep(pressure, rhs, 1.0f, pool);
+	ComputeResidual(pressure, rhs, residual, pool);
+
+	// Restrict by integrating the residual over each coarse cell and dividing by its
+	// area. Where a fine dimension is odd the last coarse cells overhang the grid and
+	// the missing fine cells count as zero, which keeps the coarse residual summing to
+	// zero so the coarse all-Neumann problem stays solvable.
+	pool.ParallelFor(0, coarseHeight, [&](int yBegin, int yEnd) {
+		for (int cy = yBegin; cy < yEnd; ++cy) {
+			for (int cx = 0; cx < coarseWidth; ++cx) {
+				float sum = 0.0f;
+				for (int y = 2 * cy; y < std::min(2 * cy + 2, height); ++y)
+					for (int x = 2 * cx; x < std::min(2 * cx + 2, width); ++x)
+						sum += residual[y][x];
+				coarse.Rhs[cy][cx] = 0.25f * sum;
+				coarse.Pressure[cy][cx] = 0.0f;
+			}
+		}
+	});
+
+	VCycle(depth + 1, coarse.Pressure, coarse.Rhs, pool);
+
+	// Prolong the coarse correction with cell-centred bilinear weights (9, 3, 3, 1)/16.
+	pool.ParallelFor(0, height, [&](int yBegin, int yEnd) {
+		for (int y = yBegin; y < yEnd; ++y) {
+			const int cy = y >> 1;
+			const int ny = std::clamp((y & 1) ? cy + 1 : cy - 1, 0, coarseHeight - 1);
+			for (int x = 0; x < width; ++x) {
+				const int cx = x >> 1;
+				const int nx = std::clamp((x & 1) ? cx + 1 : cx - 1, 0, coarseWidth - 1);
+				pressure[y][x] += (9.0f * coarse.Pressure[cy][cx] + 3.0f * coarse.Pressure[cy][nx]
+					+ 3.0f * coarse.Pressure[ny][cx] + coarse.Pressure[ny][nx]) / 16.0f;
+			}
+		}
+	});
+
+	RedBlackSweep(pressure, rhs, 1.0f, pool);
+	RedBlackSweep(pressure, rhs, 1.0f, pool);
+}
+
+int PressureSolver::SolveMultigrid(Grid2D<float>& pressure, float& residual, ThreadPool& pool)
+{
+	const int height = pressure.GetHeight();
+
+	int iteration = 0;
+	ComputeResidual(pressure, m_Rhs, m_Scratch, pool);
+	residual = (float)std::sqrt(SumInOrder(m_RowSums, height)) / m_RhsNorm;
+	while (iteration < MaxIterations && residual >= Tolerance)
+	{
+		VCycle(0, pressure, m_Rhs, pool);
+		ComputeResidual(pressure, m_Rhs, m_Scratch, pool);
+		residual = (float)std::sqrt(SumInOrder(m_RowSums, height)) / m_RhsNorm;
+		++iteration;
+	}
+	return iteration;
+}
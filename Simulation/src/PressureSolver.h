@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include "Grid2D.h"
+#include "ThreadPool.h"
+
+enum class PressureSolverType
+{
+	Jacobi = 0,
+	RedBlackSOR,
+	ConjugateGradient,
+	Multigrid
+};
+
+struct PressureSolveStats
+{
+	int Iterations = 0;
+	// Residual norm relative to the norm of the right-hand side.
+	float Residual = 0.0f;
+};
+
+// Solves the pressure Poisson equation lap(p) = rhs on a cell-centred grid with
+// zero-gradient walls, using the 5-point Laplacian. The pressure grid passed in is
+// used as the initial guess, so keeping it between steps warm-starts the solve.
+// Row sums are reduced in a fixed order, so the result does not depend on the
+// number of threads.
+class PressureSolver
+{
+public:
+	void Resize(int width, int height, float cellSize);
+
+	PressureSolveStats Solve(Grid2D<float>& pressure, const Grid2D<float>& rhs, ThreadPool& pool);
+
+	PressureSolverType Type = PressureSolverType::Multigrid;
+	float Tolerance = 1e-3f;
+	int MaxIterations = 200;
+	// Over-relaxation factor for red-black SOR, 1 gives plain Gauss-Seidel.
+	float Omega = 1.7f;
+private:
+	struct Level
+	{
+		Grid2D<float> Pressure;
+		Grid2D<float> Rhs;
+		Grid2D<float> Residual;
+	};
+
+	int SolveJacobi(Grid2D<float>& pressure, float& residual, ThreadPool& pool);
+	int SolveRedBlackSOR(Grid2D<float>& pressure, float& residual, ThreadPool& pool);
+	int SolveConjugateGradient(Grid2D<float>& pressure, float& residual, ThreadPool& pool);
+	int SolveMultigrid(Grid2D<float>& pressure, float& residual, ThreadPool& pool);
+
+	void VCycle(size_t level, Grid2D<float>& pressure, const Grid2D<float>& rhs, ThreadPool& pool);
+	void RedBlackSweep(Grid2D<float>& pressure, const Grid2D<float>& rhs, float omega, ThreadPool& pool);
+	void ComputeResidual(const Grid2D<float>& pressure, const Grid2D<float>& rhs, Grid2D<float>& residual, ThreadPool& pool);
+	double Dot(const Grid2D<float>& a, const Grid2D<float>& b, ThreadPool& pool);
+private:
+	// Right-hand side with its mean removed, so the all-Neumann problem is solvable.
+	Grid2D<float> m_Rhs;
+	Grid2D<float> m_Scratch;
+	// Conjugate gradient vectors.
+	Grid2D<float> m_Residual, m_Preconditioned, m_Direction, m_AppliedDirection;
+	// Multigrid hierarchy, m_Levels[0] is one level coarser than the input grid.
+	std::vector<Level> m_Levels;
+	std::vector<double> m_RowSums;
+	float m_RhsNorm = 0.0f;
+};
@@ -0,0 +1,256 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+	struct Scope
+	{
+		std::string Name;
+		std::mutex Mutex;
+		float History[Profiler::HistorySize];
+		uint32_t Next = 0, Count = 0;
+		uint64_t Calls = 0;
+	};
+
+	struct TraceEvent
+	{
+		ProfileScopeId Id;
+		int64_t StartNs, DurationNs;
+	};
+
+	// Events of one thread. Only that thread appends to it, the mutex is there for
+	// BeginTrace and EndTrace.
+	struct ThreadTrace
+	{
+		std::mutex Mutex;
+		uint32_t Id = 0;
+		std::string Name;
+		std::vector<TraceEvent> Events;
+	};
+
+	struct ProfilerState
+	{
+		Scope Scopes[Profiler::MaxScopes];
+		std::atomic<uint32_t> ScopeCount{ 0 };
+		// Guards registering scopes and threads.
+		std::mutex Mutex;
+		std::vector<std::shared_ptr<ThreadTrace>> Threads;
+
+		std::atomic<bool> Tracing{ false };
+		// Clock ticks of the trace start. Atomic since a BeginTrace that restarts a trace
+		// can set it while recorders on other threads are reading it.
+		std::atomic<Profiler::Clock::rep> TraceStart{ 0 };
+		std::atomic<size_t> TraceEventCount{ 0 };
+		std::atomic<uint64_t> DroppedEvents{ 0 };
+	};
+
+	// Built on first use, so scopes can be registered from static initializers.
+	ProfilerState& GetState()
+	{
+		static ProfilerState state;
+		return state;
+	}
+
+	thread_local std::shared_ptr<ThreadTrace> t_Thread;
+
+	ThreadTrace& GetThreadTrace()
+	{
+		if (!t_Thread)
+		{
+			ProfilerState& state = GetState();
+			std::lock_guard<std::mutex> lock(state.Mutex);
+			t_Thread = std::make_shared<ThreadTrace>();
+			t_Thread->Id = (uint32_t)state.Threads.size();
+			t_Thread->Name = "Thread " + std::to_string(t_Thread->Id);
+			state.Threads.push_back(t_Thread);
+		}
+		return *t_Thread;
+	}
+
+	// Nearest-rank percentile of sorted samples.
+	float Percentile(const std::vector<float>& sorted, float percentile)
+	{
+		size_t rank = (size_t)std::ceil(percentile * sorted.size());
+		return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+	}
+
+	void WriteJsonString(FILE* file, const std::string& text)
+	{
+		std::fputc('"', file);
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				std::fputc('\\', file);
+			if ((unsigned char)c >= 0x20)
+				std::fputc(c, file);
+		}
+		std::fputc('"', file);
+	}
+
+}
+
+ProfileScopeId Profiler::RegisterScope(const std::string& name)
+{
+	ProfilerState& state = GetState();
+	std::lock_guard<std::mutex> lock(state.Mutex);
+	const uint32_t count = state.ScopeCount.load(std::memory_order_relaxed);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (state.Scopes[i].Name == name)
+			return i;
+	}
+	if (count == MaxScopes)
+		return MaxScopes;
+
+	state.Scopes[count].Name = name;
+	state.ScopeCount.store(count + 1, std::memory_order_release);
+	return count;
+}
+
+void Profiler::Record(ProfileScopeId id, Clock::time_point start, Clock::time_point end)
+{
+	AddSample(id, std::chrono::duration<float, std::milli>(end - start).count());
+
+	ProfilerState& state = GetState();
+	if (!state.Tracing.load(std::memory_order_acquire) || id >= MaxScopes)
+		return;
+	if (state.TraceEventCount.fetch_add(1, std::memory_order_relaxed) >= MaxTraceEvents)
+	{
+		state.DroppedEvents.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	const Clock::time_point traceStart(Clock::duration(state.TraceStart.load(std::memory_order_relaxed)));
+	ThreadTrace& thread = GetThreadTrace();
+	std::lock_guard<std::mutex> lock(thread.Mutex);
+	thread.Events.push_back({ id,
+		std::chrono::duration_cast<std::chrono::nanoseconds>(start - traceStart).count(),
+		std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() });
+}
+
+void Profiler::AddSample(ProfileScopeId id, float milliseconds)
+{
+	if (id >= MaxScopes)
+		return;
+
+	Scope& scope = GetState().Scopes[id];
+	std::lock_guard<std::mutex> lock(scope.Mutex);
+	scope.History[scope.Next] = milliseconds;
+	scope.Next = (scope.Next + 1) % HistorySize;
+	scope.Count = std::min(scope.Count + 1, (uint32_t)HistorySize);
+	++scope.Calls;
+}
+
+void Profiler::SetThreadName(const std::string& name)
+{
+	ThreadTrace& thread = GetThreadTrace();
+	std::lock_guard<std::mutex> lock(thread.Mutex);
+	thread.Name = name;
+}
+
+std::vector<ProfileScopeSummary> Profiler::GetSummaries()
+{
+	ProfilerState& state = GetState();
+	const uint32_t count = state.ScopeCount.load(std::memory_order_acquire);
+	std::vector<ProfileScopeSummary> summaries;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		ProfileScopeSummary summary;
+		Scope& scope = state.Scopes[i];
+		{
+			std::lock_guard<std::mutex> lock(scope.Mutex);
+			if (scope.Count == 0)
+				continue;
+			summary.Calls = scope.Calls;
+			const uint32_t first = (scope.Next + HistorySize - scope.Count) % HistorySize;
+			for (uint32_t j = 0; j < scope.Count; ++j)
+				summary.History.push_back(scope.History[(first + j) % HistorySize]);
+		}
+		summary.Name = scope.Name;
+
+		std::vector<float> sorted = summary.History;
+		std::sort(sorted.begin(), sorted.end());
+		double total = 0.0;
+		for (float sample : sorted)
+			total += sample;
+		summary.LastMs = summary.History.back();
+		summary.MeanMs = (float)(total / sorted.size());
+		summary.P50Ms = Percentile(sorted, 0.50f);
+		summary.P99Ms = Percentile(sorted, 0.99f);
+		summaries.push_back(std::move(summary));
+	}
+	return summaries;
+}
+
+bool Profiler::GetSummary(const std::string& name, ProfileScopeSummary& summary)
+{
+	for (ProfileScopeSummary& candidate : GetSummaries())
+	{
+		if (candidate.Name == name)
+		{
+			summary = std::move(candidate);
+			return true;
+		}
+	}
+	return false;
+}
+
+void Profiler::BeginTrace()
+{
+	ProfilerState& state = GetState();
+	std::lock_guard<std::mutex> lock(state.Mutex);
+	for (const std::shared_ptr<ThreadTrace>& thread : state.Threads)
+	{
+		std::lock_guard<std::mutex> threadLock(thread->Mutex);
+		thread->Events.clear();
+	}
+	state.TraceEventCount.store(0, std::memory_order_relaxed);
+	state.DroppedEvents.store(0, std::memory_order_relaxed);
+	state.TraceStart.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+	state.Tracing.store(true, std::memory_order_release);
+}
+
+bool Profiler::EndTrace(const std::string& path)
+{
+	ProfilerState& state = GetState();
+	state.Tracing.store(false, std::memory_order_release);
+
+	FILE* file = std::fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+
+	std::lock_guard<std::mutex> lock(state.Mutex);
+	std::fputs("{\"traceEvents\":[\n", file);
+	bool first = true;
+	for (const std::shared_ptr<ThreadTrace>& thread : state.Threads)
+	{
+		std::lock_guard<std::mutex> threadLock(thread->Mutex);
+		std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", thread->Id);
+		WriteJsonString(file, thread->Name);
+		std::fputs("}}", file);
+		first = false;
+
+		// Complete events, with times in microseconds.
+		for (const TraceEvent& event : thread->Events)
+		{
+			std::fputs(",\n{\"name\":", file);
+			WriteJsonString(file, state.Scopes[event.Id].Name);
+			std::fprintf(file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%u}",
+				event.StartNs / 1000.0, event.DurationNs / 1000.0, thread->Id);
+		}
+	}
+	std::fprintf(file, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":%llu}}\n",
+		(unsigned long long)state.DroppedEvents.load(std::memory_order_relaxed));
+	return std::fclose(file) == 0;
+}
+
+bool Profiler::IsTracing()
+{
+	return GetState().Tracing.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Build with PSYS_PROFILE=0 to compile every PROFILE_ macro out. The Profiler itself
+// stays, it just never receives any samples.
+#ifndef PSYS_PROFILE
+	#define PSYS_PROFILE 1
+#endif
+
+using ProfileScopeId = uint32_t;
+
+struct ProfileScopeSummary
+{
+	std::string Name;
+	uint64_t Calls = 0;
+	// Over the samples still in the history.
+	float LastMs = 0.0f, MeanMs = 0.0f, P50Ms = 0.0f, P99Ms = 0.0f;
+	// Most recent samples, oldest first.
+	std::vector<float> History;
+};
+
+// Collects named timings from any thread. Every scope keeps a rolling history of its
+// last samples for the statistics, and while a trace is recording every timed scope
+// is also kept as an event and written out as Chrome trace JSON, which chrome://tracing
+// and Perfetto open.
+class Profiler
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr int HistorySize = 256;
+	static constexpr int MaxScopes = 128;
+
+	// Returns the id of the scope with this name, adding it on first use. Ids are never
+	// reused, so they can be cached in a static.
+	static ProfileScopeId RegisterScope(const std::string& name);
+
+	static void Record(ProfileScopeId id, Clock::time_point start, Clock::time_point end);
+	// Adds a sample that was not timed by a scope, such as the frame time.
+	static void AddSample(ProfileScopeId id, float milliseconds);
+
+	// Name of the calling thread in traces.
+	static void SetThreadName(const std::string& name);
+
+	// Every scope that has samples, in the order they were registered.
+	static std::vector<ProfileScopeSummary> GetSummaries();
+	static bool GetSummary(const std::string& name, ProfileScopeSummary& summary);
+
+	// Events recorded between BeginTrace and EndTrace are written to path. A trace is
+	// capped at MaxTraceEvents, later events are dropped and counted in the file.
+	// BeginTrace during a trace starts it over, from any thread.
+	static void BeginTrace();
+	static bool EndTrace(const std::string& path);
+	static bool IsTracing();
+
+	static constexpr size_t MaxTraceEvents = 1 << 22;
+};
+
+// Times the enclosing block.
+class ProfileTimer
+{
+public:
+	explicit ProfileTimer(ProfileScopeId id)
+		: m_Id(id), m_Start(Profiler::Clock::now())
+	{
+	}
+
+	~ProfileTimer()
+	{
+		Profiler::Record(m_Id, m_Start, Profiler::Clock::now());
+	}
+
+	ProfileTimer(const ProfileTimer&) = delete;
+	ProfileTimer& operator=(const ProfileTimer&) = delete;
+private:
+	ProfileScopeId m_Id;
+	Profiler::Clock::time_point m_Start;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+#if PSYS_PROFILE
+	// name must be the same every time the line runs, it is only looked up once.
+	#define PROFILE_SCOPE(name) \
+		static const ProfileScopeId PROFILE_CONCAT(s_ProfileScope, __LINE__) = ::Profiler::RegisterScope(name); \
+		::ProfileTimer PROFILE_CONCAT(profileTimer, __LINE__)(PROFILE_CONCAT(s_ProfileScope, __LINE__))
+	// For scopes registered up front, whose name is only known at run time.
+	#define PROFILE_SCOPE_ID(id) ::ProfileTimer PROFILE_CONCAT(profileTimer, __LINE__)(id)
+	#define PROFILE_VALUE(name, milliseconds) \
+		do { \
+			static const ProfileScopeId s_ProfileValue = ::Profiler::RegisterScope(name); \
+			::Profiler::AddSample(s_ProfileValue, milliseconds); \
+		} while (0)
+	#define PROFILE_THREAD(name) ::Profiler::SetThreadName(name)
+#else
+	#define PROFILE_SCOPE(name)
+	#define PROFILE_SCOPE_ID(id)
+	#define PROFILE_VALUE(name, milliseconds) do { } while (0)
+	#define PROFILE_THREAD(name)
+#endif
@@ -1,4 +1,138 @@
 #include "Random.h"
 
-std::mt19937 Random::s_RandomEngine;
-std::uniform_int_distribution<std::mt19937::result_type> Random::s_Distribution;
+#include <random>
+
+#if defined(__AVX2__)
+	#define RANDOM_AVX2
+	#include <immintrin.h>
+#endif
+
+// Default seed of std::mt19937, which this generator replaced.
+uint32_t Random::s_Seed = 5489;
+
+namespace {
+
+	const uint32_t s_Multiplier0 = 0xD2511F53;
+	const uint32_t s_Multiplier1 = 0xCD9E8D57;
+	const uint32_t s_KeyStep0 = 0x9E3779B9;
+	const uint32_t s_KeyStep1 = 0xBB67AE85;
+	const int s_Rounds = 10;
+
+	// Every Philox block holds four values, so index i is word i % 4 of block i / 4.
+	struct Block
+	{
+		uint32_t Words[4];
+	};
+
+	Block Philox(uint32_t blockIndex, uint32_t step, uint32_t stream, uint32_t seed)
+	{
+		uint32_t c0 = blockIndex, c1 = step, c2 = stream, c3 = 0;
+		uint32_t k0 = seed, k1 = 0;
+		for (int round = 0; round < s_Rounds; ++round)
+		{
+			const uint64_t product0 = (uint64_t)s_Multiplier0 * c0;
+			const uint64_t product1 = (uint64_t)s_Multiplier1 * c2;
+			const uint32_t next0 = (uint32_t)(product1 >> 32) ^ c1 ^ k0;
+			const uint32_t next2 = (uint32_t)(product0 >> 32) ^ c3 ^ k1;
+			c1 = (uint32_t)product1;
+			c3 = (uint32_t)product0;
+			c0 = next0;
+			c2 = next2;
+			k0 += s_KeyStep0;
+			k1 += s_KeyStep1;
+		}
+		return { { c0, c1, c2, c3 } };
+	}
+
+	// The top 24 bits, which a float holds exactly.
+	inline float ToFloat(uint32_t bits)
+	{
+		return (float)(int32_t)(bits >> 8) * (1.0f / 16777216.0f);
+	}
+
+#if defined(RANDOM_AVX2)
+	// 32 x 32 -> 64 bit products of all eight lanes, split into low and high halves.
+	inline void MultiplyWide(__m256i a, __m256i b, __m256i& low, __m256i& high)
+	{
+		const __m256i even = _mm256_mul_epu32(a, b);
+		const __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b);
+		low = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+		high = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+	}
+
+	inline __m256 ToFloat(__m256i bits)
+	{
+		return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(bits, 8)), _mm256_set1_ps(1.0f / 16777216.0f));
+	}
+
+	// Eight consecutive blocks starting at firstBlock, 32 values written to out.
+	void PhiloxSimd(float* out, uint32_t firstBlock, uint32_t step, uint32_t stream, uint32_t seed)
+	{
+		__m256i c0 = _mm256_add_epi32(_mm256_set1_epi32((int)firstBlock), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		__m256i c1 = _mm256_set1_epi32((int)step);
+		__m256i c2 = _mm256_set1_epi32((int)stream);
+		__m256i c3 = _mm256_setzero_si256();
+		uint32_t k0 = seed, k1 = 0;
+		const __m256i multiplier0 = _mm256_set1_epi32((int)s_Multiplier0);
+		const __m256i multiplier1 = _mm256_set1_epi32((int)s_Multiplier1);
+		for (int round = 0; round < s_Rounds; ++round)
+		{
+			__m256i low0, high0, low1, high1;
+			MultiplyWide(c0, multiplier0, low0, high0);
+			MultiplyWide(c2, multiplier1, low1, high1);
+			c0 = _mm256_xor_si256(_mm256_xor_si256(high1, c1), _mm256_set1_epi32((int)k0));
+			c2 = _mm256_xor_si256(_mm256_xor_si256(high0, c3), _mm256_set1_epi32((int)k1));
+			c1 = low1;
+			c3 = low0;
+			k0 += s_KeyStep0;
+			k1 += s_KeyStep1;
+		}
+
+		// Transpose from one register per word to four words per block.
+		const __m256i t0 = _mm256_unpacklo_epi32(c0, c1), t1 = _mm256_unpackhi_epi32(c0, c1);
+		const __m256i t2 = _mm256_unpacklo_epi32(c2, c3), t3 = _mm256_unpackhi_epi32(c2, c3);
+		const __m256i b04 = _mm256_unpacklo_epi64(t0, t2), b15 = _mm256_unpackhi_epi64(t0, t2);
+		const __m256i b26 = _mm256_unpacklo_epi64(t1, t3), b37 = _mm256_unpackhi_epi64(t1, t3);
+		_mm256_storeu_ps(out, ToFloat(_mm256_permute2x128_si256(b04, b15, 0x20)));
+		_mm256_storeu_ps(out + 8, ToFloat(_mm256_permute2x128_si256(b26, b37, 0x20)));
+		_mm256_storeu_ps(out + 16, ToFloat(_mm256_permute2x128_si256(b04, b15, 0x31)));
+		_mm256_storeu_ps(out + 24, ToFloat(_mm256_permute2x128_si256(b26, b37, 0x31)));
+	}
+#endif
+
+}
+
+void Random::Init()
+{
+	s_Seed = std::random_device()();
+}
+
+void Random::Init(uint32_t seed)
+{
+	s_Seed = seed;
+}
+
+float Random::Float(uint32_t stream, uint32_t step, uint32_t index)
+{
+	return ToFloat(Philox(index / 4, step, stream, s_Seed).Words[index % 4]);
+}
+
+void Random::Fill(float* out, int count, uint32_t stream, uint32_t step, uint32_t firstIndex)
+{
+	int i = 0;
+	// Values up to the first whole block, then whole blocks, then the rest.
+	for (; i < count && (firstIndex + i) % 4 != 0; ++i)
+		out[i] = Float(stream, step, firstIndex + i);
+#if defined(RANDOM_AVX2)
+	for (; i + 32 <= count; i += 32)
+		PhiloxSimd(out + i, (firstIndex + i) / 4, step, stream, s_Seed);
+#endif
+	for (; i + 4 <= count; i += 4)
+	{
+		const Block block = Philox((firstIndex + i) / 4, step, stream, s_Seed);
+		for (int word = 0; word < 4; ++word)
+			out[i + word] = ToFloat(block.Words[word]);
+	}
+	for (; i < count; ++i)
+		out[i] = Float(stream, step, firstIndex + i);
+}
@@ -1,21 +1,30 @@
 #pragma once
 
-#include <random>
+#include <cstdint>
 
+// Counter-based random numbers (Philox4x32-10). A value depends only on the seed and
+// the (stream, step, index) it is asked for, never on what was drawn before, so cells
+// and particles can draw their numbers on any thread in any order and a run gives the
+// same results for every thread count.
 class Random
 {
 public:
-	static void Init()
-	{
-		s_RandomEngine.seed(std::random_device()());
-	}
+	// Seed from the system's entropy source.
+	static void Init();
 
-	static float Float()
-	{
-		return (float)s_Distribution(s_RandomEngine) / (float)std::numeric_limits<uint32_t>::max();
-	}
+	// Fixed seed, so runs can be reproduced.
+	static void Init(uint32_t seed);
+	static uint32_t GetSeed() { return s_Seed; }
+
+	// Uniform float in [0, 1). Streams keep unrelated uses apart, step is usually the
+	// simulation step and index the cell or particle.
+	static float Float(uint32_t stream, uint32_t step, uint32_t index);
+
+	// Writes Float(stream, step, firstIndex + i) to out[i] for i in [0, count). Uses
+	// AVX2 when the build enables it and scalar code for the ends, both paths produce
+	// identical results.
+	static void Fill(float* out, int count, uint32_t stream, uint32_t step, uint32_t firstIndex);
 
 private:
-	static std::mt19937 s_RandomEngine;
-	static std::uniform_int_distribution<std::mt19937::result_type> s_Distribution;
+	static uint32_t s_Seed;
 };
\ No newline at end of file
@@ -1,4 +1,8 @@
+#include <cstring>
+
 #include "GLCore.h"
+#include "HeadlessRunner.h"
+#include "KernelBenchmarks.h"
 #include "SandboxLayer.h"
 
 using namespace GLCore;
@@ -12,8 +16,34 @@ public:
 	}
 };
 
-int main()
+static bool HasFlag(int argc, char** argv, const char* flag)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], flag) == 0)
+			return true;
+	}
+	return false;
+}
+
+int main(int argc, char** argv)
 {
+	// --headless steps the simulation without creating a window, see HeadlessRunner.h.
+	if (HasFlag(argc, argv, "--headless"))
+	{
+		Log::Init();
+		HeadlessConfig config;
+		if (!ParseHeadlessArgs(argc, argv, config))
+			return 1;
+		return RunHeadless(config);
+	}
+	// --benchmark times each solver kernel on its own, see KernelBenchmarks.h.
+	if (HasFlag(argc, argv, "--benchmark"))
+	{
+		Log::Init();
+		return RunKernelBenchmarks(argc, argv);
+	}
+
 	std::unique_ptr<Sandbox> app = std::make_unique<Sandbox>();
 	app->Run();
 }
\ No newline at end of file
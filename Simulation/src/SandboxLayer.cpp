@@ -1,10 +1,12 @@
 #include "SandboxLayer.h"
 
+#include "Profiler.h"
+
 using namespace GLCore;
 using namespace GLCore::Utils;
 
 SandboxLayer::SandboxLayer()
-	: m_CameraController(16.0f / 9.0f)
+	: m_CameraController(16.0f / 9.0f), m_Settings(m_Simulation.GetSettings())
 {
 }
 
@@ -14,6 +16,7 @@ SandboxLayer::~SandboxLayer()
 
 void SandboxLayer::OnAttach()
 {
+	PROFILE_THREAD("Main");
 	EnableGLDebugging();
 
 	glEnable(GL_BLEND);
@@ -45,14 +48,17 @@ void SandboxLayer::OnEvent(Event& event)
 
 void SandboxLayer::OnUpdate(Timestep ts)
 {
+	m_FrameTime = ts;
+	PROFILE_VALUE("Frame", ts.GetMilliseconds());
 	m_CameraController.OnUpdate(ts);
 
 	// Render here
 	glClearColor(0,0,0, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	m_ParticleSystem.OnUpdate(ts);
-	m_ParticleSystem.OnRender(m_CameraController.GetCamera());
+	// The simulation steps on its own thread, draw the latest state it has published.
+	const ParticleSnapshot& snapshot = m_Simulation.AcquireSnapshot();
+	m_ParticleRenderer.OnRender(snapshot, SimulationThread::GetInterpolationFactor(snapshot), m_CameraController.GetCamera());
 }
 
 void SandboxLayer::OnImGuiRender()
@@ -60,9 +66,187 @@ void SandboxLayer::OnImGuiRender()
 	// ImGui here
 
 	ImGui::Begin("Settings");
-	ImGui::Text(m_ParticleSystem.frames_per_second.c_str());
-	ImGui::DragFloat("Gravity", &m_ParticleSystem.gravity, -0.100f, -10.000f, 0.000f);
-	ImGui::DragFloat("Vorticity", &m_ParticleSystem.vorticityEpsilon, 0.001f, 0.00f, 0.050f);
-	ImGui::DragFloat("Bouyancy", &m_ParticleSystem.buoyancyEpsilon, 0.02f, 0.00f, 0.050f);
+	const ParticleSnapshot& snapshot = m_Simulation.AcquireSnapshot();
+	ImGui::Text("FPS: %d", m_FrameTime > 0.0f ? (int)(1.0f / m_FrameTime) : 0);
+	ImGui::Text("Simulation: %.0f steps/s", snapshot.StepsPerSecond);
+
+	bool changed = false;
+	changed |= ImGui::DragFloat("Gravity", &m_Settings.Gravity, -0.100f, -10.000f, 0.000f);
+	changed |= ImGui::DragFloat("Vorticity", &m_Settings.VorticityEpsilon, 0.001f, 0.00f, 0.050f);
+	changed |= ImGui::DragFloat("Bouyancy", &m_Settings.BuoyancyEpsilon, 0.02f, 0.00f, 0.050f);
+	const char* advectionNames[] = { "Bilinear", "MacCormack" };
+	int advectionScheme = (int)m_Settings.Advection;
+	if (ImGui::Combo("Advection", &advectionScheme, advectionNames, IM_ARRAYSIZE(advectionNames)))
+	{
+		m_Settings.Advection = (AdvectionScheme)advectionScheme;
+		changed = true;
+	}
+	const char* transferNames[] = { "Passive", "PIC", "FLIP", "APIC" };
+	int transferMode = (int)m_Settings.ParticleTransfer;
+	if (ImGui::Combo("Particles", &transferMode, transferNames, IM_ARRAYSIZE(transferNames)))
+	{
+		m_Settings.ParticleTransfer = (ParticleTransferMode)transferMode;
+		changed = true;
+	}
+	if (m_Settings.ParticleTransfer == ParticleTransferMode::FLIP)
+		changed |= ImGui::SliderFloat("FLIP Ratio", &m_Settings.FlipRatio, 0.0f, 1.0f);
+	changed |= ImGui::Checkbox("SPH", &m_Settings.Sph.Enabled);
+	if (m_Settings.Sph.Enabled)
+	{
+		changed |= ImGui::SliderFloat("SPH Radius", &m_Settings.Sph.Radius, 1.0f, 4.0f);
+		changed |= ImGui::SliderFloat("Rest Density", &m_Settings.Sph.RestDensity, 0.5f, 4.0f);
+		changed |= ImGui::InputFloat("Stiffness", &m_Settings.Sph.Stiffness, 0.0f, 0.0f, "%.1e");
+		changed |= ImGui::InputFloat("Viscosity", &m_Settings.Sph.Viscosity, 0.0f, 0.0f, "%.1e");
+	}
+	if (ImGui::TreeNode("Emitters", "Emitters (%zu particles)", snapshot.Particles.size()))
+	{
+		const char* shapeNames[] = { "Point", "Line", "Area" };
+		const char* triggerNames[] = { "Always", "Cloud Water", "Vapor" };
+		for (size_t i = 0; i < m_Settings.Emitters.size(); ++i)
+		{
+			ParticleEmitter& emitter = m_Settings.Emitters[i];
+			ImGui::PushID((int)i);
+			int shape = (int)emitter.Shape;
+			if (ImGui::Combo("Shape", &shape, shapeNames, IM_ARRAYSIZE(shapeNames)))
+			{
+				emitter.Shape = (EmitterShape)shape;
+				changed = true;
+			}
+			int trigger = (int)emitter.Trigger;
+			if (ImGui::Combo("Trigger", &trigger, triggerNames, IM_ARRAYSIZE(triggerNames)))
+			{
+				emitter.Trigger = (EmitterTrigger)trigger;
+				changed = true;
+			}
+			changed |= ImGui::SliderFloat2("Start", &emitter.Start.x, 0.0f, 1.0f);
+			if (emitter.Shape != EmitterShape::Point)
+				changed |= ImGui::SliderFloat2("End", &emitter.End.x, 0.0f, 1.0f);
+			if (emitter.Trigger != EmitterTrigger::Always)
+				changed |= ImGui::InputFloat("Threshold", &emitter.Threshold, 0.0f, 0.0f, "%.1e");
+			changed |= ImGui::SliderFloat("Rate", &emitter.Rate, 0.0f, 20.0f);
+			changed |= ImGui::SliderFloat("Lifetime", &emitter.Lifetime, 0.0f, 30.0f);
+			const bool remove = ImGui::Button("Remove");
+			ImGui::Separator();
+			ImGui::PopID();
+			if (remove)
+			{
+				m_Settings.Emitters.erase(m_Settings.Emitters.begin() + i--);
+				changed = true;
+			}
+		}
+		if (ImGui::Button("Add Emitter"))
+		{
+			m_Settings.Emitters.emplace_back();
+			changed = true;
+		}
+		ImGui::TreePop();
+	}
+	changed |= ImGui::Checkbox("Sparse Tiles", &m_Settings.ActiveTiles.Enabled);
+	if (m_Settings.ActiveTiles.Enabled)
+	{
+		changed |= ImGui::InputFloat("Velocity Threshold", &m_Settings.ActiveTiles.VelocityThreshold, 0.0f, 0.0f, "%.1e");
+		changed |= ImGui::InputFloat("Vorticity Threshold", &m_Settings.ActiveTiles.VorticityThreshold, 0.0f, 0.0f, "%.1e");
+		changed |= ImGui::InputFloat("Cloud Water Threshold", &m_Settings.ActiveTiles.CloudWaterThreshold, 0.0f, 0.0f, "%.1e");
+		ImGui::Text("Active: %.0f%% of cells", snapshot.ActiveTileFraction * 100.0f);
+	}
+	int threadCount = m_Settings.ThreadCount ? (int)m_Settings.ThreadCount : (int)std::max(1u, std::thread::hardware_concurrency());
+	if (ImGui::SliderInt("Threads", &threadCount, 1, (int)std::max(1u, std::thread::hardware_concurrency())))
+	{
+		m_Settings.ThreadCount = (uint32_t)threadCount;
+		changed = true;
+	}
+
+	const char* solverNames[] = { "Jacobi", "Red-Black SOR", "Conjugate Gradient", "Multigrid" };
+	int solverType = (int)m_Settings.PressureSolver;
+	if (ImGui::Combo("Pressure Solver", &solverType, solverNames, IM_ARRAYSIZE(solverNames)))
+	{
+		m_Settings.PressureSolver = (PressureSolverType)solverType;
+		changed = true;
+	}
+	changed |= ImGui::InputFloat("Tolerance", &m_Settings.PressureTolerance, 0.0f, 0.0f, "%.1e");
+	changed |= ImGui::SliderInt("Max Iterations", &m_Settings.PressureMaxIterations, 1, 1000);
+	if (m_Settings.PressureSolver == PressureSolverType::RedBlackSOR)
+		changed |= ImGui::SliderFloat("SOR Omega", &m_Settings.PressureOmega, 1.0f, 1.99f);
+	ImGui::Text("Pressure: %d iterations, residual %.2e", snapshot.Pressure.Iterations, snapshot.Pressure.Residual);
+
+	if (changed)
+		m_Simulation.SetSettings(m_Settings);
+	ImGui::End();
+
+	DrawProfiler(snapshot);
+}
+
+void SandboxLayer::DrawProfiler(const ParticleSnapshot& snapshot)
+{
+	static const char* s_TracePath = "trace.json";
+
+	ImGui::Begin("Profiler");
+	const std::vector<ProfileScopeSummary> summaries = Profiler::GetSummaries();
+	const ProfileScopeSummary* frame = nullptr;
+	const ProfileScopeSummary* step = nullptr;
+	for (const ProfileScopeSummary& summary : summaries)
+	{
+		if (summary.Name == "Frame")
+			frame = &summary;
+		else if (summary.Name == "Step")
+			step = &summary;
+	}
+
+	if (frame)
+	{
+		ImGui::Text("Frame: mean %.2f ms, p50 %.2f ms, p99 %.2f ms", frame->MeanMs, frame->P50Ms, frame->P99Ms);
+		ImGui::PlotLines("##Frame", frame->History.data(), (int)frame->History.size(), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 60.0f));
+	}
+	if (step && step->MeanMs > 0.0f)
+	{
+		// Throughput of the step itself, regardless of how often the fixed timestep runs it.
+		const double stepsPerSecond = 1000.0 / step->MeanMs;
+		ImGui::Text("Step: mean %.2f ms, p50 %.2f ms, p99 %.2f ms", step->MeanMs, step->P50Ms, step->P99Ms);
+		ImGui::Text("%.1f M cells/s, %.2f M particles/s",
+			snapshot.CellCount * stepsPerSecond / 1e6, snapshot.Particles.size() * stepsPerSecond / 1e6);
+	}
+
+	ImGui::Separator();
+	ImGui::Columns(5, "Scopes");
+	ImGui::Text("Scope"); ImGui::NextColumn();
+	ImGui::Text("Mean ms"); ImGui::NextColumn();
+	ImGui::Text("p50 ms"); ImGui::NextColumn();
+	ImGui::Text("p99 ms"); ImGui::NextColumn();
+	ImGui::Text("History"); ImGui::NextColumn();
+	ImGui::Separator();
+	for (const ProfileScopeSummary& summary : summaries)
+	{
+		if (&summary == frame)
+			continue;
+		ImGui::Text("%s", summary.Name.c_str()); ImGui::NextColumn();
+		ImGui::Text("%.3f", summary.MeanMs); ImGui::NextColumn();
+		ImGui::Text("%.3f", summary.P50Ms); ImGui::NextColumn();
+		ImGui::Text("%.3f", summary.P99Ms); ImGui::NextColumn();
+		ImGui::PushID(summary.Name.c_str());
+		ImGui::PlotLines("##History", summary.History.data(), (int)summary.History.size(), 0, nullptr, 0.0f, FLT_MAX,
+			ImVec2(-1.0f, ImGui::GetTextLineHeight()));
+		ImGui::PopID();
+		ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+	ImGui::Separator();
+
+	if (!Profiler::IsTracing())
+	{
+		if (ImGui::Button("Start Trace"))
+		{
+			Profiler::BeginTrace();
+			m_TraceStatus = "Recording";
+		}
+	}
+	else if (ImGui::Button("Stop Trace"))
+	{
+		m_TraceStatus = Profiler::EndTrace(s_TracePath) ? std::string("Wrote ") + s_TracePath : std::string("Could not write ") + s_TracePath;
+	}
+	if (!m_TraceStatus.empty())
+	{
+		ImGui::SameLine();
+		ImGui::Text("%s", m_TraceStatus.c_str());
+	}
 	ImGui::End();
 }
@@ -3,7 +3,10 @@
 #include <GLCore.h>
 #include <GLCoreUtils.h>
 
-#include "ParticleSystem.h"
+#include <string>
+
+#include "ParticleRenderer.h"
+#include "SimulationThread.h"
 
 class SandboxLayer : public GLCore::Layer
 {
@@ -16,8 +19,16 @@ public:
 	virtual void OnEvent(GLCore::Event& event) override;
 	virtual void OnUpdate(GLCore::Timestep ts) override;
 	virtual void OnImGuiRender() override;
+private:
+	// Frame and step timings, the stages of the step and the trace recorder.
+	void DrawProfiler(const ParticleSnapshot& snapshot);
 private:
 	GLCore::Utils::OrthographicCameraController m_CameraController;
 	Particle m_Particle;
-	ParticleSystem m_ParticleSystem;
+	SimulationThread m_Simulation;
+	// Copy of the simulation settings edited by the UI and posted when they change.
+	SimulationSettings m_Settings;
+	ParticleRenderer m_ParticleRenderer;
+	float m_FrameTime = 0.0f;
+	std::string m_TraceStatus;
 };
\ No newline at end of file
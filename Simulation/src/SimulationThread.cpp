@@ -0,0 +1,193 @@
+#include "SimulationThread.h"
+
+#include <algorithm>
+
+#include "ParticleKernels.h"
+#include "Profiler.h"
+
+using Clock = std::chrono::steady_clock;
+
+SimulationThread::SimulationThread(const ParticleSystemProps& props)
+	: m_ParticleSystem(props)
+{
+	m_Settings.Gravity = props.Gravity;
+	m_Settings.VorticityEpsilon = props.VorticityEpsilon;
+	m_Settings.BuoyancyEpsilon = props.BuoyancyEpsilon;
+	ApplySettings(m_Settings);
+
+	// Publish the starting state so the renderer has something to draw straight away.
+	CapturePositions(m_PreviousPositions);
+	PublishSnapshot(0.0f);
+
+	m_Thread = std::thread(&SimulationThread::Run, this);
+}
+
+SimulationThread::~SimulationThread()
+{
+	m_Running.store(false, std::memory_order_relaxed);
+	m_Thread.join();
+}
+
+void SimulationThread::SetSettings(const SimulationSettings& settings)
+{
+	std::lock_guard<std::mutex> lock(m_SettingsMutex);
+	m_Settings = settings;
+	m_SettingsChanged = true;
+}
+
+SimulationSettings SimulationThread::GetSettings() const
+{
+	std::lock_guard<std::mutex> lock(m_SettingsMutex);
+	return m_Settings;
+}
+
+float SimulationThread::GetInterpolationFactor(const ParticleSnapshot& snapshot)
+{
+	if (snapshot.TimeStep <= 0.0f)
+		return 1.0f;
+	float elapsed = std::chrono::duration<float>(Clock::now() - snapshot.PublishTime).count();
+	return std::min(std::max(elapsed / snapshot.TimeStep, 0.0f), 1.0f);
+}
+
+void SimulationThread::ApplySettings(const SimulationSettings& settings)
+{
+	m_ParticleSystem.gravity = settings.Gravity;
+	m_ParticleSystem.vorticityEpsilon = settings.VorticityEpsilon;
+	m_ParticleSystem.buoyancyEpsilon = settings.BuoyancyEpsilon;
+	m_ParticleSystem.advectionScheme = settings.Advection;
+	m_ParticleSystem.activeTiles = settings.ActiveTiles;
+
+	PressureSolver& solver = m_ParticleSystem.GetPressureSolver();
+	solver.Type = settings.PressureSolver;
+	solver.Tolerance = settings.PressureTolerance;
+	solver.MaxIterations = settings.PressureMaxIterations;
+	solver.Omega = settings.PressureOmega;
+	ParticleTransfer& transfer = m_ParticleSystem.GetParticleTransfer();
+	transfer.Mode = settings.ParticleTransfer;
+	transfer.FlipRatio = settings.FlipRatio;
+	m_ParticleSystem.sph = settings.Sph;
+	m_ParticleSystem.emitters = settings.Emitters;
+
+	// Restarting the workers is not free, so only do it when the count really changes.
+	uint32_t threadCount = settings.ThreadCount ? settings.ThreadCount : std::max(1u, std::thread::hardware_concurrency());
+	if (threadCount != m_ParticleSystem.GetThreadCount())
+		m_ParticleSystem.SetThreadCount(threadCount);
+	m_TimeStep = settings.FixedTimeStep;
+}
+
+void SimulationThread::Run()
+{
+	PROFILE_THREAD("Simulation");
+	SimulationSettings settings = GetSettings();
+	Clock::time_point lastTime = Clock::now();
+	Clock::time_point rateStart = lastTime;
+	uint64_t rateStartStep = m_Step;
+	float stepsPerSecond = 0.0f;
+	double accumulator = 0.0;
+
+	while (m_Running.load(std::memory_order_relaxed))
+	{
+		bool settingsChanged = false;
+		{
+			std::lock_guard<std::mutex> lock(m_SettingsMutex);
+			if (m_SettingsChanged)
+			{
+				settings = m_Settings;
+				m_SettingsChanged = false;
+				settingsChanged = true;
+			}
+		}
+		if (settingsChanged)
+			ApplySettings(settings);
+
+		Clock::time_point now = Clock::now();
+		accumulator += std::chrono::duration<double>(now - lastTime).count();
+		lastTime = now;
+
+		const double timeStep = settings.FixedTimeStep;
+		int steps = (int)(accumulator / timeStep);
+		if (steps == 0)
+		{
+			std::this_thread::sleep_for(std::chrono::duration<double>(timeStep - accumulator));
+			continue;
+		}
+		if (steps > settings.MaxSubSteps)
+		{
+			// Too far behind to catch up, let the simulation run slower than real time.
+			steps = settings.MaxSubSteps;
+			accumulator = steps * timeStep;
+		}
+
+		uint32_t orderVersion = 0;
+		for (int i = 0; i < steps; ++i)
+		{
+			// Only the last step of a batch is interpolated across.
+			if (i == steps - 1)
+			{
+				CapturePositions(m_PreviousPositions);
+				orderVersion = m_ParticleSystem.GetParticleOrderVersion();
+			}
+			m_ParticleSystem.OnUpdate((float)timeStep);
+			++m_Step;
+		}
+		// The particles were sorted during that step, so the earlier positions have to
+		// follow them to their new indices.
+		if (m_ParticleSystem.GetParticleOrderVersion() != orderVersion)
+			ReorderPreviousPositions();
+		accumulator -= steps * timeStep;
+
+		double rateSeconds = std::chrono::duration<double>(now - rateStart).count();
+		if (rateSeconds >= 1.0)
+		{
+			stepsPerSecond = (float)((m_Step - rateStartStep) / rateSeconds);
+			rateStart = now;
+			rateStartStep = m_Step;
+		}
+		PublishSnapshot(stepsPerSecond);
+	}
+}
+
+void SimulationThread::CapturePositions(std::vector<uint32_t>& positions) const
+{
+	const ParticleStore& particles = m_ParticleSystem.GetParticles();
+	positions.resize(particles.GetCount());
+	PackParticlePositions(particles, 0, particles.GetCount(), m_ParticleSystem.GetDomainSize(), positions.data());
+}
+
+void SimulationThread::ReorderPreviousPositions()
+{
+	const std::vector<uint32_t>& order = m_ParticleSystem.GetParticleOrder();
+	m_ReorderedPositions.resize(order.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		m_ReorderedPositions[i] = m_PreviousPositions[order[i]];
+	m_PreviousPositions.swap(m_ReorderedPositions);
+}
+
+void SimulationThread::PublishSnapshot(float stepsPerSecond)
+{
+	PROFILE_SCOPE("PublishSnapshot");
+	ParticleSnapshot& snapshot = m_Snapshots.GetWriteBuffer();
+	const ParticleStore& particles = m_ParticleSystem.GetParticles();
+
+	// Only the live particles are drawn. The ones spawned in the last step have nowhere
+	// to come from and start where they are.
+	CapturePositions(m_Positions);
+	snapshot.Particles.clear();
+	for (size_t i = 0; i < particles.GetCount(); ++i)
+	{
+		if (!particles.IsAlive(i))
+			continue;
+		const bool spawned = i >= m_PreviousPositions.size() || particles.Age[i] == 0.0f;
+		snapshot.Particles.push_back({ spawned ? m_Positions[i] : m_PreviousPositions[i], m_Positions[i] });
+	}
+	snapshot.DomainSize = m_ParticleSystem.GetDomainSize();
+
+	snapshot.Step = m_Step;
+	snapshot.TimeStep = m_TimeStep;
+	snapshot.PublishTime = Clock::now();
+	snapshot.StepsPerSecond = stepsPerSecond;
+	snapshot.CellCount = (uint64_t)m_ParticleSystem.GetWidth() * m_ParticleSystem.GetHeight();
+	snapshot.ActiveTileFraction = m_ParticleSystem.GetActiveTileFraction();
+	snapshot.Pressure = m_ParticleSystem.GetPressureSolveStats();
+	m_Snapshots.Publish();
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ParticleSystem.h"
+#include "TripleBuffer.h"
+
+// Everything the UI can change while the simulation runs. Changes are posted as a whole
+// and picked up by the simulation thread before its next step.
+struct SimulationSettings
+{
+	float Gravity = -0.1f;
+	float VorticityEpsilon = 0.001f;
+	float BuoyancyEpsilon = 0.02f;
+	AdvectionScheme Advection = AdvectionScheme::Bilinear;
+	PressureSolverType PressureSolver = PressureSolverType::Multigrid;
+	float PressureTolerance = 1e-3f;
+	int PressureMaxIterations = 200;
+	float PressureOmega = 1.7f;
+	uint32_t ThreadCount = 0;
+	ActiveTileSettings ActiveTiles;
+	ParticleTransferMode ParticleTransfer = ParticleTransferMode::Passive;
+	float FlipRatio = 0.95f;
+	SphSettings Sph;
+	std::vector<ParticleEmitter> Emitters;
+	// Simulated seconds per step, and how many steps may run to catch up after a stall
+	// before the remaining time is dropped.
+	float FixedTimeStep = 1.0f / 60.0f;
+	int MaxSubSteps = 4;
+};
+
+// One particle as the renderer streams it. Both positions are quantized to 16 bits per
+// axis over the domain by PackParticlePositions, x in the low half, so the vertex shader
+// reads them as four normalized shorts and derives the colour from the height.
+struct ParticleVertex
+{
+	uint32_t PreviousPosition;
+	uint32_t Position;
+};
+
+// State of the particles after a step, published for the render thread.
+struct ParticleSnapshot
+{
+	// Positions before and after the step, for interpolating between them.
+	std::vector<ParticleVertex> Particles;
+	// What the positions are fractions of.
+	glm::vec2 DomainSize = { 1.0f, 1.0f };
+
+	uint64_t Step = 0;
+	float TimeStep = 0.0f;
+	std::chrono::steady_clock::time_point PublishTime;
+	float StepsPerSecond = 0.0f;
+	// Size of the simulated grid, for the throughput readouts.
+	uint64_t CellCount = 0;
+	float ActiveTileFraction = 1.0f;
+	PressureSolveStats Pressure;
+};
+
+// Runs a ParticleSystem on its own thread at a fixed timestep, independent of the frame
+// rate. Real time is accumulated and consumed in whole steps, and a snapshot is handed
+// to the render thread through a triple buffer after each batch of steps.
+class SimulationThread
+{
+public:
+	SimulationThread(const ParticleSystemProps& props = ParticleSystemProps());
+	~SimulationThread();
+
+	SimulationThread(const SimulationThread&) = delete;
+	SimulationThread& operator=(const SimulationThread&) = delete;
+
+	// Safe to call from any thread, the settings are applied before the next step.
+	void SetSettings(const SimulationSettings& settings);
+	SimulationSettings GetSettings() const;
+
+	// Latest published snapshot. Only the render thread may call this, the reference
+	// stays valid until its next call.
+	const ParticleSnapshot& AcquireSnapshot() { return m_Snapshots.Acquire(); }
+
+	// How far the render time has moved from the snapshot's earlier positions towards
+	// its later ones, in [0, 1].
+	static float GetInterpolationFactor(const ParticleSnapshot& snapshot);
+private:
+	void Run();
+	void ApplySettings(const SimulationSettings& settings);
+	void CapturePositions(std::vector<uint32_t>& positions) const;
+	void ReorderPreviousPositions();
+	void PublishSnapshot(float stepsPerSecond);
+private:
+	ParticleSystem m_ParticleSystem;
+	// Packed like ParticleVertex, indexed by slot.
+	std::vector<uint32_t> m_PreviousPositions;
+	std::vector<uint32_t> m_ReorderedPositions;
+	std::vector<uint32_t> m_Positions;
+	uint64_t m_Step = 0;
+	float m_TimeStep = 0.0f;
+
+	TripleBuffer<ParticleSnapshot> m_Snapshots;
+
+	mutable std::mutex m_SettingsMutex;
+	SimulationSettings m_Settings;
+	bool m_SettingsChanged = false;
+
+	std::atomic<bool> m_Running{ true };
+	std::thread m_Thread;
+};
@@ -0,0 +1,238 @@
+#include "SphSolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/constants.hpp>
+
+#if defined(__AVX2__)
+	#define SPH_KERNELS_AVX2
+	#include <immintrin.h>
+#endif
+
+namespace {
+
+	const int s_Lanes = 8;
+
+	// Per-call constants and the particles in cell order.
+	struct SphConstants
+	{
+		const float* X;
+		const float* Y;
+		const float* VelocityX;
+		const float* VelocityY;
+		const float* Pressure;
+		const float* InvDensity;
+		float Radius, RadiusSquared;
+	};
+
+	// Sums of one particle's neighbours, lane (j - rangeBegin) % 8 of every row of cells
+	// holds neighbour j.
+	struct DensityLanes
+	{
+		alignas(32) float Weight[s_Lanes];
+	};
+
+	struct ForceLanes
+	{
+		alignas(32) float PressureX[s_Lanes];
+		alignas(32) float PressureY[s_Lanes];
+		alignas(32) float ViscosityX[s_Lanes];
+		alignas(32) float ViscosityY[s_Lanes];
+	};
+
+	inline float ReduceLanes(const float* lanes)
+	{
+		return ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+	}
+
+#if defined(SPH_KERNELS_AVX2)
+	// Lanes [0, count) set, for the last block of a range.
+	inline __m256i TailMask(uint32_t count)
+	{
+		return _mm256_cmpgt_epi32(_mm256_set1_epi32((int)count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	}
+
+	void DensityRange(const SphConstants& c, uint32_t begin, uint32_t end, float x, float y, DensityLanes& sums)
+	{
+		const __m256 px = _mm256_set1_ps(x), py = _mm256_set1_ps(y);
+		const __m256 radiusSquared = _mm256_set1_ps(c.RadiusSquared);
+		__m256 weight = _mm256_load_ps(sums.Weight);
+		for (uint32_t j = begin; j < end; j += s_Lanes)
+		{
+			const __m256i tail = TailMask(end - j);
+			const __m256 dx = _mm256_sub_ps(px, _mm256_maskload_ps(c.X + j, tail));
+			const __m256 dy = _mm256_sub_ps(py, _mm256_maskload_ps(c.Y + j, tail));
+			const __m256 r2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+			const __m256 q = _mm256_sub_ps(radiusSquared, r2);
+			const __m256 inside = _mm256_and_ps(_mm256_cmp_ps(r2, radiusSquared, _CMP_LT_OQ), _mm256_castsi256_ps(tail));
+			weight = _mm256_add_ps(weight, _mm256_and_ps(_mm256_mul_ps(_mm256_mul_ps(q, q), q), inside));
+		}
+		_mm256_store_ps(sums.Weight, weight);
+	}
+
+	void ForceRange(const SphConstants& c, uint32_t begin, uint32_t end, uint32_t i, ForceLanes& sums)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 px = _mm256_set1_ps(c.X[i]), py = _mm256_set1_ps(c.Y[i]);
+		const __m256 vx = _mm256_set1_ps(c.VelocityX[i]), vy = _mm256_set1_ps(c.VelocityY[i]);
+		const __m256 pressure = _mm256_set1_ps(c.Pressure[i]);
+		const __m256 radius = _mm256_set1_ps(c.Radius);
+		const __m256 radiusSquared = _mm256_set1_ps(c.RadiusSquared);
+		__m256 pressureX = _mm256_load_ps(sums.PressureX), pressureY = _mm256_load_ps(sums.PressureY);
+		__m256 viscosityX = _mm256_load_ps(sums.ViscosityX), viscosityY = _mm256_load_ps(sums.ViscosityY);
+		for (uint32_t j = begin; j < end; j += s_Lanes)
+		{
+			const __m256i tail = TailMask(end - j);
+			const __m256 dx = _mm256_sub_ps(px, _mm256_maskload_ps(c.X + j, tail));
+			const __m256 dy = _mm256_sub_ps(py, _mm256_maskload_ps(c.Y + j, tail));
+			const __m256 r2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+			const __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(r2, radiusSquared, _CMP_LT_OQ),
+				_mm256_cmp_ps(r2, zero, _CMP_GT_OQ)), _mm256_castsi256_ps(tail));
+			const __m256 r = _mm256_sqrt_ps(r2);
+			const __m256 diff = _mm256_sub_ps(radius, r);
+			const __m256 invDensity = _mm256_maskload_ps(c.InvDensity + j, tail);
+			const __m256 neighbourPressure = _mm256_maskload_ps(c.Pressure + j, tail);
+			const __m256 gradient = _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(pressure, neighbourPressure), invDensity),
+				_mm256_div_ps(_mm256_mul_ps(diff, diff), r));
+			const __m256 laplacian = _mm256_mul_ps(diff, invDensity);
+			const __m256 relativeX = _mm256_sub_ps(_mm256_maskload_ps(c.VelocityX + j, tail), vx);
+			const __m256 relativeY = _mm256_sub_ps(_mm256_maskload_ps(c.VelocityY + j, tail), vy);
+			pressureX = _mm256_add_ps(pressureX, _mm256_and_ps(_mm256_mul_ps(gradient, dx), inside));
+			pressureY = _mm256_add_ps(pressureY, _mm256_and_ps(_mm256_mul_ps(gradient, dy), inside));
+			viscosityX = _mm256_add_ps(viscosityX, _mm256_and_ps(_mm256_mul_ps(relativeX, laplacian), inside));
+			viscosityY = _mm256_add_ps(viscosityY, _mm256_and_ps(_mm256_mul_ps(relativeY, laplacian), inside));
+		}
+		_mm256_store_ps(sums.PressureX, pressureX);
+		_mm256_store_ps(sums.PressureY, pressureY);
+		_mm256_store_ps(sums.ViscosityX, viscosityX);
+		_mm256_store_ps(sums.ViscosityY, viscosityY);
+	}
+#else
+	void DensityRange(const SphConstants& c, uint32_t begin, uint32_t end, float x, float y, DensityLanes& sums)
+	{
+		for (uint32_t j = begin; j < end; ++j)
+		{
+			const float dx = x - c.X[j], dy = y - c.Y[j];
+			const float r2 = dx * dx + dy * dy;
+			const float q = c.RadiusSquared - r2;
+			sums.Weight[(j - begin) % s_Lanes] += r2 < c.RadiusSquared ? q * q * q : 0.0f;
+		}
+	}
+
+	void ForceRange(const SphConstants& c, uint32_t begin, uint32_t end, uint32_t i, ForceLanes& sums)
+	{
+		const float x = c.X[i], y = c.Y[i];
+		const float vx = c.VelocityX[i], vy = c.VelocityY[i];
+		const float pressure = c.Pressure[i];
+		for (uint32_t j = begin; j < end; ++j)
+		{
+			const float dx = x - c.X[j], dy = y - c.Y[j];
+			const float r2 = dx * dx + dy * dy;
+			const bool inside = r2 < c.RadiusSquared && r2 > 0.0f;
+			const float r = std::sqrt(r2);
+			const float diff = c.Radius - r;
+			const float gradient = ((pressure + c.Pressure[j]) * c.InvDensity[j]) * ((diff * diff) / r);
+			const float laplacian = diff * c.InvDensity[j];
+			const uint32_t lane = (j - begin) % s_Lanes;
+			sums.PressureX[lane] += inside ? gradient * dx : 0.0f;
+			sums.PressureY[lane] += inside ? gradient * dy : 0.0f;
+			sums.ViscosityX[lane] += inside ? (c.VelocityX[j] - vx) * laplacian : 0.0f;
+			sums.ViscosityY[lane] += inside ? (c.VelocityY[j] - vy) * laplacian : 0.0f;
+		}
+	}
+#endif
+
+	// Calls fn(begin, end) for the run of particles in every row of cells within
+	// cellRadius of the cell the position falls in.
+	template<typename Fn>
+	inline void ForEachNeighbourRow(const CellIndex& cellIndex, float x, float y, float invCellSize, int cellRadius, Fn&& fn)
+	{
+		const int width = cellIndex.GetWidth(), height = cellIndex.GetHeight();
+		const int cellX = (int)std::min(std::max(x * invCellSize, 0.0f), (float)(width - 1));
+		const int cellY = (int)std::min(std::max(y * invCellSize, 0.0f), (float)(height - 1));
+		const int xBegin = std::max(cellX - cellRadius, 0), xEnd = std::min(cellX + cellRadius, width - 1);
+		const int yBegin = std::max(cellY - cellRadius, 0), yEnd = std::min(cellY + cellRadius, height - 1);
+		for (int row = yBegin; row <= yEnd; ++row)
+			fn(cellIndex.GetCellStart(xBegin, row), cellIndex.GetCellEnd(xEnd, row));
+	}
+
+}
+
+void SphSolver::Apply(ParticleStore& particles, CellIndex& cellIndex, const SphSettings& settings,
+	float cellSize, glm::vec2 domainSize, ThreadPool& pool)
+{
+	const float invCellSize = 1.0f / cellSize;
+	cellIndex.Bin(particles, invCellSize, pool);
+	const std::vector<uint32_t>& cellParticles = cellIndex.GetCellParticles();
+	// Only the live particles were binned, the free slots carry no mass.
+	const int count = (int)cellParticles.size();
+	if (count == 0)
+		return;
+
+	m_PositionX.resize(count);
+	m_PositionY.resize(count);
+	m_VelocityX.resize(count);
+	m_VelocityY.resize(count);
+	m_Pressure.resize(count);
+	m_InvDensity.resize(count);
+	pool.ParallelFor(0, count, [&](int begin, int end) {
+		for (int k = begin; k < end; ++k)
+		{
+			const uint32_t i = cellParticles[k];
+			m_PositionX[k] = particles.PositionX[i];
+			m_PositionY[k] = particles.PositionY[i];
+			m_VelocityX[k] = particles.VelocityX[i];
+			m_VelocityY[k] = particles.VelocityY[i];
+		}
+	});
+
+	const float h = settings.Radius * cellSize;
+	const int cellRadius = (int)std::ceil(settings.Radius);
+	const float pi = glm::pi<float>();
+	const float mass = domainSize.x * domainSize.y / (float)count;
+	const float densityScale = mass * 4.0f / (pi * std::pow(h, 8.0f));
+	// The spiky gradient is 30 / (pi h^5), halved by the symmetric pressure average.
+	const float pressureScale = mass * 15.0f / (pi * std::pow(h, 5.0f));
+	const float viscosityScale = settings.Viscosity * mass * 40.0f / (pi * std::pow(h, 5.0f));
+
+	SphConstants c;
+	c.X = m_PositionX.data();
+	c.Y = m_PositionY.data();
+	c.VelocityX = m_VelocityX.data();
+	c.VelocityY = m_VelocityY.data();
+	c.Pressure = m_Pressure.data();
+	c.InvDensity = m_InvDensity.data();
+	c.Radius = h;
+	c.RadiusSquared = h * h;
+
+	// The density and pressure of every particle have to be known before any force.
+	pool.ParallelFor(0, count, [&](int begin, int end) {
+		for (int k = begin; k < end; ++k)
+		{
+			DensityLanes sums = {};
+			const float x = c.X[k], y = c.Y[k];
+			ForEachNeighbourRow(cellIndex, x, y, invCellSize, cellRadius, [&](uint32_t rowBegin, uint32_t rowEnd) {
+				DensityRange(c, rowBegin, rowEnd, x, y, sums);
+			});
+			const float density = densityScale * ReduceLanes(sums.Weight);
+			// No tension, which would pull particles into clumps that nothing resolves.
+			m_Pressure[k] = std::max(settings.Stiffness * (density - settings.RestDensity), 0.0f);
+			m_InvDensity[k] = 1.0f / density;
+			particles.Density[cellParticles[k]] = density;
+		}
+	});
+
+	pool.ParallelFor(0, count, [&](int begin, int end) {
+		for (int k = begin; k < end; ++k)
+		{
+			ForceLanes sums = {};
+			ForEachNeighbourRow(cellIndex, c.X[k], c.Y[k], invCellSize, cellRadius, [&](uint32_t rowBegin, uint32_t rowEnd) {
+				ForceRange(c, rowBegin, rowEnd, (uint32_t)k, sums);
+			});
+			const uint32_t i = cellParticles[k];
+			particles.ForceX[i] += (pressureScale * ReduceLanes(sums.PressureX) + viscosityScale * ReduceLanes(sums.ViscosityX)) * m_InvDensity[k];
+			particles.ForceY[i] += (pressureScale * ReduceLanes(sums.PressureY) + viscosityScale * ReduceLanes(sums.ViscosityY)) * m_InvDensity[k];
+		}
+	});
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "AlignedAllocator.h"
+#include "CellIndex.h"
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+
+struct SphSettings
+{
+	// Off leaves the particles without any forces between them.
+	bool Enabled = false;
+	// Smoothing length in cells. The neighbour search covers every cell it reaches.
+	float Radius = 2.0f;
+	// Density above which the pressure pushes particles apart, relative to the mean
+	// density of the particles over the domain.
+	float RestDensity = 1.0f;
+	// Pressure per unit of density above the rest density, the square of the speed of
+	// sound in domain units per second. Kept well under a cell per step to stay stable.
+	float Stiffness = 0.01f;
+	float Viscosity = 0.001f;
+};
+
+// Smoothed particle hydrodynamics between the particles. Each particle weighs the
+// same, so that the mean density over the domain is 1. The density uses the poly6
+// kernel, the pressure force the spiky kernel's gradient and the viscosity the
+// viscosity kernel's Laplacian, all in their 2D forms.
+//
+// Neighbours come from a uniform grid. The particles are binned with the CellIndex
+// every step and copied out in cell order, so the neighbours of a particle in one row
+// of cells are contiguous and are read eight at a time with AVX2. Every path sums the
+// neighbours into the same eight lanes and reduces them in the same order, so the
+// scalar path gives the same results as the AVX2 one.
+class SphSolver
+{
+public:
+	// Writes every particle's density to Density and adds the pressure and viscosity
+	// accelerations to ForceX and ForceY.
+	void Apply(ParticleStore& particles, CellIndex& cellIndex, const SphSettings& settings,
+		float cellSize, glm::vec2 domainSize, ThreadPool& pool);
+private:
+	// Particle state in cell order, by the particle's place in GetCellParticles.
+	AlignedVector<float> m_PositionX, m_PositionY;
+	AlignedVector<float> m_VelocityX, m_VelocityY;
+	AlignedVector<float> m_Pressure, m_InvDensity;
+};
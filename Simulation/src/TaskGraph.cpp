@@ -0,0 +1,142 @@
+#include "TaskGraph.h"
+
+#include <algorithm>
+#include <cstdio>
+
+TaskGraph::TaskId TaskGraph::AddTask(const std::string& name, std::function<void()> fn, std::initializer_list<TaskId> dependencies)
+{
+	const TaskId id = (TaskId)m_Tasks.size();
+	Task task;
+	task.Name = name;
+	task.Fn = std::move(fn);
+	task.ProfileScope = Profiler::RegisterScope(name);
+	task.Dependencies.assign(dependencies.begin(), dependencies.end());
+	for (TaskId dependency : dependencies)
+		m_Tasks[dependency].Dependents.push_back(id);
+	m_Tasks.push_back(std::move(task));
+	return id;
+}
+
+void TaskGraph::Run(ThreadPool& pool)
+{
+	if (m_RemainingDependencies.size() != m_Tasks.size())
+		m_RemainingDependencies = std::vector<std::atomic<int>>(m_Tasks.size());
+	for (size_t i = 0; i < m_Tasks.size(); ++i)
+		m_RemainingDependencies[i].store((int)m_Tasks[i].Dependencies.size(), std::memory_order_relaxed);
+
+	ThreadPool::TaskCounter pending{ 0 };
+	m_Pool = &pool;
+	m_Pending = &pending;
+	m_RunStart = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < m_Tasks.size(); ++i)
+	{
+		if (m_Tasks[i].Dependencies.empty())
+			pool.Spawn(pending, this, &TaskGraph::Invoke, (int)i, (int)i + 1);
+	}
+	pool.Wait(pending);
+
+	m_LastThreadCount = pool.GetThreadCount();
+	m_LastRunMs = MillisecondsSinceStart();
+	m_Pool = nullptr;
+	m_Pending = nullptr;
+}
+
+void TaskGraph::Invoke(void* context, int id, int)
+{
+	static_cast<TaskGraph*>(context)->Execute(id);
+}
+
+void TaskGraph::Execute(TaskId id)
+{
+	Task& task = m_Tasks[id];
+	task.Timing.Thread = m_Pool->GetCurrentThreadIndex();
+	task.Timing.StartMs = MillisecondsSinceStart();
+	{
+		PROFILE_SCOPE_ID(task.ProfileScope);
+		task.Fn();
+	}
+	task.Timing.EndMs = MillisecondsSinceStart();
+
+	// Queued before this task counts as finished, so the run cannot end in between.
+	for (TaskId dependent : task.Dependents)
+	{
+		if (m_RemainingDependencies[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1)
+			m_Pool->Spawn(*m_Pending, this, &TaskGraph::Invoke, dependent, dependent + 1);
+	}
+}
+
+double TaskGraph::MillisecondsSinceStart() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_RunStart).count();
+}
+
+std::vector<TaskGraph::TaskId> TaskGraph::GetCriticalPath() const
+{
+	// Ids are already in dependency order, so one pass finds the longest chain ending
+	// at every task.
+	std::vector<double> chainMs(m_Tasks.size(), 0.0);
+	std::vector<TaskId> previous(m_Tasks.size(), -1);
+	TaskId last = -1;
+	for (size_t i = 0; i < m_Tasks.size(); ++i)
+	{
+		const Task& task = m_Tasks[i];
+		for (TaskId dependency : task.Dependencies)
+		{
+			if (previous[i] == -1 || chainMs[dependency] > chainMs[previous[i]])
+				previous[i] = dependency;
+		}
+		chainMs[i] = (task.Timing.EndMs - task.Timing.StartMs) + (previous[i] == -1 ? 0.0 : chainMs[previous[i]]);
+		if (last == -1 || chainMs[i] > chainMs[last])
+			last = (TaskId)i;
+	}
+
+	std::vector<TaskId> path;
+	for (TaskId id = last; id != -1; id = previous[id])
+		path.push_back(id);
+	std::reverse(path.begin(), path.end());
+	return path;
+}
+
+std::string TaskGraph::DumpSchedule() const
+{
+	std::string text;
+	char line[256];
+	std::snprintf(line, sizeof(line), "%zu tasks on %u threads, %.3f ms\n", m_Tasks.size(), m_LastThreadCount, m_LastRunMs);
+	text += line;
+	std::snprintf(line, sizeof(line), "%-3s %-28s %5s %6s %10s %10s %10s  %s\n",
+		"Id", "Task", "Level", "Thread", "Start ms", "End ms", "Length ms", "After");
+	text += line;
+
+	// A task's level is the number of tasks on the longest chain before it, so tasks
+	// on the same level may run at the same time.
+	std::vector<int> levels(m_Tasks.size(), 0);
+	for (size_t i = 0; i < m_Tasks.size(); ++i)
+	{
+		const Task& task = m_Tasks[i];
+		std::string after;
+		for (TaskId dependency : task.Dependencies)
+		{
+			levels[i] = std::max(levels[i], levels[dependency] + 1);
+			after += (after.empty() ? "" : ", ") + std::to_string(dependency);
+		}
+		std::snprintf(line, sizeof(line), "%-3zu %-28s %5d %6u %10.3f %10.3f %10.3f  %s\n",
+			i, task.Name.c_str(), levels[i], task.Timing.Thread, task.Timing.StartMs, task.Timing.EndMs,
+			task.Timing.EndMs - task.Timing.StartMs, after.empty() ? "-" : after.c_str());
+		text += line;
+	}
+
+	const std::vector<TaskId> path = GetCriticalPath();
+	double pathMs = 0.0;
+	std::string names;
+	for (TaskId id : path)
+	{
+		pathMs += m_Tasks[id].Timing.EndMs - m_Tasks[id].Timing.StartMs;
+		names += (names.empty() ? "" : " -> ") + m_Tasks[id].Name;
+	}
+	std::snprintf(line, sizeof(line), "Critical path: %.3f ms (%.0f%% of the run)\n",
+		pathMs, m_LastRunMs > 0.0 ? pathMs * 100.0 / m_LastRunMs : 0.0);
+	text += line;
+	text += "  " + names + "\n";
+	return text;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+// Stages of a step and the stages each of them has to wait for. Run starts every
+// stage on the pool as soon as its dependencies have finished, so independent stages
+// run side by side and their ParallelFor bands share the same queues. The graph is
+// built once and run every step; the timings of the last run are kept for tuning, and
+// every task is a profiler scope of the same name.
+class TaskGraph
+{
+public:
+	using TaskId = int;
+
+	struct TaskTiming
+	{
+		// Milliseconds since the start of the run, and the pool thread that ran it.
+		double StartMs = 0.0, EndMs = 0.0;
+		uint32_t Thread = 0;
+	};
+
+	// Dependencies must already be in the graph, which keeps it free of cycles and
+	// the ids in a valid execution order.
+	TaskId AddTask(const std::string& name, std::function<void()> fn, std::initializer_list<TaskId> dependencies = {});
+
+	// Runs every task once and returns when they have all finished.
+	void Run(ThreadPool& pool);
+
+	size_t GetTaskCount() const { return m_Tasks.size(); }
+	const std::string& GetTaskName(TaskId id) const { return m_Tasks[id].Name; }
+	const TaskTiming& GetTiming(TaskId id) const { return m_Tasks[id].Timing; }
+	double GetLastRunMs() const { return m_LastRunMs; }
+
+	// Chain of dependent tasks with the longest total duration in the last run. No
+	// amount of threads makes a step shorter than this chain.
+	std::vector<TaskId> GetCriticalPath() const;
+	// Table of every task with its dependency level, thread and timing in the last run,
+	// followed by the critical path.
+	std::string DumpSchedule() const;
+private:
+	struct Task
+	{
+		std::string Name;
+		std::function<void()> Fn;
+		std::vector<TaskId> Dependencies;
+		std::vector<TaskId> Dependents;
+		TaskTiming Timing;
+		ProfileScopeId ProfileScope;
+	};
+
+	static void Invoke(void* context, int id, int);
+	void Execute(TaskId id);
+	double MillisecondsSinceStart() const;
+private:
+	std::vector<Task> m_Tasks;
+
+	// State of the run in progress.
+	std::vector<std::atomic<int>> m_RemainingDependencies;
+	ThreadPool* m_Pool = nullptr;
+	ThreadPool::TaskCounter* m_Pending = nullptr;
+	std::chrono::steady_clock::time_point m_RunStart;
+
+	uint32_t m_LastThreadCount = 0;
+	double m_LastRunMs = 0.0;
+};
@@ -0,0 +1,224 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <string>
+
+#include "Profiler.h"
+
+// Pool the current thread works for and the queue it owns there, so nested calls
+// push onto their own thread's queue.
+static thread_local const ThreadPool* t_Pool = nullptr;
+static thread_local uint32_t t_QueueIndex = 0;
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+	SetThreadCount(threadCount);
+}
+
+ThreadPool::~ThreadPool()
+{
+	StopWorkers();
+}
+
+void ThreadPool::SetThreadCount(uint32_t threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	StopWorkers();
+	StartWorkers(threadCount - 1);
+}
+
+uint32_t ThreadPool::GetCurrentThreadIndex() const
+{
+	return t_Pool == this ? t_QueueIndex : 0;
+}
+
+void ThreadPool::StartWorkers(uint32_t workerCount)
+{
+	m_Stop = false;
+	m_Queues.clear();
+	for (uint32_t i = 0; i <= workerCount; ++i)
+		m_Queues.push_back(std::make_unique<WorkQueue>());
+
+	m_Workers.reserve(workerCount);
+	for (uint32_t i = 0; i < workerCount; ++i)
+		m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i + 1);
+}
+
+void ThreadPool::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_WakeCondition.notify_all();
+	for (std::thread& worker : m_Workers)
+		worker.join();
+	m_Workers.clear();
+}
+
+void ThreadPool::Run(int begin, int end, void* context, InvokeFn invoke)
+{
+	if (end <= begin)
+		return;
+
+	// Small ranges and single-threaded pools skip the queues entirely.
+	const int threadCount = (int)GetThreadCount();
+	if (threadCount == 1 || end - begin == 1)
+	{
+		invoke(context, begin, end);
+		return;
+	}
+
+	// A few bands per thread evens out rows that are cheaper than others.
+	const int bandCount = std::min(end - begin, threadCount * 4);
+	const int range = end - begin;
+	TaskCounter counter{ bandCount };
+	{
+		// Queued last band first, so the owner, which pops from the back, starts at the
+		// first rows and thieves start at the last.
+		WorkQueue& queue = *m_Queues[GetCurrentThreadIndex()];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		for (int band = bandCount - 1; band >= 0; --band)
+		{
+			int bandBegin = begin + (int)((int64_t)range * band / bandCount);
+			int bandEnd = begin + (int)((int64_t)range * (band + 1) / bandCount);
+			queue.PushBack({ context, invoke, bandBegin, bandEnd, &counter });
+		}
+	}
+	NotifyQueued(bandCount);
+	Wait(counter);
+}
+
+void ThreadPool::Spawn(TaskCounter& counter, void* context, InvokeFn invoke, int begin, int end)
+{
+	counter.fetch_add(1, std::memory_order_relaxed);
+	{
+		WorkQueue& queue = *m_Queues[GetCurrentThreadIndex()];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		queue.PushBack({ context, invoke, begin, end, &counter });
+	}
+	NotifyQueued(1);
+}
+
+void ThreadPool::Wait(TaskCounter& counter)
+{
+	const uint32_t queueIndex = GetCurrentThreadIndex();
+	while (counter.load(std::memory_order_acquire) != 0)
+	{
+		Task task;
+		if (!TryPop(queueIndex, task))
+		{
+			// The remaining tasks are running on other threads, they are short enough
+			// that yielding beats putting this thread to sleep.
+			std::this_thread::yield();
+			continue;
+		}
+		Execute(task);
+	}
+}
+
+void ThreadPool::NotifyQueued(int count)
+{
+	m_QueuedTasks.fetch_add(count, std::memory_order_seq_cst);
+
+	// Taking the mutex orders this with a worker that has just found nothing to do and
+	// is about to sleep, so the wake-up cannot be missed.
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+	}
+	if (count == 1)
+		m_WakeCondition.notify_one();
+	else
+		m_WakeCondition.notify_all();
+}
+
+bool ThreadPool::TryPop(uint32_t queueIndex, Task& task)
+{
+	if (m_QueuedTasks.load(std::memory_order_seq_cst) == 0)
+		return false;
+
+	// Newest work of our own first, it is the most likely to still be in cache.
+	{
+		WorkQueue& queue = *m_Queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		if (queue.Count > 0)
+		{
+			task = queue.PopBack();
+			m_QueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	// Then the oldest work of the other threads, which tends to be the largest.
+	const uint32_t queueCount = (uint32_t)m_Queues.size();
+	for (uint32_t i = 1; i < queueCount; ++i)
+	{
+		WorkQueue& queue = *m_Queues[(queueIndex + i) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		if (queue.Count > 0)
+		{
+			task = queue.PopFront();
+			m_QueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::WorkQueue::PushBack(const Task& task)
+{
+	if (Count == Tasks.size())
+	{
+		// Unrolls the ring into a buffer twice the size, oldest task first.
+		std::vector<Task> grown(std::max<size_t>(64, Tasks.size() * 2));
+		for (size_t i = 0; i < Count; ++i)
+			grown[i] = Tasks[(Front + i) % Tasks.size()];
+		Tasks.swap(grown);
+		Front = 0;
+	}
+	Tasks[(Front + Count) % Tasks.size()] = task;
+	++Count;
+}
+
+ThreadPool::Task ThreadPool::WorkQueue::PopBack()
+{
+	--Count;
+	return Tasks[(Front + Count) % Tasks.size()];
+}
+
+ThreadPool::Task ThreadPool::WorkQueue::PopFront()
+{
+	const Task task = Tasks[Front];
+	Front = (Front + 1) % Tasks.size();
+	--Count;
+	return task;
+}
+
+void ThreadPool::Execute(const Task& task)
+{
+	task.Invoke(task.Context, task.Begin, task.End);
+	task.Counter->fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void ThreadPool::WorkerLoop(uint32_t queueIndex)
+{
+	t_Pool = this;
+	t_QueueIndex = queueIndex;
+	PROFILE_THREAD("Worker " + std::to_string(queueIndex));
+	for (;;)
+	{
+		Task task;
+		if (TryPop(queueIndex, task))
+		{
+			Execute(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_WakeCondition.wait(lock, [this]() { return m_Stop || m_QueuedTasks.load(std::memory_order_seq_cst) > 0; });
+		if (m_Stop)
+			return;
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Persistent pool of worker threads that runs the solver kernels as row bands and the
+// stages of a TaskGraph. Workers are created once and sleep while there is no work,
+// so no threads are spawned per frame.
+//
+// Every thread has its own queue. A thread pushes and pops work at the back of its
+// queue and, when that is empty, steals from the front of the others, so a stage that
+// splits into bands keeps them on its own thread unless another thread runs dry.
+class ThreadPool
+{
+public:
+	// Number of spawned tasks that have not finished yet.
+	using TaskCounter = std::atomic<int>;
+	using InvokeFn = void(*)(void*, int, int);
+
+	// A thread count of 0 uses every hardware thread. The count includes the calling
+	// thread, which always takes part in the work.
+	explicit ThreadPool(uint32_t threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Must not be called while work is in flight.
+	void SetThreadCount(uint32_t threadCount);
+	uint32_t GetThreadCount() const { return (uint32_t)m_Workers.size() + 1; }
+	// Index of the calling thread in this pool, 0 for threads the pool does not own.
+	uint32_t GetCurrentThreadIndex() const;
+
+	// Splits [begin, end) into contiguous bands, calls fn(bandBegin, bandEnd) for each
+	// and returns once every band is done, so each call doubles as a barrier between
+	// dependent stages. The calling thread runs bands, and any other queued work,
+	// while it waits, which makes nested calls from inside a band or a graph stage
+	// safe and lets them spread over idle threads.
+	template<typename Fn>
+	void ParallelFor(int begin, int end, Fn&& fn)
+	{
+		using FnType = typename std::remove_reference<Fn>::type;
+		Run(begin, end, &fn, [](void* context, int bandBegin, int bandEnd)
+		{
+			(*static_cast<FnType*>(context))(bandBegin, bandEnd);
+		});
+	}
+
+	// Queues invoke(context, begin, end) on the calling thread's queue and counts it
+	// in counter, which is decremented once it has run. Wait helps run queued work
+	// until counter reaches zero.
+	void Spawn(TaskCounter& counter, void* context, InvokeFn invoke, int begin, int end);
+	void Wait(TaskCounter& counter);
+private:
+	struct Task
+	{
+		void* Context;
+		InvokeFn Invoke;
+		int Begin, End;
+		TaskCounter* Counter;
+	};
+
+	// Ring buffer of tasks that only ever grows, so once it has held the most work a
+	// step queues at once, queueing allocates nothing.
+	struct WorkQueue
+	{
+		std::mutex Mutex;
+		std::vector<Task> Tasks;
+		size_t Front = 0, Count = 0;
+
+		void PushBack(const Task& task);
+		Task PopBack();
+		Task PopFront();
+	};
+
+	void Run(int begin, int end, void* context, InvokeFn invoke);
+	void NotifyQueued(int count);
+	bool TryPop(uint32_t queueIndex, Task& task);
+	void Execute(const Task& task);
+	void StartWorkers(uint32_t workerCount);
+	void StopWorkers();
+	void WorkerLoop(uint32_t queueIndex);
+private:
+	std::vector<std::thread> m_Workers;
+	// Queue 0 is shared by every thread outside the pool, worker i owns queue i + 1.
+	std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+	std::atomic<int> m_QueuedTasks{ 0 };
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WakeCondition;
+	bool m_Stop = false;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free hand-off of the latest value from one writer thread to one reader thread.
+// The writer fills GetWriteBuffer() and publishes it, the reader picks up whatever was
+// published last. Neither side ever waits, and a buffer is never written while the
+// reader holds it, so published values can be read as immutable snapshots.
+template<typename T>
+class TripleBuffer
+{
+public:
+	// Writer side. The buffer still holds whatever was published into it two swaps
+	// ago, which lets large snapshots reuse their storage.
+	T& GetWriteBuffer() { return m_Buffers[m_WriteIndex]; }
+
+	void Publish()
+	{
+		int previous = m_Shared.exchange(m_WriteIndex | s_FreshBit, std::memory_order_acq_rel);
+		m_WriteIndex = previous & s_IndexMask;
+	}
+
+	// Reader side. Returns the most recently published buffer, which stays valid and
+	// unchanged until the next call.
+	const T& Acquire()
+	{
+		if (m_Shared.load(std::memory_order_acquire) & s_FreshBit)
+		{
+			int previous = m_Shared.exchange(m_ReadIndex, std::memory_order_acq_rel);
+			m_ReadIndex = previous & s_IndexMask;
+		}
+		return m_Buffers[m_ReadIndex];
+	}
+private:
+	static constexpr int s_IndexMask = 3;
+	static constexpr int s_FreshBit = 4;
+
+	T m_Buffers[3];
+	int m_WriteIndex = 0;
+	int m_ReadIndex = 1;
+	// Index of the buffer between the two sides, plus whether it is newer than the reader's.
+	std::atomic<int> m_Shared{ 2 };
+};